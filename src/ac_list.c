@@ -23,10 +23,12 @@
 #include "add_unvers.h"
 #include "props.h"
 #include "info.h"
+#include "manifest.h"
 #include "revert.h"
 #include "remote.h"
 #include "resolve.h"
 #include "build.h"
+#include "spool.h"
 
 
 /** \file
@@ -64,6 +66,8 @@ static const char
 			*acl_diff[]   = { "diff", NULL },
 			*acl_help[]   = { "help", "?", NULL },
 			*acl_info[]   = { "info", NULL },
+			*acl_manif[]  = { "manifest", NULL },
+			*acl_push[]   = { "push", NULL },
 			/** \todo: remove initialize */
 			*acl_urls[]   = { "urls", "initialize", NULL };
 
@@ -100,6 +104,9 @@ struct actionlist_t action_list[]=
 	/* The first action is the default. */
 	ACT(status,   st__work,   st__action, FILTER, STS_WRITE, DIR_UPD, RO),
 	ACT(commit,   ci__work,   ci__action, UNINIT, FILTER, DIR_UPD),
+	/* The commits are done by child processes, which switch to the commit 
+	 * action; so the WC lock isn't held between them. */
+	ACT(  push, spl__push,         NULL, RO),
 	ACT(update,   up__work, st__progress, UNINIT, DECODER),
 	ACT(export,  exp__work,         NULL, .is_import_export=1, DECODER),
 	ACT(unvers,   au__work,   au__action, .i_val=RF_UNVERSION, STS_WRITE),
@@ -124,6 +131,7 @@ struct actionlist_t action_list[]=
 	 * (default /var/spool/fsvs) to exist. */
 	ACT(  help,  ac__Usage,         NULL, .is_import_export=1, RO),
 	ACT(  info, info__work, info__action, RO),
+	ACT( manif,  man__work,         NULL, RO),
 	ACT(prop_g,prp__g_work,         NULL, RO),
 	ACT(prop_s,prp__s_work,         NULL, .i_val=FS_NEW),
 	ACT(prop_d,prp__s_work,         NULL, .i_val=FS_REMOVED),
@@ -47,9 +47,9 @@ int bld__work(struct estat *root, int argc, char *argv[])
 	root->do_userselected = 1;
 	opt_recursive=1;
 
-	STOPIF( waa__build_tree(root), NULL);
-	DEBUGP("build tree, now saving");
-	STOPIF( waa__output_tree(root), NULL);
+	/* The directories are read while the list is written, so that big trees 
+	 * don't need to be kept in memory. */
+	STOPIF( waa__build_output_tree(root), NULL);
 
 ex:
 	return status;
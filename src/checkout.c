@@ -54,6 +54,10 @@
  * \n If there's a need to create that directory, please say so; patches 
  * for some parameter like \c -p are welcome.
  *
+ * \note An interrupted checkout is not resumed -- the files it has 
+ * already fetched aren't recorded in the \ref upd "update journal", so 
+ * please clean the directory and start the checkout again.
+ *
  * For a format definition of the URLs please see the chapter \ref 
  * url_format and the \ref urls and \ref update commands.
  *
@@ -12,12 +12,24 @@
 #include <unistd.h>
 #include <apr_md5.h>
 #include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <limits.h>
+#include <string.h>
 
 #include "checksum.h"
 #include "helper.h"
 #include "global.h"
 #include "est_ops.h"
 #include "waa.h"
+#include "status.h"
+#include "md5_mb.h"
+
+#ifdef HAVE_LINUX_FIEMAP_H
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
 
 
 /** \file
@@ -25,6 +37,11 @@
 
 #define MAPSIZE (32*1024*1024)
 
+/** How many bytes a range of a file should have at least, before it gets 
+ * verified in a process of its own.
+ * See \ref o_verify_jobs. */
+#define CS__MIN_RANGE_SIZE (64*1024*1024)
+
 
 
 /** CRC table.
@@ -111,6 +128,8 @@ int cs___manber_data_init(struct t_manber_data *mbd,
 int cs___end_of_block(const unsigned char *data, int maxlen, 
 		int *eob, 
 		struct t_manber_data *mb_f);
+/** Finishes the MD5 of a block that has no manber border. */
+void cs___finish_block(struct t_manber_data *mb_f);
 
 
 /** Hex-character to ascii. 
@@ -282,6 +301,239 @@ ex:
 }
 
 
+/** Hashes a small file with plain \c read() calls.
+ *
+ * Small files have no \ref md5s, so the manber blocks would only be 
+ * calculated to be thrown away again - and the data would be run through 
+ * MD5 twice (for the block and for the full file). Mapping and unmapping 
+ * costs more than reading a few KB, too.
+ *
+ * The buffer is kept for the next file. */
+int cs___hash_small(int fh, char *fullpath, md5_digest_t md5)
+{
+	int status;
+	ssize_t len;
+	apr_md5_ctx_t ctx;
+	static unsigned char *buffer=NULL;
+
+
+	status=0;
+	if (!buffer)
+		STOPIF( hlp__alloc( &buffer, CS__MIN_FILE_SIZE), NULL);
+
+	apr_md5_init(&ctx);
+	while (1)
+	{
+		len=read(fh, buffer, CS__MIN_FILE_SIZE);
+		STOPIF_CODE_ERR( len == -1, errno, "reading %s", fullpath);
+		if (len == 0) break;
+
+		apr_md5_update(&ctx, buffer, len);
+		st__bytes_hashed+=len;
+		STOPIF( hlp__throttle(len), NULL);
+	}
+	apr_md5_final(md5, &ctx);
+
+ex:
+	return status;
+}
+
+
+/** Verifies the stored blocks \a first up to (excluding) \a last of a 
+ * file.
+ *
+ * The manber state gets reset at each block border, so a range that 
+ * starts at a stored border can be checked without looking at the data 
+ * before. \a changed is set on the first difference, and the range is not 
+ * read any further.
+ *
+ * If \a last is the final block, and that ends at the end of the file 
+ * (ie. it's the rest after the last border), its MD5 is compared, too. */
+int cs___verify_range(struct estat *sts, int fh, 
+		struct cs__manber_hashes *mbh, 
+		unsigned first, unsigned last,
+		int *changed)
+{
+	int status, i;
+	unsigned hash_pos, buf_pos;
+	off_t pos, stop;
+	ssize_t len;
+	struct t_manber_data mb_dat;
+	unsigned char *buffer;
+
+
+	buffer=NULL;
+	*changed=1;
+	STOPIF( hlp__alloc( &buffer, MAPSIZE), NULL);
+	STOPIF( cs___manber_data_init(&mb_dat, sts), NULL );
+
+	pos= first ? mbh->end[first-1] : 0;
+	stop=mbh->end[last-1];
+	mb_dat.fpos=pos;
+	hash_pos=first;
+	DEBUGP("verifying blocks %u to %u, bytes %llu to %llu",
+			first, last, (t_ull)pos, (t_ull)stop);
+
+	while (pos < stop)
+	{
+		len=pread(fh, buffer, 
+				stop-pos < MAPSIZE ? stop-pos : MAPSIZE, pos);
+		STOPIF_CODE_ERR( len == -1, errno, "reading at %llu", (t_ull)pos);
+		/* File got shorter? */
+		if (len == 0) goto ex;
+
+		buf_pos=0;
+		while (buf_pos < len)
+		{
+			STOPIF( cs___end_of_block(buffer+buf_pos, len-buf_pos,
+						&i, &mb_dat ), NULL);
+			if (i==-1) break;
+
+			if (hash_pos >= last ||
+					mb_dat.last_state != mbh->hash[hash_pos] ||
+					mb_dat.fpos != mbh->end[hash_pos] ||
+					memcmp(mb_dat.block_md5, mbh->md5[hash_pos], 
+						APR_MD5_DIGESTSIZE) != 0)
+			{
+				DEBUGP("block #%u differs", hash_pos);
+				goto ex;
+			}
+
+			hash_pos++;
+			STOPIF( cs___end_of_block(NULL, 0, NULL, &mb_dat), NULL );
+			buf_pos+=i;
+		}
+
+		pos+=len;
+	}
+
+	if (hash_pos == last-1 && last == mbh->count)
+	{
+		/* The rest of the file, after the last border. */
+		cs___finish_block(&mb_dat);
+		if (mb_dat.fpos != mbh->end[hash_pos] ||
+				memcmp(mb_dat.block_md5, mbh->md5[hash_pos], 
+					APR_MD5_DIGESTSIZE) != 0)
+			goto ex;
+		hash_pos++;
+	}
+
+	if (hash_pos == last)
+		*changed=0;
+
+ex:
+	mb_dat.sts=NULL;
+	IF_FREE(buffer);
+	return status;
+}
+
+
+/** Verifies a big file in several processes.
+ *
+ * The stored blocks are split into (about) equally sized ranges, and 
+ * each range is checked by a child process via cs___verify_range().
+ * As soon as one child reports a difference the others are stopped.
+ *
+ * If the file can't be done that way (too small, no blocks stored for its 
+ * tail, or some child failed) \c ENOENT is returned, and the caller has to 
+ * read the file sequentially.
+ *
+ * If the file is unchanged the full MD5 is not calculated - it's the same 
+ * as before, as all the data is. */
+int cs___compare_parallel(struct estat *sts, int fh, off_t size,
+		struct cs__manber_hashes *mbh, int *changed)
+{
+	int status, jobs, running, j, wstatus, failed;
+	unsigned first, last;
+	pid_t *pids, pid;
+
+
+	status=0;
+	pids=NULL;
+	*changed=0;
+	failed=0;
+
+	jobs=opt__get_int(OPT__VERIFY_JOBS);
+	/* Several processes would each use the whole budget. */
+	if (hlp__throttle_active())
+		jobs=1;
+	if (jobs > size/CS__MIN_RANGE_SIZE)
+		jobs=size/CS__MIN_RANGE_SIZE;
+	if (jobs < 2 || !mbh->count || mbh->end[mbh->count-1] != size || 
+			jobs > mbh->count)
+	{
+		status=ENOENT;
+		goto ex;
+	}
+
+	STOPIF( hlp__calloc( &pids, jobs, sizeof(*pids)), NULL);
+
+	/* Don't give the buffered data to the children, too. */
+	fflush(NULL);
+
+	first=0;
+	running=0;
+	for(j=0; j<jobs; j++)
+	{
+		last=first+1;
+		while (last < mbh->count && 
+				mbh->end[last-1] < size / jobs * (j+1))
+			last++;
+		if (j == jobs-1) last=mbh->count;
+
+		pid=fork();
+		STOPIF_CODE_ERR( pid == -1, errno, "Cannot fork()");
+
+		if (pid == 0)
+		{
+			signal(SIGTERM, SIG_DFL);
+			status=cs___verify_range(sts, fh, mbh, first, last, changed);
+			_exit(status ? 2 : *changed ? 1 : 0);
+		}
+
+		DEBUGP("started %llu for blocks %u to %u", (t_ull)pid, first, last);
+		pids[j]=pid;
+		running++;
+
+		first=last;
+		if (first >= mbh->count) break;
+	}
+
+	while (running)
+	{
+		pid=wait(&wstatus);
+		STOPIF_CODE_ERR( pid == -1, errno, "Waiting for children failed");
+
+		for(j=0; j<jobs; j++)
+			if (pids[j] == pid) break;
+		if (j == jobs) continue;
+
+		pids[j]=0;
+		running--;
+
+		if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 1)
+		{
+			/* Found a difference - the others can stop. */
+			*changed=1;
+			for(j=0; j<jobs; j++)
+				if (pids[j]) kill(pids[j], SIGTERM);
+		}
+		else if (!*changed && 
+				!(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0))
+			failed=1;
+	}
+
+	if (failed && !*changed)
+		status=ENOENT;
+	else if (!*changed)
+		st__bytes_hashed+=size;
+
+ex:
+	IF_FREE(pids);
+	return status;
+}
+
+
 /** 
  * -.
  * \param sts Which entry to check
@@ -388,6 +640,25 @@ int cs__compare_file(struct estat *sts, char *fullpath, int *result)
 			STOPIF(status, "open(\"%s\", O_RDONLY) failed", fullpath);
 		}
 
+		if (actual.size < CS__MIN_FILE_SIZE)
+		{
+			STOPIF( cs___hash_small(fh, fullpath, sts->md5), NULL);
+			mb_dat.sts=NULL;
+			goto compared;
+		}
+
+		if (do_manber)
+		{
+			status=cs___compare_parallel(sts, fh, actual.size, &mbh_data, &i);
+			if (status != ENOENT)
+			{
+				STOPIF( status, NULL);
+				if (i) sts->md5[0] ^= 0x1;
+				mb_dat.sts=NULL;
+				goto compared;
+			}
+		}
+
 		status=0;
 		while (current_pos < actual.size)
 		{
@@ -413,7 +684,11 @@ int cs__compare_file(struct estat *sts, char *fullpath, int *result)
 							&i, &mb_dat ),
 						NULL);
 
-				if (i==-1) break;
+				if (i==-1)
+				{
+					STOPIF( hlp__throttle(length_mapped-map_pos), NULL);
+					break;
+				}
 
 				if (do_manber)
 				{
@@ -455,11 +730,13 @@ changed:
 				STOPIF( cs___end_of_block(NULL, 0, NULL, &mb_dat), NULL );
 
 				map_pos+=i;
+				STOPIF( hlp__throttle(i), NULL);
 			}
 
 			STOPIF_CODE_ERR( munmap((void*)filedata, length_mapped) == -1,
 					errno, "unmapping of file failed");
 			current_pos+=length_mapped;
+			st__bytes_hashed+=length_mapped;
 
 			if (i==-2) break;
 		}
@@ -477,6 +754,7 @@ changed:
 		DEBUGP("nothing to hash for %s", fullpath);
 	}
 
+compared:
 	sts->change_flag = memcmp(old_md5, sts->md5, sizeof(sts->md5)) == 0 ?
 		CF_NOTCHANGED : CF_CHANGED;
 	DEBUGP("change flag for %s set to %d", fullpath, sts->change_flag);
@@ -497,6 +775,238 @@ ex:
 }
 
 
+/** Sort key for cs__compare_list(). */
+struct cs___disk_pos_t {
+	/** The entry. */
+	struct estat *sts;
+	/** Physical byte position of the first extent, or \c ULLONG_MAX if 
+	 * unknown. */
+	unsigned long long physical;
+};
+
+
+/** Sorts by physical position, and (for unknown positions) by inode.  */
+static int cs___disk_pos_compare(const void *a, const void *b)
+{
+	const struct cs___disk_pos_t *p1=a, *p2=b;
+
+	if (p1->physical != p2->physical)
+		return p1->physical < p2->physical ? -1 : +1;
+	if (p1->sts->st.ino != p2->sts->st.ino)
+		return p1->sts->st.ino < p2->sts->st.ino ? -1 : +1;
+	return 0;
+}
+
+
+/** Returns the physical position of the first data block of \a path, via 
+ * \c FIEMAP.
+ * If that's not available (or the file has no extents), \c ULLONG_MAX is 
+ * returned; these files are then done in inode order. */
+static unsigned long long cs___get_physical(char *path)
+{
+	unsigned long long physical;
+#ifdef HAVE_LINUX_FIEMAP_H
+	int fh;
+	/* Space for the header and a single extent. */
+	unsigned long long buffer[ 1 + 
+		(sizeof(struct fiemap) + sizeof(struct fiemap_extent)) /
+		sizeof(unsigned long long) ];
+	struct fiemap *map=(struct fiemap*)buffer;
+
+
+	physical=ULLONG_MAX;
+
+	fh=open(path, O_RDONLY);
+	if (fh == -1) goto ex;
+
+	memset(buffer, 0, sizeof(buffer));
+	map->fm_start=0;
+	map->fm_length=~0ULL;
+	map->fm_extent_count=1;
+
+	if (ioctl(fh, FS_IOC_FIEMAP, map) == 0 &&
+			map->fm_mapped_extents > 0)
+		physical=map->fm_extents[0].fe_physical;
+
+	close(fh);
+
+ex:
+#else
+	physical=ULLONG_MAX;
+#endif
+
+	return physical;
+}
+
+
+/** How many small files cs___hash_small_batch() hashes together. */
+#define CS___BATCH_FILES (4*MD5_MB__LANES)
+/** How much data cs___hash_small_batch() reads for one batch. */
+#define CS___BATCH_BYTES (4*1024*1024)
+
+
+/** Hashes a batch of small files, and sets their change flags. */
+static void cs___finish_batch(struct estat **batch, int count,
+		const unsigned char *const data[], const size_t len[])
+{
+	int i;
+	md5_digest_t digests[CS___BATCH_FILES];
+
+
+	if (count < MD5_MB__MIN_BATCH)
+		for(i=0; i<count; i++)
+			apr_md5(digests[i], data[i], len[i]);
+	else
+		md5_mb__hash(count, data, len, digests);
+
+	for(i=0; i<count; i++)
+	{
+		batch[i]->change_flag = 
+			memcmp(batch[i]->md5, digests[i], sizeof(digests[i])) == 0 ?
+			CF_NOTCHANGED : CF_CHANGED;
+		memcpy(batch[i]->md5, digests[i], sizeof(digests[i]));
+		DEBUGP("change flag for %s set to %d", 
+				batch[i]->name, batch[i]->change_flag);
+	}
+}
+
+
+/** Hashes the small files in \a list side by side, via md5_mb__hash().
+ *
+ * Only regular files below \ref CS__MIN_FILE_SIZE are done here; they're 
+ * read completely into memory, and then hashed in batches.
+ * Everything else (and files that are unreadable, or changed their size 
+ * while reading) keeps \c CF_UNKNOWN, for cs__compare_file(). */
+static int cs___hash_small_batch(struct estat **list, int count)
+{
+	int status, i, n, fh;
+	size_t used;
+	ssize_t len, got;
+	struct estat *sts, *batch[CS___BATCH_FILES];
+	const unsigned char *data[CS___BATCH_FILES];
+	size_t lens[CS___BATCH_FILES];
+	struct sstat_t actual;
+	char *path;
+	static unsigned char *buffer=NULL;
+
+
+	status=0;
+	fh=-1;
+	if (!buffer)
+		STOPIF( hlp__alloc( &buffer, CS___BATCH_BYTES), NULL);
+
+	n=0;
+	used=0;
+	for(i=0; i<count; i++)
+	{
+		sts=list[i];
+		if (sts->change_flag != CF_UNKNOWN || !S_ISREG(sts->st.mode))
+			continue;
+
+		STOPIF( ops__build_path(&path, sts), NULL);
+		if (hlp__lstat(path, &actual) || 
+				!S_ISREG(actual.mode) ||
+				actual.size >= CS__MIN_FILE_SIZE)
+			continue;
+
+		if (n == CS___BATCH_FILES || used + actual.size + 1 > CS___BATCH_BYTES)
+		{
+			cs___finish_batch(batch, n, data, lens);
+			n=0;
+			used=0;
+		}
+
+		fh=open(path, O_RDONLY);
+		if (fh == -1) continue;
+
+		/* One byte more, to see whether it has grown. */
+		got=0;
+		while (got <= actual.size)
+		{
+			len=read(fh, buffer+used+got, actual.size+1-got);
+			STOPIF_CODE_ERR( len == -1, errno, "reading %s", path);
+			if (len == 0) break;
+			got+=len;
+		}
+		close(fh);
+		fh=-1;
+
+		st__bytes_hashed+=got;
+		STOPIF( hlp__throttle(got), NULL);
+		if (got != actual.size) continue;
+
+		batch[n]=sts;
+		data[n]=buffer+used;
+		lens[n]=got;
+		n++;
+		used+=got;
+	}
+
+	cs___finish_batch(batch, n, data, lens);
+
+ex:
+	if (fh != -1) close(fh);
+	return status;
+}
+
+
+/** -.
+ *
+ * The small files are hashed in batches by cs___hash_small_batch(), so 
+ * that MD5 can run on several files at once; the others are checked by 
+ * cs__compare_file().
+ * The results are kept in estat::change_flag, so that the later 
+ * cs__compare_file() calls in the normal tree order just return them.
+ *
+ * On rotating or SMR disks with cold caches reading the files in tree or 
+ * inode order can still cause lots of seeks, if the filesystem is 
+ * fragmented. So with \a disk_order the files are first sorted by the 
+ * physical position of their data, see \ref o_hash_order. */
+int cs__compare_list(struct estat **list, int count, int disk_order)
+{
+	int status;
+	int i;
+	struct cs___disk_pos_t *pos;
+	struct estat **sorted;
+	char *path;
+
+
+	pos=NULL;
+	sorted=NULL;
+	status=0;
+	if (!count) goto ex;
+
+	if (disk_order)
+	{
+		STOPIF( hlp__alloc( &pos, sizeof(*pos) * count), NULL);
+		STOPIF( hlp__alloc( &sorted, sizeof(*sorted) * count), NULL);
+
+		for(i=0; i<count; i++)
+		{
+			pos[i].sts=list[i];
+			STOPIF( ops__build_path(&path, list[i]), NULL);
+			pos[i].physical=cs___get_physical(path);
+		}
+
+		qsort(pos, count, sizeof(*pos), cs___disk_pos_compare);
+
+		for(i=0; i<count; i++)
+			sorted[i]=pos[i].sts;
+		list=sorted;
+	}
+
+	DEBUGP("hashing %d files", count);
+	STOPIF( cs___hash_small_batch(list, count), NULL);
+	for(i=0; i<count; i++)
+		STOPIF( cs__compare_file(list[i], NULL, NULL), NULL);
+
+ex:
+	IF_FREE(pos);
+	IF_FREE(sorted);
+	return status;
+}
+
+
 /** -.
  * If a file has been committed, this is where various checksum-related
  * uninitializations can happen. */
@@ -682,11 +1192,22 @@ ex:
 }
 
 
-int cs___update_manber(struct t_manber_data *mb_f,
-		const unsigned char *data, apr_size_t len)
+/** Finishes the MD5 of a block that ends without a manber border, ie. at 
+ * the end of the file.
+ * Zero blocks keep their all-zero MD5, like in cs___end_of_block(). */
+void cs___finish_block(struct t_manber_data *mb_f)
+{
+	if (mb_f->data_bits)
+		apr_md5_final( mb_f->block_md5, & mb_f->block_md5_ctx);
+}
+
+
+/** Writes the line for the block that just ended into the \ref md5s file.
+ * */
+int cs___write_manber_line(struct t_manber_data *mb_f)
 {
 	int status;
-	int eob, i;
+	int i;
 	/* MD5 as hex (constant-length), 
 	 * state as hex (constant-length),
 	 * offset of block, length of block, 
@@ -694,6 +1215,40 @@ int cs___update_manber(struct t_manber_data *mb_f,
 	char buffer[MANBER_LINELEN+10];
 	char *filename;
 
+
+	status=0;
+	i=sprintf(buffer, cs___mb_wr_format, 
+			cs__md5tohex_buffered(mb_f->block_md5),
+			mb_f->last_state,
+			(t_ull)mb_f->last_fpos, 
+			(t_ull)(mb_f->fpos - mb_f->last_fpos));
+	BUG_ON(i > sizeof(buffer)-3, "Buffer too small - stack overrun");
+
+	if (mb_f->manber_fd == -1)
+	{
+		/* The file has not been opened yet.
+		 * Do it now.
+		 * */
+		STOPIF( ops__build_path(&filename, mb_f->sts), NULL);
+		STOPIF( waa__open_entry(mb_f->sts, WAA__FILE_MD5s_EXT, WAA__WRITE,
+					&	cs___manber.manber_fd), NULL );
+		DEBUGP("now doing manber-hashing for %s...", filename);
+	}
+
+	STOPIF_CODE_ERR( write( mb_f->manber_fd, buffer, i) != i,
+			errno, "writing to manber hash file");
+
+ex:
+	return status;
+}
+
+
+int cs___update_manber(struct t_manber_data *mb_f,
+		const unsigned char *data, apr_size_t len)
+{
+	int status;
+	int eob;
+
 	status=0;
 	/* We tried to avoid doing this calculation for small files.
 	 *
@@ -739,26 +1294,7 @@ int cs___update_manber(struct t_manber_data *mb_f,
 				eob);
 
 		/* write new line to data file */
-		i=sprintf(buffer, cs___mb_wr_format, 
-				cs__md5tohex_buffered(mb_f->block_md5),
-				mb_f->last_state,
-				(t_ull)mb_f->last_fpos, 
-				(t_ull)(mb_f->fpos - mb_f->last_fpos));
-		BUG_ON(i > sizeof(buffer)-3, "Buffer too small - stack overrun");
-
-		if (mb_f->manber_fd == -1)
-		{
-			/* The file has not been opened yet.
-			 * Do it now.
-			 * */
-			STOPIF( ops__build_path(&filename, mb_f->sts), NULL);
-			STOPIF( waa__open_byext(filename, WAA__FILE_MD5s_EXT, WAA__WRITE,
-						&	cs___manber.manber_fd), NULL );
-			DEBUGP("now doing manber-hashing for %s...", filename);
-		}
-
-		STOPIF_CODE_ERR( write( mb_f->manber_fd, buffer, i) != i,
-				errno, "writing to manber hash file");
+		STOPIF( cs___write_manber_line(mb_f), NULL);
 
 		/* re-init manber state */
 		STOPIF( cs___end_of_block(NULL, 0, NULL, mb_f), NULL );
@@ -828,6 +1364,16 @@ svn_error_t *cs___mnbs_close(void *baton)
 	 * don't keep that file. */
 	if (mb_f->manber_fd != -1)
 	{
+		/* The data after the last border is written as a block, too; so 
+		 * that all bytes of the file are covered, and ranges of the file 
+		 * can be verified independently. */
+		if (mb_f->fpos > mb_f->last_fpos && mb_f->fpos >= CS__MIN_FILE_SIZE)
+		{
+			cs___finish_block(mb_f);
+			STOPIF( cs___write_manber_line(mb_f), NULL);
+			mb_f->last_fpos = mb_f->fpos;
+		}
+
 		STOPIF( waa__close(mb_f->manber_fd, 
 					mb_f->fpos < CS__MIN_FILE_SIZE ? ECANCELED : 
 					status != 0), NULL );
@@ -970,12 +1516,13 @@ ex:
  * \section The last block
  *
  * The last block in a file ends per definition *not* on a manber-block-
- * border (or only per chance). This block is not written into the md5s file.
- * The data is verified by the full-file MD5 that we've been calculating.
- *
- * \todo When we do a rsync-copy from the repository, we'll have to look at
- * that again! Either we write the last block too, or we'll have to ask for
- * the last few bytes extra.
+ * border (or only per chance). It is written into the md5s file as a final 
+ * block, with the file size as its end and the manber state it had at 
+ * that point; that's needed to verify the tail of a file in a separate 
+ * process (see cs___compare_parallel()).
+ * md5s files written by older versions don't have it; such files are 
+ * only compared sequentially, and the rest is verified by the full-file 
+ * MD5.
  * 
  * */
 /** -.
@@ -1002,7 +1549,7 @@ int cs__read_manber_hashes(struct estat *sts, struct cs__manber_hashes *data)
 
 	STOPIF( ops__build_path(&filename, sts), NULL);
 	/* It's ok if there's no md5s file. simply return ENOENT. */
-	status=waa__open_byext(filename, WAA__FILE_MD5s_EXT, WAA__READ, &fh);
+	status=waa__open_entry(sts, WAA__FILE_MD5s_EXT, WAA__READ, &fh);
 	if (status == ENOENT) goto ex;
 	STOPIF( status, "reading md5s-file for %s", filename);
 
@@ -38,6 +38,9 @@ struct cs__manber_hashes
 
 /** Checks whether a file has changed. */
 int cs__compare_file(struct estat *sts, char *fullpath, int *result);
+/** Checks a list of files; if \a disk_order is set, in the order of 
+ * their data on disk. */
+int cs__compare_list(struct estat **list, int count, int disk_order);
 /** Puts the hex string of \a md5 into \a dest, and returns \a dest. */
 char* cs__md5tohex(const md5_digest_t md5, char *dest);
 /** Converts an MD5 digest to an ASCII string in a self-managed buffer. */
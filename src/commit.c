@@ -62,7 +62,13 @@
  * 
  * Please see \ref status for explanations on \c -v and \c -C . \n
  * For advanced backup usage see also \ref FSVS_PROP_COMMIT_PIPE
- * "the commit-pipe property".  */
+ * "the commit-pipe property".
+ *
+ * On slow or unreliable network connections the changes can be stored 
+ * locally, and sent later by \ref push; see \ref o_commit_local.
+ *
+ * The initial import of a big tree into a local repository can be done 
+ * much faster with \ref o_commit_via_dump. */
 
 
 #include <apr_md5.h>
@@ -74,6 +80,12 @@
 #include <subversion-1/svn_error.h>
 #include <subversion-1/svn_string.h>
 #include <subversion-1/svn_time.h>
+#ifdef HAVE_SVN_REPOS
+#include <subversion-1/svn_repos.h>
+#include <subversion-1/svn_fs.h>
+#endif
+#include <subversion-1/svn_user.h>
+#include <subversion-1/svn_dirent_uri.h>
 
 #include <sys/types.h>
 #include <sys/mman.h>
@@ -95,6 +107,8 @@
 #include "racallback.h"
 #include "url.h"
 #include "helper.h"
+#include "spool.h"
+#include "hot.h"
 
 
 
@@ -289,15 +303,42 @@ int ci___send_user_props(void *baton,
 		apr_pool_t *pool)
 {
 	int status;
-	datum key, value;
+	datum key, value, list;
 	hash_t db;
 	svn_string_t *str;
+	char *cp;
 
 
 	db=NULL;
+	list.dptr=NULL;
 
 	/* First do auto-props. */
-	STOPIF( ops__apply_group(sts, &db, pool), NULL);
+	STOPIF( ops__apply_group(sts, NULL, pool), NULL);
+
+	/* If the entry only references the auto-props of its group, they can be 
+	 * sent directly; no need to write a property file for it. */
+	status=prp__group_ref_get(sts, &list);
+	if (status != ENOENT)
+	{
+		STOPIF(status, NULL);
+
+		cp=list.dptr;
+		while (cp < list.dptr+list.dsize)
+		{
+			key.dptr=cp;
+			cp += strlen(cp)+1;
+			DEBUGP("sending auto-prop %s=%s", key.dptr, cp);
+
+			str=svn_string_create(cp, pool);
+			STOPIF( send_a_prop(baton, store_encoder, sts, function,
+						key.dptr, str, pool), NULL);
+			cp += strlen(cp)+1;
+		}
+		goto ex;
+	}
+
+	STOPIF( prp__open_byestat(sts, 
+				GDBM_WRCREAT | HASH_REMEMBER_FILENAME, &db), NULL);
 
 	/* Do user-defined properties.
 	 * Could return ENOENT if none. */
@@ -343,6 +384,7 @@ int ci___send_user_props(void *baton,
 	STOPIF( hsh__close(db, status), NULL);
 
 ex:
+	IF_FREE(list.dptr);
 	return status;
 }
 
@@ -407,6 +449,82 @@ error:
 }
 
 
+/** Read function of the stream set up by ci___throttle_filter(). */
+static svn_error_t *ci___throttle_read(void *baton, char *data, 
+		apr_size_t *len)
+{
+	int status;
+	svn_error_t *status_svn;
+	svn_stream_t *input=baton;
+
+
+	status=0;
+	STOPIF_SVNERR( svn_stream_read, (input, data, len) );
+	STOPIF( hlp__throttle(*len), NULL);
+
+ex:
+	RETURN_SVNERR(status);
+}
+
+
+/** Close function of the stream set up by ci___throttle_filter(). */
+static svn_error_t *ci___throttle_close(void *baton)
+{
+	return svn_stream_close(baton);
+}
+
+
+/** Puts a filter on \a *s_stream that calls hlp__throttle() for the data 
+ * read, so that the \ref o_limits "limits" apply to the data sent by a 
+ * commit, too.
+ *
+ * Without a limit the stream is used as-is. */
+static void ci___throttle_filter(svn_stream_t **s_stream, apr_pool_t *pool)
+{
+	svn_stream_t *new_str;
+
+
+	if (!hlp__throttle_active()) return;
+
+	new_str=svn_stream_create(*s_stream, pool);
+	svn_stream_set_read(new_str, ci___throttle_read);
+	svn_stream_set_close(new_str, ci___throttle_close);
+	*s_stream=new_str;
+}
+
+
+/** Puts the manber filter on \a s_stream, if \a sts should get block 
+ * hashes.
+ *
+ * We need the local manber hashes and MD5s to detect changes; the remote 
+ * values would be needed for delta transfers. */
+int ci___manber_filter(struct estat *sts, char *filename, 
+		svn_stream_t **s_stream, int *has_manber, apr_pool_t *pool)
+{
+	int status;
+
+
+	status=0;
+	*has_manber= (sts->st.size >= CS__MIN_FILE_SIZE);
+	if (*has_manber)
+	{
+		/* Files that change completely don't profit from the block 
+		 * hashes. */
+		if (sts->flags & RF_NO_BLOCKHASH)
+		{
+			DEBUGP("%s has no block hashes", filename);
+			*has_manber=0;
+			STOPIF( waa__delete_entry(sts, WAA__FILE_MD5s_EXT, 1), NULL);
+		}
+	}
+	if (*has_manber)
+		STOPIF( cs__new_manber_filter(sts, *s_stream, s_stream, pool), NULL );
+
+ex:
+	return status;
+}
+
+
 /** Commit function for non-directory entries.
  *
  * Here we handle devices, symlinks and files.
@@ -433,6 +551,8 @@ svn_error_t *ci__nondir(const svn_delta_editor_t *editor,
 	struct encoder_t *encoder;
 	int transfer_text, has_manber;
 	hash_t db;
+	struct spl__entry_t *spooled;
+	char *datafile;
 
 
 	str=NULL;
@@ -442,6 +562,10 @@ svn_error_t *ci__nondir(const svn_delta_editor_t *editor,
 
 	STOPIF( ops__build_path(&filename, sts), NULL);
 
+	/* When pushing a local commit the data is taken from the spool. */
+	spooled=spl__find(sts);
+	datafile= spooled && spooled->data ? spooled->data : filename;
+
 
 	/* The only "real" information symlinks have is the target
 	 * they point to. We don't set properties which won't get used on 
@@ -499,7 +623,7 @@ svn_error_t *ci__nondir(const svn_delta_editor_t *editor,
 		switch (sts->st.mode & S_IFMT)
 		{
 			case S_IFLNK:
-				STOPIF( ops__link_to_string(sts, filename, &cp), NULL);
+				STOPIF( ops__link_to_string(sts, datafile, &cp), NULL);
 				STOPIF( hlp__local2utf8(cp, &cp, -1), NULL);
 				/* It is not defined whether svn_stringbuf_create copies the string,
 				 * takes the character pointer into the pool, or whatever.
@@ -514,16 +638,14 @@ svn_error_t *ci__nondir(const svn_delta_editor_t *editor,
 						ops__dev_to_filedata(sts), pool);
 				break;
 			case S_IFREG:
-				STOPIF( apr_file_open(&a_stream, filename, APR_READ, 0, pool),
-						"open file \"%s\" for reading", filename);
+				STOPIF( apr_file_open(&a_stream, datafile, APR_READ, 0, pool),
+						"open file \"%s\" for reading", datafile);
 
 				s_stream=svn_stream_from_aprfile (a_stream, pool);
+				ci___throttle_filter(&s_stream, pool);
 
-				/* We need the local manber hashes and MD5s to detect changes;
-				 * the remote values would be needed for delta transfers. */
-				has_manber= (sts->st.size >= CS__MIN_FILE_SIZE);
-				if (has_manber)
-					STOPIF( cs__new_manber_filter(sts, s_stream, &s_stream, pool), NULL );
+				STOPIF( ci___manber_filter(sts, filename, &s_stream, 
+							&has_manber, pool), NULL);
 
 				/* That's needed only for actually putting the data in the 
 				 * repository - for local re-calculating it isn't. */
@@ -565,6 +687,9 @@ svn_error_t *ci__nondir(const svn_delta_editor_t *editor,
 					 delta_baton,
 					 sts->md5, pool) );
 			DEBUGP("after sending encoder=%p", encoder);
+
+			st__bytes_sent += sts->st.size;
+			STOPIF( st__progress_file(sts, 0), NULL);
 		}
 		else
 		{
@@ -608,6 +733,10 @@ svn_error_t *ci__nondir(const svn_delta_editor_t *editor,
 	}
 
 
+	/* Only changes count for the statistics, not new entries. */
+	if (!(sts->entry_status & FS_NEW))
+		STOPIF( hot__note(sts), NULL);
+
 	STOPIF( cs__set_file_committed(sts), NULL);
 
 ex:
@@ -642,11 +771,14 @@ svn_error_t *ci__directory(const svn_delta_editor_t *editor,
 	struct sstat_t stat;
 	struct cache_entry_t *utf8fn_plus_missing;
 	int utf8fn_len;
+	int have_removed;
+	struct spl__entry_t *spooled;
 
 
 	status=0;
 	utf8fn_plus_missing=NULL;
 	subpool=NULL;
+	have_removed=0;
 	DEBUGP("commit_dir with baton %p", dir_baton);
 	for(i=0; i<dir->entry_count; i++)
 	{
@@ -720,13 +852,13 @@ svn_error_t *ci__directory(const svn_delta_editor_t *editor,
 			if (!exists_now)
 			{
 				DEBUGP("%s=%d doesn't exist anymore", sts->name, i);
-				/* remove from data structures */
-
-				STOPIF( ops__delete_entry(dir, NULL, i, UNKNOWN_INDEX),
-						NULL);
-				STOPIF( waa__delete_byext(filename, WAA__FILE_MD5s_EXT, 1), NULL);
-				STOPIF( waa__delete_byext(filename, WAA__PROP_EXT, 1), NULL);
-				i--;
+				/* Remove from data structures - all removed entries of this 
+				 * directory at once, after the loop. */
+				STOPIF( waa__delete_entry(sts, WAA__FILE_MD5s_EXT, 1), NULL);
+				STOPIF( waa__delete_entry(sts, WAA__PROP_EXT, 1), NULL);
+				STOPIF( prp__group_ref_drop(sts), NULL);
+				sts->to_be_ignored=1;
+				have_removed=1;
 				continue;
 			}
 		} 
@@ -752,7 +884,10 @@ svn_error_t *ci__directory(const svn_delta_editor_t *editor,
 		/* access() would possibly be a bit lighter, but doesn't work
 		 * for broken symlinks. */
 		/* TODO: Could we use FS_REMOVED here?? */
-		if (hlp__lstat(filename, &stat))
+		spooled=spl__find(sts);
+		if (spooled)
+			stat=spooled->st;
+		else if (hlp__lstat(filename, &stat))
 		{
 			/* If an entry doesn't exist, but *should*, as it's marked RF_ADD,
 			 * we fail (currently).
@@ -894,6 +1029,10 @@ svn_error_t *ci__directory(const svn_delta_editor_t *editor,
 	}
 
 
+	if (have_removed)
+		STOPIF( ops__free_marked(dir, 0), NULL);
+
+
 	/* When a directory has been committed (with all changes), 
 	 * we can drop the check flag.
 	 * If we only do parts of the child list, we must set it, so that we know 
@@ -1052,6 +1191,512 @@ ex:
 
 
 
+#ifdef HAVE_SVN_REPOS
+/** How much is read at once for the \c Text-content-md5 of a file. */
+#define CI___DUMP_MD5_BUFFER (64*1024)
+
+/** State of the dump stream in ci___via_dump(). */
+struct ci___dump_t
+{
+	/** The entries to add, parents before their children. */
+	struct estat **list;
+	/** Number of entries in \a list, the next one to do, and the number 
+	 * allocated. */
+	int count, next, max;
+	/** Headers, properties and possibly the text of the current node; and 
+	 * how much of that was already read. */
+	svn_stringbuf_t *buf;
+	apr_size_t buf_pos;
+	/** The file data of the current node, if any. */
+	svn_stream_t *data;
+	/** How many bytes of \a data are still to be read. */
+	svn_filesize_t left;
+	/** The MD5 of \a data while it's sent, and the one written into the 
+	 * node header. */
+	apr_md5_ctx_t md5_ctx;
+	md5_digest_t text_md5;
+	/** The entry the \a data belongs to. */
+	struct estat *sts;
+	/** The missing base directories in UTF-8, with a \c / at the end; or 
+	 * an empty string. */
+	char *prefix;
+	/** Cleared for every node. */
+	apr_pool_t *pool;
+};
+
+
+/** Collects the entries below \a dir for ci___via_dump() into \a d; \a 
+ * all_new is cleared if one of them isn't simply added.
+ *
+ * The selection is the same as in ci__directory(); directories with only 
+ * changes below are not added, but their children are looked at, too. */
+static int ci___dump_collect(struct estat *dir, struct ci___dump_t *d, 
+		int *all_new)
+{
+	int status;
+	uint32_t i;
+	struct estat *sts;
+
+
+	status=0;
+	for(i=0; i<dir->entry_count && *all_new; i++)
+	{
+		sts=dir->by_inode[i];
+
+		if (!( (sts->flags & RF___COMMIT_MASK) && sts->do_this_entry) &&
+				!(sts->entry_status & ~FS_CHILD_CHANGED))
+			goto children;
+
+		if ( !( (sts->entry_status & FS_NEW) || (sts->flags & RF_ADD) ) ||
+				(sts->entry_status & FS_REMOVED) ||
+				(sts->flags & (RF_COPY_BASE | RF_UNVERSION)) )
+		{
+			DEBUGP("%s isn't simply new", sts->name);
+			*all_new=0;
+			goto ex;
+		}
+
+		if (d->count >= d->max)
+		{
+			d->max = d->max*2 + 64;
+			STOPIF( hlp__realloc( &d->list, d->max*sizeof(*d->list)), NULL);
+		}
+		d->list[d->count++]=sts;
+
+children:
+		if (S_ISDIR(sts->st.mode) && 
+				(sts->entry_status & (FS_NEW | FS_CHILD_CHANGED)))
+			STOPIF( ci___dump_collect(sts, d, all_new), NULL);
+	}
+
+ex:
+	return status;
+}
+
+
+/** Stores a property for the dump stream; a \c change_any_prop_t.
+ * The \a baton is the \c svn_stringbuf_t to append to. */
+static svn_error_t *ci___dump_prop(void *baton, const char *name, 
+		const svn_string_t *value, apr_pool_t *pool)
+{
+	svn_stringbuf_t *props=baton;
+
+	/* Removing a property of a new entry is a no-op. */
+	if (value)
+	{
+		svn_stringbuf_appendcstr(props, 
+				apr_psprintf(pool, "K %lu\n%s\nV %lu\n", 
+					(unsigned long)strlen(name), name, 
+					(unsigned long)value->len));
+		svn_stringbuf_appendbytes(props, value->data, value->len);
+		svn_stringbuf_appendbytes(props, "\n", 1);
+	}
+
+	return SVN_NO_ERROR;
+}
+
+
+/** Calculates the MD5 of the file \a a_stream for the \c 
+ * Text-content-md5 header, and rewinds it.
+ *
+ * The header has to come before the data, so the file is read twice; the 
+ * second time it normally comes from the page cache. */
+static int ci___dump_md5(apr_file_t *a_stream, char *filename, 
+		md5_digest_t md5)
+{
+	int status;
+	apr_size_t len;
+	apr_off_t pos;
+	apr_md5_ctx_t ctx;
+	static char *buffer=NULL;
+
+
+	status=0;
+	if (!buffer)
+		STOPIF( hlp__alloc( &buffer, CI___DUMP_MD5_BUFFER), NULL);
+
+	apr_md5_init(&ctx);
+	while (1)
+	{
+		len=CI___DUMP_MD5_BUFFER;
+		status=apr_file_read(a_stream, buffer, &len);
+		if (status == APR_EOF) break;
+		STOPIF( status, "reading %s", filename);
+
+		apr_md5_update(&ctx, buffer, len);
+		STOPIF( hlp__throttle(len), NULL);
+	}
+	apr_md5_final(md5, &ctx);
+
+	pos=0;
+	STOPIF( apr_file_seek(a_stream, APR_SET, &pos), 
+			"rewinding %s", filename);
+
+ex:
+	return status;
+}
+
+
+/** Prepares the dump record of \a sts in \a d.
+ *
+ * Does the same local changes for \a sts as ci__directory() and 
+ * ci__nondir(). */
+static int ci___dump_node(struct ci___dump_t *d, struct estat *sts)
+{
+	int status;
+	svn_error_t *status_svn;
+	char *filename, *utf8_filename, *cp;
+	const char *kind;
+	struct sstat_t stat;
+	svn_stringbuf_t *props;
+	apr_file_t *a_stream;
+	apr_md5_ctx_t md5_ctx;
+	int has_manber;
+	char text_md5_hex[APR_MD5_DIGESTSIZE*2+1];
+
+
+	status=0;
+	cp=NULL;
+	kind="file";
+	STOPIF( ops__build_path(&filename, sts), NULL);
+
+	if (hlp__lstat(filename, &stat))
+	{
+		STOPIF_CODE_ERR( sts->flags & RF_ADD, ENOENT,
+				"Entry %s should be added, but doesn't exist.",
+				filename);
+
+		DEBUGP("%s doesn't exist, ignoring (%d)", filename, errno);
+		goto ex;
+	}
+
+	if (sts->do_this_entry && ops__allowed_by_filter(sts))
+		sts->st=stat;
+
+	apr_pool_clear(d->pool);
+	props=svn_stringbuf_create("", d->pool);
+
+	STOPIF( ci___send_user_props(props, sts, ci___dump_prop, 
+				!S_ISDIR(sts->st.mode), d->pool), NULL);
+	STOPIF_CODE_ERR( sts->decoder, EINVAL,
+			"!The entry \"%s\" has a commit-pipe, which can't be used with\n"
+			"the \"commit_via_dump\" option.", filename);
+	STOPIF_SVNERR( ci___set_props, (props, sts, ci___dump_prop, d->pool) ); 
+
+	switch (sts->st.mode & S_IFMT)
+	{
+		case S_IFDIR:
+			kind="dir";
+			if (! (sts->do_this_entry && ops__allowed_by_filter(sts)) )
+				sts->flags |= RF_CHECK;
+			else
+				sts->flags &= ~RF_CHECK;
+			break;
+		case S_IFLNK:
+			STOPIF( ops__link_to_string(sts, filename, &cp), NULL);
+			STOPIF( hlp__local2utf8(cp, &cp, -1), NULL);
+			break;
+		case S_IFBLK:
+		case S_IFCHR:
+			cp=ops__dev_to_filedata(sts);
+			break;
+		case S_IFREG:
+			STOPIF( apr_file_open(&a_stream, filename, APR_READ, 0, d->pool),
+					"open file \"%s\" for reading", filename);
+			STOPIF( ci___dump_md5(a_stream, filename, d->text_md5), NULL);
+			d->data=svn_stream_from_aprfile(a_stream, d->pool);
+			ci___throttle_filter(&d->data, d->pool);
+			STOPIF( ci___manber_filter(sts, filename, &d->data, 
+						&has_manber, d->pool), NULL);
+			d->left=sts->st.size;
+			d->sts=sts;
+			apr_md5_init(&d->md5_ctx);
+			break;
+		default:
+			BUG("invalid/unknown file type 0%o", sts->st.mode);
+	}
+
+	/* Special entries have their data right here. */
+	if (cp)
+	{
+		ci___dump_prop(props, propname_special, 
+				svn_string_create(propval_special, d->pool), d->pool);
+		apr_md5_init(&md5_ctx);
+		apr_md5_update(&md5_ctx, cp, strlen(cp));
+		apr_md5_final(sts->md5, &md5_ctx);
+		memcpy(d->text_md5, sts->md5, sizeof(d->text_md5));
+	}
+	svn_stringbuf_appendcstr(props, "PROPS-END\n");
+
+	STOPIF( hlp__local2utf8(filename+2, &utf8_filename, -1), NULL );
+	d->buf=svn_stringbuf_createf(d->pool,
+			"Node-path: %s%s\n"
+			"Node-kind: %s\n"
+			"Node-action: add\n"
+			"Prop-content-length: %lu\n",
+			d->prefix, utf8_filename, kind, (unsigned long)props->len);
+	if (S_ISDIR(sts->st.mode))
+		svn_stringbuf_appendcstr(d->buf, 
+				apr_psprintf(d->pool, "Content-length: %lu\n\n",
+					(unsigned long)props->len));
+	else
+	{
+		d->left= cp ? strlen(cp) : d->left;
+		svn_stringbuf_appendcstr(d->buf, 
+				apr_psprintf(d->pool, 
+					"Text-content-length: %llu\n"
+					"Text-content-md5: %s\n"
+					"Content-length: %llu\n\n",
+					(t_ull)d->left, 
+					cs__md5tohex(d->text_md5, text_md5_hex),
+					(t_ull)(props->len + d->left)));
+	}
+	svn_stringbuf_appendbytes(d->buf, props->data, props->len);
+	d->buf_pos=0;
+
+	if (cp)
+		svn_stringbuf_appendcstr(d->buf, cp);
+	if (!d->data)
+		svn_stringbuf_appendcstr(d->buf, "\n");
+
+	if (ops__allowed_by_filter(sts))
+		STOPIF( st__status(sts), NULL);
+
+	if (!(sts->flags & RF_COPY_BASE))
+	{
+		sts->flags &= ~RF_ADD;
+		sts->entry_status |= FS_NEW | FS_META_CHANGED;
+	}
+	if (url__current_has_precedence(sts->url))
+	{
+		sts->url=current_url;
+		sts->repos_rev = SET_REVNUM;
+	}
+	committed_entries++;
+
+ex:
+	return status;
+}
+
+
+/** The read function of the dump stream; generates the nodes as they're 
+ * needed, so the data is read only once. */
+static svn_error_t *ci___dump_read(void *baton, char *buffer, 
+		apr_size_t *len)
+{
+	struct ci___dump_t *d=baton;
+	int status;
+	svn_error_t *status_svn;
+	apr_size_t done, n;
+
+
+	status=0;
+	done=0;
+	while (done < *len)
+	{
+		if (d->buf && d->buf_pos < d->buf->len)
+		{
+			n=d->buf->len - d->buf_pos;
+			if (n > *len-done) n=*len-done;
+			memcpy(buffer+done, d->buf->data + d->buf_pos, n);
+			d->buf_pos += n;
+			done += n;
+		}
+		else if (d->data && d->left)
+		{
+			n= d->left < (svn_filesize_t)(*len-done) ? d->left : *len-done;
+			STOPIF_SVNERR( svn_stream_read, (d->data, buffer+done, &n));
+			STOPIF_CODE_ERR( n == 0, EIO, 
+					"!The file \"%s\" got shorter while committing.", 
+					d->sts->name);
+
+			apr_md5_update(&d->md5_ctx, buffer+done, n);
+			d->left -= n;
+			done += n;
+			st__bytes_sent += n;
+		}
+		else if (d->data)
+		{
+			/* This writes the manber hashes, too. */
+			STOPIF_SVNERR( svn_stream_close, (d->data) );
+			d->data=NULL;
+			apr_md5_final(d->sts->md5, &d->md5_ctx);
+			STOPIF_CODE_ERR( memcmp(d->sts->md5, d->text_md5, 
+						sizeof(d->text_md5)) != 0, EIO,
+					"!The file \"%s\" was changed while committing.",
+					d->sts->name);
+			STOPIF( st__progress_file(d->sts, 0), NULL);
+
+			d->buf=svn_stringbuf_create("\n", d->pool);
+			d->buf_pos=0;
+		}
+		else if (d->next < d->count)
+			STOPIF( ci___dump_node(d, d->list[d->next++]), NULL);
+		else
+			break;
+	}
+
+	*len=done;
+
+ex:
+	RETURN_SVNERR(status);
+}
+
+
+/** Commits \a root by loading a dump stream into the repository.
+ *
+ * This is only done for the initial import of a tree into a local (\c 
+ * file://) repository, see \ref o_commit_via_dump; \a used is set to \c 
+ * 0 if that isn't possible, and nothing is done.
+ *
+ * An initial import means that nothing of this URL is versioned yet; new 
+ * entries in an existing tree are committed as usual, as their parents 
+ * would have to be opened.
+ *
+ * Creating the nodes via the repository API in a single transaction 
+ * avoids the overhead of the commit editor for each entry. */
+static int ci___via_dump(struct estat *root, const char *utf8_commit_msg, 
+		char *missing_dirs, int *used)
+{
+	int status;
+	svn_error_t *status_svn;
+	struct ci___dump_t dump;
+	apr_pool_t *pool;
+	svn_stringbuf_t *head, *props;
+	svn_stream_t *stream;
+	svn_repos_t *repos;
+	svn_revnum_t new_rev;
+	const char *path, *repos_root, *author, *date;
+	char *base_url, *cp;
+	int len, all_new;
+
+
+	status=0;
+	*used=0;
+	pool=NULL;
+	memset(&dump, 0, sizeof(dump));
+
+	if (strncmp(current_url->url, "file://", 7) != 0)
+	{
+		DEBUGP("not a local repository");
+		goto ex;
+	}
+
+	if (current_url->current_rev)
+	{
+		DEBUGP("already versioned at %llu", (t_ull)current_url->current_rev);
+		goto ex;
+	}
+
+	all_new=1;
+	STOPIF( ci___dump_collect(root, &dump, &all_new), NULL);
+	if (!all_new || !dump.count)
+	{
+		DEBUGP("not an initial import");
+		goto ex;
+	}
+
+	*used=1;
+	STOPIF( apr_pool_create_ex(&pool, global_pool, NULL, NULL), 
+			"no pool");
+	STOPIF( apr_pool_create_ex(&dump.pool, pool, NULL, NULL), 
+			"no pool");
+
+
+	/* The session was opened on the existing part of the URL. */
+	len=current_url->urllen;
+	if (missing_dirs) len -= strlen(missing_dirs)+1;
+	STOPIF( hlp__strnalloc(len, &base_url, current_url->url), NULL);
+	STOPIF_SVNERR( svn_uri_get_dirent_from_file_url, 
+			(&path, svn_uri_canonicalize(base_url, pool), pool) );
+	repos_root=svn_repos_find_root_path(path, pool);
+	STOPIF_CODE_ERR( !repos_root, ENOENT,
+			"!No repository found for \"%s\".", current_url->url);
+	path += strlen(repos_root);
+	DEBUGP("loading into %s at %s", repos_root, path);
+
+	STOPIF_SVNERR( svn_repos_open, (&repos, repos_root, pool) );
+
+
+	/* The revision record, and the missing base directories. */
+	author= opt__get_int(OPT__AUTHOR) ? 
+		opt__get_string(OPT__AUTHOR) : svn_user_get_name(pool);
+	date=svn_time_to_cstring(apr_time_now(), pool);
+
+	props=svn_stringbuf_create("", pool);
+	ci___dump_prop(props, "svn:log", 
+			svn_string_create(utf8_commit_msg, pool), pool);
+	if (author)
+		ci___dump_prop(props, "svn:author", 
+				svn_string_create(author, pool), pool);
+	ci___dump_prop(props, "svn:date", svn_string_create(date, pool), pool);
+	svn_stringbuf_appendcstr(props, "PROPS-END\n");
+
+	head=svn_stringbuf_createf(pool, 
+			"SVN-fs-dump-format-version: 2\n\n"
+			"Revision-number: 1\n"
+			"Prop-content-length: %lu\n"
+			"Content-length: %lu\n\n",
+			(unsigned long)props->len, (unsigned long)props->len);
+	svn_stringbuf_appendbytes(head, props->data, props->len);
+	svn_stringbuf_appendcstr(head, "\n");
+
+	dump.prefix="";
+	if (missing_dirs)
+	{
+		STOPIF( hlp__local2utf8( missing_dirs, &cp, -1), NULL);
+		dump.prefix=apr_pstrcat(pool, cp, "/", NULL);
+
+		/* Every level of the missing directories is a node of its own. */
+		for(cp=dump.prefix; (cp=strchr(cp+1, '/')); )
+			svn_stringbuf_appendcstr(head, 
+					apr_psprintf(pool, 
+						"Node-path: %.*s\n"
+						"Node-kind: dir\n"
+						"Node-action: add\n"
+						"Prop-content-length: 10\n"
+						"Content-length: 10\n\n"
+						"PROPS-END\n\n",
+						(int)(cp-dump.prefix), dump.prefix));
+	}
+	dump.buf=head;
+	dump.buf_pos=0;
+
+
+	stream=svn_stream_create(&dump, pool);
+	svn_stream_set_read(stream, ci___dump_read);
+
+	committed_entries=0;
+	STOPIF_SVNERR( svn_repos_load_fs2,
+			(repos, stream, NULL, svn_repos_load_uuid_ignore,
+			 *path ? path : NULL, 
+			 TRUE, TRUE, /* use pre- and post-commit hooks */
+			 NULL, NULL, pool) );
+
+	STOPIF_SVNERR( svn_fs_youngest_rev, 
+			(&new_rev, svn_repos_fs(repos), pool) );
+	current_url->current_rev = new_rev;
+
+	if (opt__verbosity() > VERBOSITY_VERYQUIET)
+		printf("committed revision\t%ld on %s as %s\n",
+				new_rev, date, author ? author : "(no author)");
+
+	/* Like at the end of ci__directory(). */
+	if (root->do_this_entry && ops__allowed_by_filter(root))
+		root->flags &= ~RF_CHECK;
+	else
+		root->flags |= RF_CHECK;
+
+ex:
+	IF_FREE(dump.list);
+	if (pool) apr_pool_destroy(pool);
+	return status;
+}
+#endif
+
+
+
+
 /** The main commit function.
  *
  * It does as much setup as possible before traversing the tree - to find 
@@ -1060,7 +1705,10 @@ ex:
  * The message file gets opened here to verify its existence,
  * and to get a handle to it. If we're doing \c chdir()s later we don't 
  * mind; the open handle let's us read when we need it. And the contents 
- * are cached only as long as necessary. */
+ * are cached only as long as necessary.
+ *
+ * For a local commit (\ref o_commit_local) the repository isn't 
+ * contacted; the changes are stored via spl__write() instead. */
 int ci__work(struct estat *root, int argc, char *argv[])
 {
 	int status;
@@ -1076,12 +1724,16 @@ int ci__work(struct estat *root, int argc, char *argv[])
 	const char *url_name;
 	time_t delay_start;
 	char *missing_dirs;
+	int is_local, spooled, via_dump;
 
 
 	status=0;
 	status_svn=NULL;
 	edit_baton=NULL;
 	editor=NULL;
+	missing_dirs=NULL;
+	is_local= !spl__active() && 
+		opt__get_int(OPT__COMMIT_LOCAL) == OPT__YES;
 	/* This cannot be used uninitialized, but gcc doesn't know */
 	commitmsg_fh=-1;
 
@@ -1113,6 +1765,15 @@ int ci__work(struct estat *root, int argc, char *argv[])
 
 	STOPIF( waa__find_common_base(argc, argv, &normalized), NULL);
 
+	/* Older local commits would overwrite this one when pushed. */
+	if (!is_local && !spl__active())
+	{
+		STOPIF( spl__count(&spooled), NULL);
+		STOPIF_CODE_ERR( spooled, EBUSY,
+				"!There are %d local commits that were not pushed yet;\n"
+				"please run \"fsvs push\" first.", spooled);
+	}
+
 	/* Check if there's an URL defined before asking for a message */
 	STOPIF( url__load_nonempty_list(NULL, 0), NULL);
 
@@ -1138,7 +1799,8 @@ int ci__work(struct estat *root, int argc, char *argv[])
 	STOPIF(ign__load_list(NULL), NULL);
 
 
-	STOPIF( url__open_session(NULL, &missing_dirs), NULL);
+	if (!is_local)
+		STOPIF( url__open_session(NULL, &missing_dirs), NULL);
 	/* Warn early. */
 	if (missing_dirs)
 		STOPIF_CODE_ERR( opt__get_int(OPT__MKDIR_BASE) == OPT__NO, ENOENT,
@@ -1157,6 +1819,9 @@ int ci__work(struct estat *root, int argc, char *argv[])
 	STOPIF( waa__read_or_build_tree(root, argc, normalized, argv, 
 				NULL, 0), NULL);
 
+	if (spl__active())
+		STOPIF( spl__apply(root), NULL);
+
 
 	if (opt_commitmsgfile)
 	{
@@ -1189,12 +1854,55 @@ int ci__work(struct estat *root, int argc, char *argv[])
 				"see \"empty_message\" option.");
 	}
 
+	if (is_local)
+	{
+		STOPIF( spl__write(root, opt_commitmsg), NULL);
+
+		if (opt_commitmsgfile && st.st_size != 0)
+			STOPIF_CODE_ERR( munmap(opt_commitmsg, st.st_size) == -1, errno,
+					"munmap()");
+		if (commitmsg_is_temp)
+			STOPIF_CODE_ERR( unlink(opt_commitmsgfile) == -1, errno,
+					"Cannot remove temporary message file %s", opt_commitmsgfile);
+		goto ex;
+	}
+
 	STOPIF( hlp__local2utf8(opt_commitmsg, &utf8_commit_msg, -1),
 			"Conversion of the commit message to utf8 failed");
 
 	if (opt__verbosity() > VERBOSITY_VERYQUIET)
 		printf("Committing to %s\n", current_url->url);
 
+	/* Pushed commits have to send the spooled data. */
+	if (opt__get_int(OPT__COMMIT_VIA_DUMP) == OPT__YES && !spl__active())
+	{
+#ifdef HAVE_SVN_REPOS
+		STOPIF( ci___via_dump(root, utf8_commit_msg, missing_dirs, 
+					&via_dump), NULL);
+#else
+		DEBUGP("no libsvn_repos, doing a normal commit");
+		via_dump=0;
+#endif
+		if (via_dump)
+		{
+			if (opt_commitmsgfile && st.st_size != 0)
+				STOPIF_CODE_ERR( munmap(opt_commitmsg, st.st_size) == -1, errno,
+						"munmap()");
+			if (commitmsg_is_temp)
+				STOPIF_CODE_ERR( unlink(opt_commitmsgfile) == -1, errno,
+						"Cannot remove temporary message file %s", opt_commitmsgfile);
+
+			if (ops__allowed_by_filter(root))
+				STOPIF( hlp__lstat( root->name, &root->st), NULL);
+
+			delay_start=time(NULL);
+			STOPIF( waa__output_tree(root), NULL);
+			STOPIF( url__output_list(), NULL);
+			STOPIF( hlp__delay(delay_start, DELAY_COMMIT), NULL);
+			goto ex;
+		}
+	}
+
 
 	STOPIF_SVNERR( svn_ra_get_commit_editor,
 			(current_url->session,
@@ -1249,6 +1957,8 @@ int ci__work(struct estat *root, int argc, char *argv[])
 		{
 			if (opt__verbosity() > VERBOSITY_VERYQUIET)
 				printf("Avoiding empty commit as requested.\n");
+			if (spl__active())
+				STOPIF( spl__done(), NULL);
 			goto abort_commit;
 		}
 
@@ -1270,6 +1980,9 @@ int ci__work(struct estat *root, int argc, char *argv[])
 			 * Just use unionfs - that's easier. */
 			STOPIF( waa__output_tree(root), NULL);
 			STOPIF( url__output_list(), NULL);
+
+			if (spl__active())
+				STOPIF( spl__done(), NULL);
 		}
 
 		/* We do the delay here ... here we've got a chance that the second 
@@ -1252,6 +1252,9 @@ int cm___make_copy(struct estat *root,
 	else
 	{
 		STOPIF( waa__copy_entries(src, dest), NULL);
+		/* The group auto-properties are local data, too; without this they'd 
+		 * be lost on a rename. */
+		STOPIF( prp__group_ref_copy(src, dest), NULL);
 		revision=src->repos_rev;
 	}
 
@@ -49,14 +49,15 @@ struct free_estat
 /** Formats for writing entries in the \a dir files.
  * <tt>mode ctime mtime repo_flags dev_descr MD5_should
  *   size repos_version url# dev# inode# parent_line# entry_count
- *   uid gid name\\0\\n</tt>
- * Directories have an \c x instead of MD5_*. */
+ *   uid gid entry_id name\\0\\n</tt>
+ * Directories have an \c x instead of MD5_*. 
+ * Up to version 6 of the \ref dir file there was no \c entry_id. */
 const char ops__dir_info_format_p[]="%07llo %8x %8x %x %s %s "
 "%lld %ld %u %lx %lld %lld %u "
-"%u %u %s";
+"%u %u %llx %s";
 #define WAA_MAX_DIR_INFO_CHARS (11+1+8+1+8+1+8+1+APR_MD5_DIGESTSIZE*2+1 \
 		+18+1+9+1+9+1+16+1+18+1+18+1+9+1+ \
-		9+1+9+1+NAME_MAX+1+1)
+		9+1+9+1+16+1+NAME_MAX+1+1)
 
 
 /** -.
@@ -70,8 +71,17 @@ const char link_spec[]="link ",
 			cdev_spec[]="cdev",
 			bdev_spec[]="bdev";
 
+/** The free list, sorted by address. */
 static struct free_estat *free_list = NULL;
 
+/** How many freed entries are collected before they're merged into the 
+ * free list. */
+#define OPS__FREE_BATCH (1024)
+/** Entries freed, but not yet in the free list. */
+static struct estat *ops___freed[OPS__FREE_BATCH];
+/** Number of entries in \c ops___freed. */
+static int ops___freed_count=0;
+
 
 
 /** -.
@@ -325,11 +335,14 @@ ex:
  * \a parent_i gets set to the stored value; the translation to a \c parent 
  * pointer must be done in the caller.
  *
+ * \a version is that of the \ref dir file; before version 7 there's no 
+ * entry ID, so estat::entry_id is left alone.
+ *
  * \c EOF cannot be reliable detected here; but we are guaranteed a 
  * <tt>\\0\\n</tt> at the end of the string, to have a filename 
  * termination. */
 int ops__load_1entry(char **mem_pos, struct estat *sts, char **filename,
-		ino_t *parent_i)
+		ino_t *parent_i, int version)
 {
 	char *buffer, *before;
 	int status;
@@ -400,6 +413,12 @@ int ops__load_1entry(char **mem_pos, struct estat *sts, char **filename,
 	before=hlp__skip_ws(buffer);
 	sts->st.gid = strtoul(before, &buffer, 10); 
 	if (before == buffer) goto inval;
+	if (version >= 7)
+	{
+		before=hlp__skip_ws(buffer);
+		sts->entry_id = strtoull(before, &buffer, 16);
+		if (before == buffer || !sts->entry_id) goto inval;
+	}
 
 
        /* We need to parse, but would overwrite the shared md5 member. */
@@ -556,6 +575,7 @@ int ops__save_1entry(struct estat *sts,
 			is_dir ? ops___entries_to_write(sts) : 0,
 			sts->st.uid,
 			sts->st.gid,
+			sts->entry_id,
 			sts->name
 			);
 	BUG_ON(len > sizeof(buffer)-2);
@@ -688,17 +708,21 @@ int ops__calc_path_len(struct estat *sts)
  * If some function modifies that memory, it should set the first
  * char to \c \\0, to signal that it's no longer valid for other users.
  *
- * \todo A further optimization would be to check if a parent is already 
- * present, and append to that path. Similar for a neighbour entry.
+ * If the parent's path is still in the cache (which is the normal case 
+ * while traversing the tree, as directories are handled before their 
+ * children) only the name gets appended to a copy of it; so the cost 
+ * doesn't depend on the depth of the entry.
+ *
+ * \todo Similar for a neighbour entry.
  *
  * The \c cache_entry_t::id member is used as a pointer to the struct \ref estat.
  * */
 int ops__build_path(char **value, struct estat *sts)
 {
 	static struct cache_t *cache=NULL;
-	int status, i;
-	unsigned needed_space;
-	char *data;
+	int status, i, parent_index;
+	unsigned needed_space, name_len;
+	char *data, *parent_path;
 
 	/* Please note that in struct \ref estat there's a bitfield, and its member 
 	 * \ref cache_index must take the full range plus an additional "out of 
@@ -724,19 +748,47 @@ int ops__build_path(char **value, struct estat *sts)
 
 	needed_space=sts->path_len+1;
 
+	/* Is the parent's path available? */
+	parent_index=-1;
+	if (sts->parent &&
+			sts->parent->cache_index>0 &&
+			sts->parent->cache_index<=cache->max && 
+			cache->entries[sts->parent->cache_index-1]->id == 
+			(cache_value_t)sts->parent &&
+			cache->entries[sts->parent->cache_index-1]->data[0] &&
+			!cache->entries[sts->parent->cache_index-1]->data[
+			sts->parent->path_len])
+		parent_index=sts->parent->cache_index-1;
+
 	STOPIF( cch__add(cache, (cache_value_t)sts, NULL, 
 				needed_space, &data), NULL);
 
-	/* Now we have an index, and enough space. */
-	status=ops__build_path2(data, needed_space, sts);
-	if (status == 0)
+	/* Now we have an index, and enough space.
+	 * If the new entry took the slot of the parent we have to build the 
+	 * path the long way. */
+	if (parent_index >= 0 && parent_index != cache->lru)
+	{
+		parent_path=cache->entries[parent_index]->data;
+		name_len=sts->path_len - sts->parent->path_len - 1;
+
+		memcpy(data, parent_path, sts->parent->path_len);
+		data[sts->parent->path_len]=PATH_SEPARATOR;
+		memcpy(data + sts->parent->path_len + 1, sts->name, name_len);
+		data[sts->path_len]=0;
+	}
+	else
 	{
-		/* Something happened with our path length counting -
-		 * it's really a bug. */
-		BUG("path len counting went wrong");
+		status=ops__build_path2(data, needed_space, sts);
+		if (status == 0)
+		{
+			/* Something happened with our path length counting -
+			 * it's really a bug. */
+			BUG("path len counting went wrong");
+		}
+
+		data[status-1]=0;
 	}
 
-	data[status-1]=0;
 	sts->cache_index=cache->lru+1;
 	status=0;
 
@@ -760,8 +812,10 @@ int ops__new_entries(struct estat *dir,
 
 
 	status=0;
-	/* By name is no longer valid. */
+	/* By name is no longer valid; and the URL index doesn't know the new 
+	 * entries. */
 	IF_FREE(dir->by_name);
+	url__subtree_index_valid=0;
 	/* Now insert the newly found entries in the dir list. */
 	STOPIF( hlp__realloc( &dir->by_inode, 
 				(dir->entry_count+count+1) * sizeof(dir->by_inode[0])), NULL);
@@ -872,6 +926,84 @@ static inline void ops___move_array(struct estat **array, int index, int len)
 }
 
 
+/** Compares two freed blocks by address, for \a qsort(). */
+static int ops___cmp_freed(const void *a, const void *b)
+{
+	register const struct estat * const *_a=a;
+	register const struct estat * const *_b=b;
+
+	return *_a < *_b ? -1 : (*_a > *_b ? +1 : 0);
+}
+
+
+/** Appends the free block \a block with \a count entries to the free 
+ * list ending at \a *tail.
+ * If it directly follows the last block, both get merged. */
+static inline void ops___append_free(struct free_estat ***tail, 
+		struct free_estat **last, 
+		struct free_estat *block, int count)
+{
+	if (*last && 
+			(char*)*last + sizeof(struct estat)*(*last)->count == (char*)block)
+	{
+		(*last)->count += count;
+		return;
+	}
+
+	VALGRIND_MAKE_MEM_DEFINED(block, sizeof(*block));
+	block->count=count;
+	block->next=NULL;
+	**tail=block;
+	*tail=&block->next;
+	*last=block;
+}
+
+
+/** Merges the collected freed entries into the free list.
+ *
+ * The free list is kept sorted by address; so after sorting the batch 
+ * both can be merged in a single pass, joining adjacent blocks.  That 
+ * gives big blocks again, eg. after removing a whole subtree. */
+static void ops___merge_freed(void)
+{
+	struct free_estat *list, *next, *last;
+	struct free_estat **tail;
+	int i;
+
+
+	if (!ops___freed_count) return;
+
+	DEBUGP("merging %d freed entries", ops___freed_count);
+	qsort(ops___freed, ops___freed_count, sizeof(*ops___freed), 
+			ops___cmp_freed);
+
+	list=free_list;
+	free_list=NULL;
+	tail=&free_list;
+	last=NULL;
+	i=0;
+	while (list || i<ops___freed_count)
+	{
+		if (list && 
+				(i>=ops___freed_count || (char*)list < (char*)ops___freed[i]))
+		{
+			VALGRIND_MAKE_MEM_DEFINED(list, sizeof(*list));
+			next=list->next;
+			ops___append_free(&tail, &last, list, list->count);
+			list=next;
+		}
+		else
+		{
+			ops___append_free(&tail, &last, 
+					(struct free_estat*)ops___freed[i], 1);
+			i++;
+		}
+	}
+
+	ops___freed_count=0;
+}
+
+
 /** -.
  * The returned area is zeroed. */
 int ops__allocate(int needed, 
@@ -885,6 +1017,7 @@ int ops__allocate(int needed,
 	status=0;
 	BUG_ON(needed <=0, "not even a single block needed?");
 
+	ops___merge_freed();
 	DEBUGP("need %d blocks, freelist=%p", needed, free_list);
 	if (free_list)
 	{
@@ -960,12 +1093,11 @@ int ops__free_entry(struct estat **sts_p)
 {
 	int i, status;
 	struct estat *sts=*sts_p;
-	struct free_estat *free_p, *free_p2;
-	struct free_estat **prev;
-	struct free_estat *block;
 
 
 	status=0;
+	/* The URL index might point to this entry. */
+	url__subtree_index_valid=0;
 	if (sts->old)
 		STOPIF( ops__free_entry(& sts->old), NULL);
 	if (S_ISDIR(sts->st.mode))
@@ -985,69 +1117,13 @@ int ops__free_entry(struct estat **sts_p)
 	 * the free list written here overwrites parts.
 	 * So we clear on allocate. */
 
-	/* TODO: insert into free list (pointer, element count) with merging. 
-	 * That requires finding a free block just below or just above
-	 * the current sts, and check if the current and the free can be merged.
-	 * Currently the list is just prepended.
-	 *
-	 * TODO: The list should be sorted in some way.
-	 * Possibly by address and size in two trees, to quickly find
-	 * the largest free block or the nearest block.
-	 */
-	/* The freed block stores the list data to other blocks. */
+	/* Walking the free list for every single entry would make freeing a 
+	 * large subtree quadratic; so the blocks are only collected here, and 
+	 * merged into the free list in batches. */
 	DEBUGP("freeing block %p", *sts_p);
-
-	block=(struct free_estat*)*sts_p;
-	/* Can we merge? */
-	free_p=free_list;
-	prev=&free_list;
-	while (free_p)
-	{
-		VALGRIND_MAKE_MEM_DEFINED(free_p, sizeof(*free_p));
-		if ((char*)block + sizeof(struct estat) == (char*)free_p)
-		{
-			/* Copy data */
-			block->count = free_p->count+1;
-			block->next = free_p->next;
-			if (prev != &free_list)
-				VALGRIND_MAKE_MEM_DEFINED(prev, sizeof(*prev));
-			*prev = block;
-			if (prev != &free_list)
-				VALGRIND_MAKE_MEM_NOACCESS(prev, sizeof(*prev));
-			break;
-		}
-
-		if ((char*)block == (char*)free_p+sizeof(struct estat)*free_p->count)
-		{
-			free_p->count++;
-			break;
-		}
-
-		prev=&free_p->next;
-		free_p2=free_p;
-		/* silence compiler warning */
-		(void) free_p2;
-
-		free_p=*prev;
-
-		VALGRIND_MAKE_MEM_NOACCESS(free_p2, sizeof(*free_p2));
-	}
-
-
-	if (free_p)
-	{
-		DEBUGP("merged to %p; now size %d", block, free_p->count);
-		VALGRIND_MAKE_MEM_NOACCESS(free_p, sizeof(*free_p));
-	}
-	else
-	{
-		block->next=free_list;
-		block->count=1;
-		free_list=block;
-		DEBUGP("new entry in free list");
-	}
-
-	VALGRIND_MAKE_MEM_NOACCESS( block, sizeof(struct estat));
+	if (ops___freed_count >= OPS__FREE_BATCH)
+		ops___merge_freed();
+	ops___freed[ops___freed_count++]=*sts_p;
 
 	*sts_p=NULL;
 
@@ -1065,7 +1141,10 @@ ex:
  *
  * If an invalid index is given, we mark a \a BUG(). 
  *
- * \todo Use a binary search in the \c by_inode and \c by_name arrays. */
+ * \c by_name is found via a binary search; \c by_inode needn't be sorted, 
+ * so it still gets a linear scan.
+ * To remove many entries of a directory, mark them and use 
+ * ops__free_marked() instead - that needs only a single pass. */
 int ops__delete_entry(struct estat *dir, 
 		struct estat *sts, 
 		int index_byinode, 
@@ -1073,6 +1152,7 @@ int ops__delete_entry(struct estat *dir,
 {
 	int i;
 	int status;
+	struct estat **sts_p;
 
 	BUG_ON( (sts ? 1 : 0) +
 			(index_byinode >=0 ? 1 : 0) +
@@ -1123,12 +1203,42 @@ int ops__delete_entry(struct estat *dir,
 	{
 		if (index_byname == UNKNOWN_INDEX)
 		{
-			/* Maybe use ops__find_entry_byname? Would do a binary search, but 
-			 * using string compares. */
-			for(index_byname=dir->entry_count-1; 
-					index_byname>=0; 
-					index_byname--)
-				if (dir->by_name[index_byname] == sts) break;
+			/* The names are unique; but the comparison uses strcoll(), which 
+			 * may see different names as equal. So the neighbours with the same 
+			 * key are looked at, too; and if the array is not sorted in the 
+			 * current locale, there's still the linear search. */
+			sts_p=bsearch(sts->name, dir->by_name, dir->entry_count, 
+					sizeof(dir->by_name[0]), 
+					(comparison_fn_t)dir___f_sort_by_nameCS);
+
+			index_byname=UNKNOWN_INDEX;
+			if (sts_p)
+			{
+				index_byname=sts_p - dir->by_name;
+				while (index_byname > 0 &&
+						dir___f_sort_by_nameCS(sts->name, 
+							dir->by_name+index_byname-1) == 0)
+					index_byname--;
+
+				while (index_byname < dir->entry_count &&
+						dir->by_name[index_byname] != sts &&
+						dir___f_sort_by_nameCS(sts->name, 
+							dir->by_name+index_byname) == 0)
+					index_byname++;
+
+				if (index_byname >= dir->entry_count ||
+						dir->by_name[index_byname] != sts)
+					index_byname=UNKNOWN_INDEX;
+			}
+
+			if (index_byname == UNKNOWN_INDEX)
+			{
+				DEBUGP("%s not found via bsearch", sts->name);
+				for(index_byname=dir->entry_count-1; 
+						index_byname>=0; 
+						index_byname--)
+					if (dir->by_name[index_byname] == sts) break;
+			}
 
 			BUG_ON(index_byname == UNKNOWN_INDEX);
 		}
@@ -1153,6 +1263,10 @@ ex:
  * An entry is marked by having estat::to_be_ignored set; and such entries 
  * are removed here.
  *
+ * Both arrays are compacted in a single pass each; as the order of the 
+ * remaining entries is kept, \c by_name needs no re-sorting.
+ * So removing any number of entries costs only \c O(entry_count).
+ *
  * If \a fast_mode is set, the entries are get removed from the list are 
  * not free()d, nor do the pointer arrays get resized. */
 int ops__free_marked(struct estat *dir, int fast_mode)
@@ -1165,7 +1279,16 @@ int ops__free_marked(struct estat *dir, int fast_mode)
 	BUG_ON(!S_ISDIR(dir->st.mode));
 	status=0;
 
-	IF_FREE(dir->by_name);
+	/* by_name must be done first - after freeing the entries their flags 
+	 * can't be read anymore. */
+	if (dir->by_name)
+	{
+		src=dst=dir->by_name;
+		for(i=0; i<dir->entry_count; i++, src++)
+			if (!(*src)->to_be_ignored)
+				*dst++ = *src;
+		*dst=NULL;
+	}
 
 	src=dst=dir->by_inode;
 	new_count=0;
@@ -1188,11 +1311,16 @@ int ops__free_marked(struct estat *dir, int fast_mode)
 
 	if (new_count != dir->entry_count)
 	{
+		DEBUGP("removed %d of %d entries", 
+				dir->entry_count - new_count, dir->entry_count);
 		if (!fast_mode)
 		{
-			/* resize by_inode - should never give NULL. */
+			/* resize the arrays - should never give NULL. */
 			STOPIF( hlp__realloc( &dir->by_inode, 
 						sizeof(*(dir->by_inode)) * (new_count+1) ), NULL);
+			if (dir->by_name)
+				STOPIF( hlp__realloc( &dir->by_name, 
+							sizeof(*(dir->by_name)) * (new_count+1) ), NULL);
 		}
 
 		dir->by_inode[new_count]=NULL;
@@ -1749,7 +1877,8 @@ int ops__are_children_interesting(struct estat *dir)
  *
  * This means applying the target URL, and storing the auto-properties.
  *
- * Optionally the property database can be returned in \a props.
+ * Optionally the property database can be returned in \a props; else the 
+ * auto-properties are only referenced from the group, see \ref gprop.
  * */
 int ops__apply_group(struct estat *sts, hash_t *props, 
 		apr_pool_t *pool)
@@ -1779,13 +1908,15 @@ int ops__apply_group(struct estat *sts, hash_t *props,
 		}
 
 		STOPIF( prp__set_from_aprhash(sts, group->auto_props, 
-					STORE_IN_FS, props, pool), NULL);
+					props ? STORE_IN_FS : STORE_BY_GROUP, props, pool), NULL);
 		sts->flags |= RF_PUSHPROPS;
 	}
 
 	if (!sts->url)
 		sts->url=group->url;
 	sts->to_be_ignored=group->is_ignore;
+	if (group->no_blockhash)
+		sts->flags |= RF_NO_BLOCKHASH;
 
 	sts->match_pattern=NULL;
 
@@ -67,7 +67,7 @@ int ops__save_1entry(struct estat *sts,
 		int filehandle);
 /** Fills \a sts from a buffer \a where. */
 int ops__load_1entry(char **where, struct estat *sts, char **filename,
-		ino_t *parent_i);
+		ino_t *parent_i, int version);
 /** Does a \c lstat() on the given entry, and sets the \c entry_status. */
 int ops__update_single_entry(struct estat *sts, struct sstat_t *output);
 /** Wrapper for \c ops__update_single_entry and some more. */
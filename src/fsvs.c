@@ -34,6 +34,8 @@
 #include "options.h"
 #include "actions.h"
 #include "racallback.h"
+#include "props.h"
+#include "snapshot.h"
 
 /** \file
  * The central parts of fsvs (main).
@@ -77,6 +79,8 @@
  *   <dt>\ref status <dd><tt>Get a list of changed entries</tt>
  *   <dt>\ref info <dd><tt>Display detailed information about 
  *   single entries</tt>
+ *   <dt>\ref manifest <dd><tt>Print the stored data of all entries, 
+ *   for comparing machines</tt>
  *   <dt>\ref log <dd><tt>Fetch the log messages from the repository</tt>
  *   <dt>\ref diff <dd><tt>Get differences between files (local and 
  *   remote)</tt>
@@ -96,6 +100,8 @@
  * \section cmds_rep Commands working with the repository:
  * <dl>
  *   <dt>\ref commit <dd><tt>Send changed data to the repository</tt>
+ *   <dt>\ref push <dd><tt>Send locally stored commits to the 
+ *   repository</tt>
  *   <dt>\ref update <dd><tt>Get updates from the repository</tt>
  *   <dt>\ref checkout <dd><tt>Fetch some part of the repository, and 
  *     register it as working copy</tt>
@@ -966,8 +972,8 @@ void *_do_component_tests(int a)
  * - Initializes the various parts 
  *   - APR (apr_initialize()), 
  *   - WAA (waa__init()), 
- *   - RA (svn_ra_initialize()), 
- *   - Callback functions (cb__init()) ...
+ *   - RA (svn_ra_initialize()) and callback functions (cb__init()) are 
+ *     only initialized on the first repository access ...
  *   - Local charset (\c LC_CTYPE)
  * - Processes the command line. In glibc the options are reordered to the
  *   front; on BSD systems this is not done, so there's an extra loop to do
@@ -1059,7 +1065,6 @@ int main(int argc, char *args[], char *env[])
 	struct estat root = { };
 	int status, help;
 	char *cmd;
-	svn_error_t *status_svn;
 	int eo_args, i;
 	void *mem_start, *mem_end;
 
@@ -1394,15 +1399,14 @@ int main(int argc, char *args[], char *env[])
 	if (debuglevel) _do_component_tests(optind);
 #endif
 
-	/* Do some initializations. Some of them won't always be needed - 
-	 * maybe we should do another flag in the action list, if that turns
-	 * out to be slow sometimes (DNS failure/misconfiguration, loading
-	 * delay, ...) */
+	/* Do some initializations.
+	 * The RA layer, the subversion configuration and the authentication 
+	 * baton are only set up by url__open_session(), as local-only actions 
+	 * like status or info don't need them; that can be slow (DNS 
+	 * failure/misconfiguration, loading delay, ...) */
 	STOPIF( apr_initialize(), "apr_initialize");
 	STOPIF( apr_pool_create_ex(&global_pool, NULL, NULL, NULL), 
 			"create an apr_pool");
-	STOPIF_SVNERR( svn_ra_initialize, (global_pool));
-	STOPIF_SVNERR( cb__init, (global_pool));
 
 
 	STOPIF( action->work(&root, argc-optind, args+optind), 
@@ -1412,15 +1416,24 @@ int main(int argc, char *args[], char *env[])
 	STOPIF( cm__get_source(NULL, NULL, NULL, NULL, status), 
 			NULL);
 
+	/* Keep the configuration files for the next run. */
+	STOPIF( snap__save(), NULL);
+
 	/* Maybe we should try that even if we failed? 
 	 * Would make sense in that the warnings might be helpful in determining
 	 * the cause of a problem.
 	 * But the error report would scroll away, so we don't do that. */
 	STOPIF( wa__summary(), NULL);
 
+	STOPIF( prp__group_db_close(0), NULL);
+
 	STOPIF( url__close_sessions(), NULL);
 
 ex:
+	/* On errors the changed references are discarded. */
+	prp__group_db_close(status);
+	st__progress_file_finish(status);
+
 	mem_end=sbrk(0);
 	DEBUGP("memory stats: %p to %p, %llu KB", 
 			mem_start, mem_end, (t_ull)(mem_end-mem_start)/1024);
@@ -218,6 +218,16 @@ struct url_t {
 	/** Changelist counter. */
 	int entry_list_count;
 
+	/** The topmost entries of this URL, ie. the ones whose parent has 
+	 * another URL (or is the root).
+	 * Built by waa__input_tree(); only to be used if \c 
+	 * url__subtree_index_valid is set. */
+	struct estat **subtrees;
+	/** Number of entries in url_t::subtrees. */
+	unsigned subtree_count;
+	/** Allocated space in url_t::subtrees. */
+	unsigned subtree_alloc;
+
 	/** Flag saying whether this URL should be done.
 	 * Should not be queried directly, but by using url__to_be_handled().  */
 	int to_be_handled:1;
@@ -433,6 +443,12 @@ struct estat {
 	/** Flags for this entry. See \ref EntFlags "Various flags for entries" for constant definitions. */
 	AC_CV_C_UINT32_T flags;
 
+	/** Number of this entry in the WAA, stored in the \ref dir file; the
+	 * per-entry files are addressed by it (see \ref ids).
+	 * \c 0 until one is needed; then waa__get_entry_directory() assigns
+	 * one. */
+	t_ull entry_id;
+
 
 	/** Packed representations of the file type; see \c preproc.h for 
 	 * details.
@@ -550,6 +566,9 @@ struct estat {
 #define RF_COPY_SUB (32)
 /** Has this entry a conflict? */
 #define RF_CONFLICT (64)
+/** No block checksums (\ref md5s) are kept for this entry.
+ * Set from the group when the entry is added; see \ref ign_blockhash. */
+#define RF_NO_BLOCKHASH (128)
 /** This entry may not be written by waa__output_tree(). */
 #define RF_DONT_WRITE (1 << 18)
 /** Whether this entry was just created by \a ops__traverse(). */
@@ -559,7 +578,8 @@ struct estat {
 
 /** Which of the flags above should be stored in the WAA. */
 #define RF___SAVE_MASK (RF_UNVERSION | RF_ADD | RF_CHECK | \
-		RF_COPY_BASE | RF_COPY_SUB | RF_PUSHPROPS | RF_CONFLICT)
+		RF_COPY_BASE | RF_COPY_SUB | RF_PUSHPROPS | RF_CONFLICT | \
+		RF_NO_BLOCKHASH)
 /** Mask for commit-relevant flags.
  * An entry with \c RF_COPY_BASE must (per definition) marked as \c RF_ADD; 
  * and RF_PUSHPROPS gets folded into FS_PROPERTIES. */
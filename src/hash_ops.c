@@ -11,6 +11,7 @@
 #include <string.h>
 
 #include "global.h"
+#include "actions.h"
 #include "waa.h"
 #include "helper.h"
 #include "hash_ops.h"
@@ -181,29 +182,109 @@
  *
  * @{ */
 
+/** Copies the file \a from to \a to.
+ * Returns \c ENOENT silently if \a from doesn't exist. */
+static int hsh___copy_file(char *from, char *to)
+{
+	int status;
+	int src, dest;
+	ssize_t len;
+	char buffer[16384];
+
+
+	status=0;
+	dest=-1;
+	src=open(from, O_RDONLY);
+	if (src == -1)
+	{
+		status=errno;
+		if (status == ENOENT) goto ex;
+		STOPIF( status, "Cannot open database file %s", from);
+	}
+
+	dest=open(to, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+	STOPIF_CODE_ERR( dest == -1, errno, 
+			"Cannot create database file %s", to);
+
+	while (1)
+	{
+		len=read(src, buffer, sizeof(buffer));
+		STOPIF_CODE_ERR( len == -1, errno, "Reading %s", from);
+		if (len == 0) break;
+		STOPIF_CODE_ERR( write(dest, buffer, len) != len, errno, 
+				"Writing %s", to);
+	}
+
+ex:
+	if (src != -1) close(src);
+	if (dest != -1 && close(dest) == -1 && !status)
+		status=errno;
+	return status;
+}
+
+
 /** Bare open function for internal use. 
+ *
+ * If \a sts is given, the database is one of its per-entry files (see 
+ * waa__get_entry_directory()), and \a wcfile is not used.
  *
  * \a *fname_out, if not \c NULL, gets an allocated copy of the filename. 
+ *
+ * If \a publish_out is not \c NULL, a database that's opened for writing 
+ * is really a copy with a temporary name (for \c GDBM_NEWDB an empty 
+ * one), and \a *publish_out gets an allocated copy of the real name; 
+ * hsh__close() renames it into place.
+ *
+ * So a database is never changed in place; read-only actions can open 
+ * without locking, so that they don't fail or wait while a writer has the 
+ * database open, and still see either the old or the complete new data.
+ *
+ * If \a pending_out is given too, the copy is deferred: for \c 
+ * GDBM_WRITER and \c GDBM_WRCREAT the current file is opened read-only 
+ * (for \c GDBM_WRCREAT it needn't exist, then \a *output is \c NULL), 
+ * and \a *pending_out gets the mode to use on the first write; see 
+ * hsh___make_writable(). Most databases opened for writing are never 
+ * changed.
  * */
-int hsh___new_bare(char *wcfile, char *name, int gdbm_mode, 
+int hsh___new_bare(char *wcfile, struct estat *sts, 
+		char *name, int gdbm_mode, 
 		GDBM_FILE *output, 
-		char **fname_out)
+		char **fname_out,
+		char **publish_out,
+		int *pending_out)
 {
 	int status;
 	char *cp, *eos;
 	GDBM_FILE db;
+	int open_mode, is_temporary, pending;
 
 
 	status=0;
 	db=NULL;
+	pending= publish_out && pending_out && 
+		(gdbm_mode == GDBM_WRITER || gdbm_mode == GDBM_WRCREAT) ? 
+		gdbm_mode : 0;
+	if (pending) gdbm_mode=GDBM_READER;
 
-	if (gdbm_mode == HASH_TEMPORARY)
+	is_temporary= gdbm_mode == HASH_TEMPORARY;
+	if (is_temporary)
 	{
 		/* Replace our own constant with a public available value. */
 		gdbm_mode = GDBM_NEWDB;
 		cp=waa_tmp_path;
 		/* Use this bit, so that the open filehandle says what it was. */
 		eos=waa_tmp_fn;
+		/* Nothing to publish. */
+		publish_out=NULL;
+	}
+	else if (sts)
+	{
+		/* An entry without an ID has no databases yet. */
+		status=waa__get_entry_directory(sts, &cp, &eos, NULL,
+				pending ? GWD_NEW_ID :
+				(gdbm_mode == GDBM_READER) ? 0 : GWD_MKDIR | GWD_NEW_ID);
+		if (status == ENOENT) goto ex;
+		STOPIF(status, NULL);
 	}
 	else
 		STOPIF( waa__get_waa_directory(wcfile, &cp, &eos, NULL,
@@ -211,6 +292,24 @@ int hsh___new_bare(char *wcfile, char *name, int gdbm_mode,
 					| waa__get_gwd_flag(name)), NULL);
 	strcpy(eos, name);
 
+	if (pending)
+		STOPIF( hlp__strdup( publish_out, cp), NULL);
+	else if (gdbm_mode != GDBM_READER && publish_out)
+	{
+		STOPIF( hlp__strdup( publish_out, cp), NULL);
+		strcat(eos, ".tmp");
+
+		if (gdbm_mode != GDBM_NEWDB)
+		{
+			status=hsh___copy_file(*publish_out, cp);
+			if (status == ENOENT && gdbm_mode == GDBM_WRCREAT)
+				status=0;
+			/* For GDBM_WRITER ENOENT goes back silently. */
+			if (status == ENOENT) goto ex;
+			STOPIF( status, NULL);
+		}
+	}
+
 	if (gdbm_mode == GDBM_NEWDB)
 	{
 		/* libgdbm3=1.8.3-3 has a bug - with GDBM_NEWDB an existing database is 
@@ -223,31 +322,119 @@ int hsh___new_bare(char *wcfile, char *name, int gdbm_mode,
 		status=0;
 	}
 
-	db = gdbm_open(cp, 0, gdbm_mode, 0777, NULL);
+	open_mode=gdbm_mode;
+#ifdef GDBM_NOLOCK
+	if (gdbm_mode == GDBM_READER && action->is_readonly)
+		open_mode |= GDBM_NOLOCK;
+#endif
+
+	db = gdbm_open(cp, 0, open_mode, 0777, NULL);
 	if (!db)
 	{
 		status=errno;
-		if (status != ENOENT)
+		/* Nothing to read yet. */
+		if (status == ENOENT && pending == GDBM_WRCREAT)
+			status=0;
+		else if (status != ENOENT)
 			STOPIF(status, "Cannot open database file %s", cp);
 	}
-	else
-	{
-		/* Temporary files can be removed immediately. */
-		if (gdbm_mode == HASH_TEMPORARY)
-			STOPIF_CODE_ERR( unlink(cp) == -1, errno,
-					"Removing database file '%s'", cp);
+	/* Temporary files can be removed immediately. */
+	else if (is_temporary)
+		STOPIF_CODE_ERR( unlink(cp) == -1, errno,
+				"Removing database file '%s'", cp);
 
-		if (fname_out) 
-			STOPIF( hlp__strdup( fname_out, cp), NULL);
-	}
+	if (!status && fname_out) 
+		STOPIF( hlp__strmnalloc( strlen(cp)+5, fname_out, 
+					cp, pending ? ".tmp" : "", NULL), NULL);
 
 ex:
 	if (status)
 	{
 		if (db) gdbm_close(db);
+		if (publish_out && *publish_out)
+		{
+			/* Don't leave a half-written copy behind. */
+			if (!pending) unlink(cp);
+			IF_FREE(*publish_out);
+		}
 	}
 	else
+	{
 		*output=db;
+		if (pending_out) *pending_out=pending;
+	}
+
+	return status;
+}
+
+
+/** Makes the copy of a database that was opened for writing, and opens 
+ * that instead of the current file.
+ * Called before the first change; see hsh___new_bare(). */
+static int hsh___make_writable(hash_t db)
+{
+	int status, mode;
+	char *tmp_name;
+
+
+	tmp_name=NULL;
+	STOPIF( hlp__strmnalloc( strlen(db->publish_as)+5, &tmp_name, 
+				db->publish_as, ".tmp", NULL), NULL);
+	DEBUGP("copying %s for writing", db->publish_as);
+
+	if (db->db)
+	{
+		gdbm_close(db->db);
+		db->db=NULL;
+	}
+
+	STOPIF( waa__mkdir(tmp_name, 0), NULL);
+	mode=GDBM_WRITER;
+	status=hsh___copy_file(db->publish_as, tmp_name);
+	if (status == ENOENT)
+	{
+		/* See the GDBM_NEWDB bug in hsh___new_bare(). */
+		STOPIF_CODE_ERR( unlink(tmp_name) == -1 && errno != ENOENT, errno,
+				"Removing database file '%s'", tmp_name);
+		mode=GDBM_NEWDB;
+	}
+	else
+		STOPIF(status, NULL);
+
+	db->db = gdbm_open(tmp_name, 0, mode, 0777, NULL);
+	STOPIF_CODE_ERR( !db->db, errno, 
+			"Cannot open database file %s", tmp_name);
+	db->write_mode=0;
+
+ex:
+	IF_FREE(tmp_name);
+	return status;
+}
+
+
+/** Common part of hsh__new() and hsh__new_for_entry(). */
+static int hsh___new(char *wcfile, struct estat *sts, 
+		char *name, int gdbm_mode, 
+		hash_t *output)
+{
+	int status;
+	hash_t hash;
+
+
+	STOPIF( hlp__calloc( &hash, 1, sizeof(*hash)), NULL);
+
+	/* Return errors silently. */
+	status=hsh___new_bare(wcfile, sts, name, 
+			gdbm_mode & ~HASH_REMEMBER_FILENAME, 
+			& (hash->db), 
+			gdbm_mode & HASH_REMEMBER_FILENAME ? &(hash->filename) : NULL,
+			& (hash->publish_as), & (hash->write_mode));
+
+ex:
+	if (status)
+		IF_FREE(hash);
+	else
+		*output=hash;
 
 	return status;
 }
@@ -263,26 +450,104 @@ ex:
  */
 int hsh__new(char *wcfile, char *name, int gdbm_mode, 
 		hash_t *output)
+{
+	return hsh___new(wcfile, NULL, name, gdbm_mode, output);
+}
+
+
+/** -.
+ * Returns \c ENOENT silently, like hsh__new(); an entry without an ID 
+ * has no database yet. */
+int hsh__new_for_entry(struct estat *sts, char *name, int gdbm_mode, 
+		hash_t *output)
+{
+	return hsh___new(NULL, sts, name, gdbm_mode, output);
+}
+
+
+/** -.
+ * The \a list is of the form <tt>key\\0value\\0key\\0value\\0...</tt>, 
+ * with both strings stored including their \c \\0; it's copied, so the 
+ * caller keeps its memory.
+ *
+ * Nothing is written anywhere; storing or deleting in such a hash is an 
+ * error. */
+int hsh__new_from_list(datum list, hash_t *output)
 {
 	int status;
 	hash_t hash;
 
 
 	STOPIF( hlp__calloc( &hash, 1, sizeof(*hash)), NULL);
+	STOPIF( hlp__alloc( &hash->in_memory.dptr, list.dsize+1), NULL);
+	memcpy(hash->in_memory.dptr, list.dptr, list.dsize);
+	hash->in_memory.dsize=list.dsize;
 
-	/* Return errors silently. */
-	status=hsh___new_bare(wcfile, name, 
-			gdbm_mode & ~HASH_REMEMBER_FILENAME, 
-			& (hash->db), 
-			gdbm_mode & HASH_REMEMBER_FILENAME ? &(hash->filename) : NULL);
+	*output=hash;
 
 ex:
-	if (status)
-		IF_FREE(hash);
+	return status;
+}
+
+
+/** Returns the next key in the in-memory list of \a db after \a pos, or 
+ * the first if \a pos is \c NULL; \c NULL at the end.
+ * The value follows the returned key. */
+static char *hsh___list_next(hash_t db, char *pos)
+{
+	char *end;
+
+
+	end=db->in_memory.dptr + db->in_memory.dsize;
+	if (!pos)
+		pos=db->in_memory.dptr;
 	else
-		*output=hash;
+	{
+		/* Skip key and value. */
+		pos+=strlen(pos)+1;
+		pos+=strlen(pos)+1;
+	}
 
-	return status;
+	return pos < end ? pos : NULL;
+}
+
+
+/** Finds \a key in the in-memory list of \a db. */
+static char *hsh___list_find(hash_t db, datum key)
+{
+	char *cp;
+
+
+	for(cp=hsh___list_next(db, NULL); cp; cp=hsh___list_next(db, cp))
+		if (strlen(cp)+1 == key.dsize && memcmp(cp, key.dptr, key.dsize) == 0)
+			return cp;
+
+	return NULL;
+}
+
+
+/** Returns an allocated copy of the string at \a cp in \a out; 
+ * \c ENOENT if \a cp is \c NULL. */
+static int hsh___list_copy(char *cp, datum *out)
+{
+	datum d;
+
+
+	d.dptr=NULL;
+	d.dsize=0;
+	if (cp)
+	{
+		d.dsize=strlen(cp)+1;
+		d.dptr=malloc(d.dsize);
+		if (d.dptr)
+			memcpy(d.dptr, cp, d.dsize);
+		else
+			d.dsize=0;
+	}
+
+	if (out) *out=d;
+	else IF_FREE(d.dptr);
+	return d.dptr ? 0 : cp ? ENOMEM : ENOENT;
 }
 
 
@@ -301,6 +566,8 @@ int hsh__collect_garbage(hash_t db, int *did_remove)
 	if (db && db->to_delete)
 	{
 		key=gdbm_firstkey(db->to_delete);
+		if (key.dptr && db->write_mode)
+			STOPIF( hsh___make_writable(db), NULL);
 		while (key.dptr)
 		{
 			next=gdbm_nextkey(db->to_delete, key);
@@ -328,15 +595,18 @@ ex:
 /** -.
  * 
  * If \a has_failed is set, some error has happened, and the registered 
- * keys are not used for deletion (like a \c ROLLBACK). */
+ * keys are not used for deletion (like a \c ROLLBACK); the changed copy 
+ * of the database is discarded, and the old data kept. */
 int hsh__close(hash_t db, int has_failed)
 {
 	int status;
 	int have_removed;
 	datum key;
+	char *tmp_name;
 
 
 	status=0;
+	tmp_name=NULL;
 	if (!db) goto ex;
 
 	have_removed=0;
@@ -346,13 +616,26 @@ int hsh__close(hash_t db, int has_failed)
 			STOPIF( hsh__collect_garbage(db, &have_removed), NULL);
 	}
 
-	/* No more data in that hash? */
-	if (hsh__first(db, &key) == ENOENT &&
-			db->filename)
+	/* Never changed - the current file stays as it is. */
+	if (db->write_mode)
+		IF_FREE(db->publish_as);
+
+	/* No more data in that hash? Only on success, and only if there's a 
+	 * (new) file. */
+	if (!has_failed && !db->write_mode && db->filename &&
+			hsh__first(db, &key) == ENOENT)
 	{
 		DEBUGP("nothing found, removing %s", db->filename);
 		STOPIF( waa__delete_byext(db->filename, NULL, 0), 
 				"Cleaning up the empty hash '%s'", db->filename);
+
+		/* The old data is superseded, too. */
+		if (db->publish_as)
+		{
+			STOPIF_CODE_ERR( unlink(db->publish_as) == -1 && errno != ENOENT, 
+					errno, "Removing database file '%s'", db->publish_as);
+			IF_FREE(db->publish_as);
+		}
 	}
 	else
 	{
@@ -374,9 +657,25 @@ int hsh__close(hash_t db, int has_failed)
 		db->db=NULL;
 	}
 
+	if (db->publish_as)
+	{
+		STOPIF( hlp__strmnalloc( strlen(db->publish_as)+5, &tmp_name, 
+					db->publish_as, ".tmp", NULL), NULL);
+		if (has_failed)
+			status= unlink(tmp_name) == -1 && errno != ENOENT ? errno : 0;
+		else
+			status= rename(tmp_name, db->publish_as) == -1 ? errno : 0;
+		STOPIF( status, "Publishing database file '%s'", db->publish_as);
+	}
+
 ex:
+	IF_FREE(tmp_name);
 	if (db)
+	{
 		IF_FREE(db->filename);
+		IF_FREE(db->publish_as);
+		IF_FREE(db->in_memory.dptr);
+	}
 	IF_FREE(db);
 
 	return status;
@@ -388,7 +687,13 @@ int hsh__fetch(hash_t db, datum key, datum *value)
 {
 	static datum vl;
 
-	if (!db) return ENOENT;
+	if (!db || (!db->db && !db->in_memory.dptr)) return ENOENT;
+
+	if (db->in_memory.dptr)
+	{
+		vl.dptr=hsh___list_find(db, key);
+		return hsh___list_copy(vl.dptr ? vl.dptr+key.dsize : NULL, value);
+	}
 
 	vl=gdbm_fetch(db->db, key);
 
@@ -404,7 +709,10 @@ int hsh__first(hash_t db, datum *key)
 {
 	datum k;
 
-	if (!db) return ENOENT;
+	if (!db || (!db->db && !db->in_memory.dptr)) return ENOENT;
+
+	if (db->in_memory.dptr)
+		return hsh___list_copy(hsh___list_next(db, NULL), key);
 
 	k=gdbm_firstkey(db->db);
 	if (key) *key=k;
@@ -421,7 +729,13 @@ int hsh__next(hash_t db, datum *key, const datum *oldkey)
 	datum k;
 
 	/* Get next key. */
-	k=gdbm_nextkey(db->db, *oldkey);
+	if (db->in_memory.dptr)
+	{
+		k.dptr=hsh___list_find(db, *oldkey);
+		hsh___list_copy(k.dptr ? hsh___list_next(db, k.dptr) : NULL, &k);
+	}
+	else
+		k=gdbm_nextkey(db->db, *oldkey);
 
 	/* Ev. free old key-data. */
 	if (oldkey == key) 
@@ -442,6 +756,10 @@ int hsh__store(hash_t db, datum key, datum value)
 {
 	int status;
 
+	BUG_ON(db->in_memory.dptr, "Storing into a read-only hash");
+	if (db->write_mode)
+		STOPIF( hsh___make_writable(db), NULL);
+
 	if (value.dsize == 0 || value.dptr == NULL)
 		status=gdbm_delete(db->db, key);
 	else
@@ -455,6 +773,33 @@ ex:
 }
 
 
+/** -.
+ * Returns \c ENOENT silently if there's no such key; then no copy of the 
+ * database needs to be made. */
+int hsh__delete(hash_t db, datum key)
+{
+	int status;
+
+
+	status=0;
+	BUG_ON(db->in_memory.dptr, "Deleting in a read-only hash");
+	if (!db->db || !gdbm_exists(db->db, key))
+	{
+		status=ENOENT;
+		goto ex;
+	}
+
+	if (db->write_mode)
+		STOPIF( hsh___make_writable(db), NULL);
+
+	STOPIF_CODE_ERR( gdbm_delete(db->db, key) != 0, gdbm_errno,
+			"Removing %s", key.dptr);
+
+ex:
+	return status;
+}
+
+
 /** -.
  * The delimiting \\0 is stored, too. */
 int hsh__store_charp(hash_t db, char *keyp, char *valuep)
@@ -624,8 +969,8 @@ int hsh__register_delete(hash_t db, datum key)
 
 	if (!db->to_delete)
 	{
-		STOPIF( hsh___new_bare(NULL, "del", HASH_TEMPORARY,
-					&(db->to_delete), NULL), 
+		STOPIF( hsh___new_bare(NULL, NULL, "del", HASH_TEMPORARY,
+					&(db->to_delete), NULL, NULL, NULL), 
 				NULL);
 	}
 
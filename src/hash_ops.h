@@ -38,6 +38,17 @@ struct hash_s
 	GDBM_FILE to_delete;
 	/** Allocated copy of the filename, if HASH_REMEMBER_FILENAME was set. */
 	char *filename;
+	/** A database opened for writing is a copy with a temporary name; on 
+	 * hsh__close() it gets renamed to this (allocated) name.
+	 * So readers see either the old or the complete new data. */
+	char *publish_as;
+	/** If not \c 0, the copy for writing has not been made yet; \c db is 
+	 * the current file, opened read-only (or \c NULL if there's none), 
+	 * and this is the mode to open the copy with. */
+	int write_mode;
+	/** For hsh__new_from_list(): a read-only <tt>key\\0value\\0...</tt> 
+	 * list in memory, used instead of \c db. */
+	datum in_memory;
 };
 
 
@@ -46,11 +57,16 @@ struct hash_s
  */
 int hsh__new(char *wcfile, char *name, int gdbm_mode, 
 		hash_t *hash);
+/** Create a new hash with the given \a name for the entry \a sts. */
+int hsh__new_for_entry(struct estat *sts, char *name, int gdbm_mode, 
+		hash_t *hash);
 /** Only a temporary hash; not available in \c gdbm.
  * Unless the predefined constants include the value \c 0, and ORed 
  * together give -1, this is a distinct value. */
 #define HASH_TEMPORARY ((GDBM_NEWDB | GDBM_READER | \
 			GDBM_WRCREAT | GDBM_WRITER) +1)
+/** Returns a read-only hash that serves the data in \a list. */
+int hsh__new_from_list(datum list, hash_t *hash);
 /** This flag tells hsh__new() to remember the filename, for later 
  * cleaning-up. */
 #define HASH_REMEMBER_FILENAME (0x40000000)
@@ -82,6 +98,8 @@ int hsh__list_get(hash_t hash,
 int hsh__store_charp(hash_t db, char *key, char *value);
 /** Store some value in the hash table. */
 int hsh__store(hash_t db, datum key, datum value);
+/** Remove \a key from the hash table. */
+int hsh__delete(hash_t db, datum key);
 /** Read \a value associated with some \a key in \a db.
  * Memory of datum::dptr is malloc()ed. */
 int hsh__fetch(hash_t db, datum key, datum *value);
@@ -14,6 +14,7 @@
 #include <netdb.h>
 #include <time.h>
 #include <sys/types.h>
+#include <sys/resource.h>
 #include <grp.h>
 #include <poll.h>
 #include <pwd.h>
@@ -1813,14 +1814,17 @@ int hlp__stream_md5(svn_stream_t *stream, unsigned char md5[APR_MD5_DIGESTSIZE])
 {
 	int status;
 	svn_error_t *status_svn;
-	const int buffer_size=16384;
-	char *buffer;
+	const int buffer_size=128*1024;
+	static char *buffer=NULL;
 	apr_size_t len;
 	apr_md5_ctx_t md5_ctx;
 
 
 	status=0;
-	STOPIF( hlp__alloc( &buffer, buffer_size), NULL);
+	/* The buffer is kept for the next call; this gets called for every 
+	 * file on commit. */
+	if (!buffer)
+		STOPIF( hlp__alloc( &buffer, buffer_size), NULL);
 
 	if (md5)
 		apr_md5_init(&md5_ctx);
@@ -1861,6 +1865,231 @@ int hlp__delay(time_t start, enum opt__delay_e which)
 }
 
 
+/** How long a window for the \ref o_limits "CPU limit" is, in 
+ * microseconds.
+ * The CPU time used in that window is compared to the wall-clock time; 
+ * then a new window is started. */
+#define HLP___CPU_WINDOW (2*1000000LL)
+
+/** State of hlp__throttle(). */
+static struct {
+	/** Bytes that may still be read without waiting; gets negative if 
+	 * more than that was read. */
+	long long tokens;
+	/** When \a tokens was last refilled, in microseconds. */
+	long long refilled;
+	/** Start of the current CPU window, in wall-clock and CPU 
+	 * microseconds. */
+	long long window_wall, window_cpu;
+	/** When the limit file was last looked at. */
+	long long file_checked;
+	/** The modification time of the limit file when it was read. */
+	time_t file_mtime;
+} hlp___throttle;
+
+
+/** -.
+ * */
+long long hlp__usec_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000LL + ts.tv_nsec/1000;
+}
+
+
+/** Returns the CPU time used by this process, in microseconds. */
+static long long hlp___usec_cpu(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)*1000000LL +
+		ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+
+/** Reads the \c io_limit and \c cpu_limit settings from \a fn.
+ * The syntax is the same as for the configuration files; other options 
+ * are not allowed here. */
+static int hlp___read_limit_file(const char *fn)
+{
+	int status;
+	FILE *fp;
+	char *buffer;
+
+
+	status=0;
+	fp=fopen(fn, "r");
+	if (!fp)
+	{
+		status=errno;
+		/* Not there (anymore) - keep the current values. */
+		if (status == ENOENT)
+		{
+			status=0;
+			goto ex;
+		}
+		STOPIF( status, "Cannot open the limit file '%s'", fn);
+	}
+
+	DEBUGP("reading limits from %s", fn);
+	hlp__string_from_filep(NULL, NULL, NULL, SFF_RESET_LINENUM);
+	while (1)
+	{
+		status=hlp__string_from_filep(fp, &buffer, NULL,
+				SFF_WHITESPACE | SFF_COMMENT);
+		if (status == EOF) break;
+		STOPIF( status, NULL);
+
+		if (*buffer == '#') continue;
+
+		STOPIF_CODE_ERR( strncmp(buffer, "io_limit", 8) != 0 &&
+				strncmp(buffer, "cpu_limit", 9) != 0, EINVAL,
+				"!Only \"io_limit\" and \"cpu_limit\" can be set in the limit file\n"
+				"'%s' (line %u).", fn,
+				hlp__string_from_filep(NULL, NULL, NULL, SFF_GET_LINENUM));
+
+		/* The file overrides even the command line. */
+		STOPIF( opt__parse(buffer, NULL, PRIO_MUSTHAVE, 0),
+				"In file '%s' on line %u", fn, 
+				hlp__string_from_filep(NULL, NULL, NULL, SFF_GET_LINENUM));
+	}
+	status=0;
+
+ex:
+	if (fp) fclose(fp);
+	return status;
+}
+
+
+/** Looks (at most once per second) whether the limit file has changed, 
+ * and re-reads it in that case. */
+static int hlp___check_limit_file(long long now)
+{
+	int status;
+	const char *fn;
+	struct stat st;
+
+
+	status=0;
+	fn=opt__get_string(OPT__LIMIT_FILE);
+	if (!fn || !*fn) goto ex;
+
+	if (hlp___throttle.file_checked &&
+			now - hlp___throttle.file_checked < 1000000) 
+		goto ex;
+	hlp___throttle.file_checked=now;
+
+	if (stat(fn, &st) == -1 || st.st_mtime == hlp___throttle.file_mtime)
+		goto ex;
+
+	hlp___throttle.file_mtime=st.st_mtime;
+	STOPIF( hlp___read_limit_file(fn), NULL);
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * */
+int hlp__throttle_active(void)
+{
+	const char *fn;
+
+	fn=opt__get_string(OPT__LIMIT_FILE);
+	return opt__get_int(OPT__IO_LIMIT) > 0 || 
+		opt__get_int(OPT__CPU_LIMIT) < 100 || 
+		(fn && *fn);
+}
+
+
+/** -.
+ * Two token buckets are used:
+ * - For the \c io_limit the bucket is refilled with the allowed number of 
+ *   bytes per second, and holds at most one second worth of data; if 
+ *   \a bytes is more than is in the bucket, we wait until it's paid back.
+ * - For the \c cpu_limit the CPU time used in the current window is 
+ *   compared to the wall-clock time that may be used for it; if we're 
+ *   ahead, we sleep for the difference.
+ *
+ * The limits can be changed while running via the \ref o_limits "limit 
+ * file". */
+int hlp__throttle(unsigned long long bytes)
+{
+	int status;
+	long long now, rate, wait, cpu_now, need;
+	int io_limit, cpu_limit;
+
+
+	status=0;
+	now=hlp__usec_now();
+	STOPIF( hlp___check_limit_file(now), NULL);
+
+	io_limit=opt__get_int(OPT__IO_LIMIT);
+	cpu_limit=opt__get_int(OPT__CPU_LIMIT);
+	wait=0;
+
+	if (io_limit > 0)
+	{
+		rate=io_limit*1024LL;
+		if (!hlp___throttle.refilled)
+		{
+			hlp___throttle.tokens=rate;
+			hlp___throttle.refilled=now;
+		}
+
+		hlp___throttle.tokens += 
+			(now - hlp___throttle.refilled) * rate / 1000000;
+		if (hlp___throttle.tokens > rate)
+			hlp___throttle.tokens=rate;
+		hlp___throttle.refilled=now;
+
+		hlp___throttle.tokens -= bytes;
+		if (hlp___throttle.tokens < 0)
+			wait= -hlp___throttle.tokens * 1000000 / rate;
+	}
+	else
+		hlp___throttle.refilled=0;
+
+	if (cpu_limit > 0 && cpu_limit < 100)
+	{
+		cpu_now=hlp___usec_cpu();
+		if (!hlp___throttle.window_wall ||
+				now - hlp___throttle.window_wall > HLP___CPU_WINDOW)
+		{
+			hlp___throttle.window_wall=now;
+			hlp___throttle.window_cpu=cpu_now;
+		}
+		else
+		{
+			/* The CPU time used so far needs that much wall-clock time. */
+			need=(cpu_now - hlp___throttle.window_cpu) * 100 / cpu_limit - 
+				(now - hlp___throttle.window_wall);
+			if (need > wait) wait=need;
+		}
+	}
+
+	/* Less than a millisecond isn't worth a syscall. */
+	if (wait >= 1000)
+	{
+		DEBUGP("throttling for %lld usec", wait);
+		/* usleep() needn't support a second or more. */
+		while (wait >= 1000000)
+		{
+			sleep(1);
+			wait -= 1000000;
+		}
+		usleep(wait);
+	}
+
+ex:
+	return status;
+}
+
+
 /** -.
  * We could either generate a name ourself, or just use this function - and 
  * have in mind that we open and close a file, just to overwrite it 
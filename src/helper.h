@@ -170,6 +170,14 @@ int hlp__stream_md5(svn_stream_t *stream,
 /** Delay until time wraps. */
 int hlp__delay(time_t start, enum opt__delay_e which);
 
+/** Returns a monotonic time in microseconds. */
+long long hlp__usec_now(void);
+/** Waits as needed to keep the \ref o_limits "I/O and CPU limits", after 
+ * \a bytes have been read. */
+int hlp__throttle(unsigned long long bytes);
+/** Whether some \ref o_limits "limit" is set. */
+int hlp__throttle_active(void);
+
 /** Renames a local file to something like .mine. */
 int hlp__rename_to_unique(char *fn, char *extension, 
 		const char **unique_name, 
@@ -0,0 +1,424 @@
+/************************************************************************
+ * Copyright (C) 2009 Philipp Marek.
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ ************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "global.h"
+#include "waa.h"
+#include "helper.h"
+#include "est_ops.h"
+#include "options.h"
+#include "image.h"
+#include "hot.h"
+
+
+/** \file
+ * Change frequency statistics, for the \ref o_hot_first option.
+ *
+ * \ref status with \ref o_stop_change stops at the first change; but the
+ * entries are checked in the order of the \ref dir file, so a change in
+ * a file that is changed all the time might only be seen at the end.
+ *
+ * So each \ref commit counts how often the entries got committed with
+ * changes, and the most often changed ones are kept in the \ref hot file
+ * - along with their \c lstat() data from the \ref dir file, so that they
+ *   can be checked before the entries are read at all.
+ *
+ * As the \ref tree image, the \ref hot file records the \ref dir file it
+ * belongs to, and is rewritten with it; the \c lstat() data isn't used if
+ * that doesn't match. (The counts stay valid.)
+ *
+ * The counts are halved when one of them gets too big, so that entries
+ * which are not changed anymore move down the list again. */
+
+
+/** How many entries are kept in the \ref hot file. */
+#define HOT___MAX_ENTRIES (256)
+/** If a count gets bigger than that, all of them are halved. */
+#define HOT___MAX_COUNT (1024)
+
+
+/** An entry of the \ref hot file. */
+struct hot___entry_t
+{
+	/** How often it was committed with changes. */
+	unsigned count;
+	/** The \c lstat() data from the \ref dir file. */
+	struct sstat_t st;
+	/** The wc-relative path. */
+	char *path;
+	/** The entry in the tree, if found by hot___resolve(). */
+	struct estat *sts;
+};
+
+
+/** The entries noted while committing. */
+static struct estat **hot___noted;
+/** Number of entries in \ref hot___noted, and allocated. */
+static int hot___noted_count, hot___noted_max;
+
+
+/** -. */
+int hot__note(struct estat *sts)
+{
+	int status;
+
+
+	status=0;
+	if (hot___noted_count >= hot___noted_max)
+	{
+		hot___noted_max = hot___noted_max*2 + 64;
+		STOPIF( hlp__realloc( &hot___noted,
+					hot___noted_max*sizeof(*hot___noted)), NULL);
+	}
+	hot___noted[hot___noted_count++]=sts;
+
+ex:
+	return status;
+}
+
+
+/** Reads the \ref hot file.
+ * \a *list is \c NULL and \a *count \c 0 if there's none.  \a valid tells
+ * whether the \c lstat() data belongs to the current \ref dir file. */
+static int hot___load(struct hot___entry_t **list, int *count,
+		int *valid)
+{
+	int status, fh, i, pos;
+	struct stat st, dir_st;
+	char *buffer, *cp;
+	struct hot___entry_t *ent;
+	unsigned cnt, mode;
+	t_ull uid, gid, size, dev, ino, m_s, m_ns, c_s, c_ns;
+	t_ull d_dev, d_ino, d_size, d_m_s, d_m_ns;
+
+
+	status=0;
+	fh=-1;
+	buffer=NULL;
+	*list=NULL;
+	*count=0;
+	*valid=0;
+
+	status=waa__open_byext(wc_path, WAA__HOT_EXT, WAA__READ, &fh);
+	if (status == ENOENT)
+	{
+		status=0;
+		goto ex;
+	}
+	STOPIF( status, NULL);
+
+	STOPIF_CODE_ERR( fstat(fh, &st) == -1, errno,
+			"Cannot get length of the change statistics");
+	STOPIF( hlp__alloc( &buffer, st.st_size+1), NULL);
+	STOPIF_CODE_ERR( read(fh, buffer, st.st_size) != st.st_size, errno,
+			"Cannot read the change statistics");
+	buffer[st.st_size]=0;
+
+	/* The first line identifies the dir file. */
+	if (sscanf(buffer, "%llu %llu %llu %llu %llu\n%n",
+				&d_dev, &d_ino, &d_size, &d_m_s, &d_m_ns, &pos) != 5)
+		goto invalid;
+
+	status=img__dir_stat(&dir_st);
+	if (status == ENOENT)
+		status=0;
+	else
+	{
+		STOPIF( status, NULL);
+		*valid = d_dev == (t_ull)dir_st.st_dev &&
+			d_ino == (t_ull)dir_st.st_ino &&
+			d_size == (t_ull)dir_st.st_size &&
+			d_m_s == (t_ull)dir_st.st_mtim.tv_sec &&
+			d_m_ns == (t_ull)dir_st.st_mtim.tv_nsec;
+	}
+
+	/* Each line ends with "\0\n". */
+	for(cp=buffer+pos; cp < buffer+st.st_size; cp++)
+		if (!cp[0] && cp[1] == '\n') (*count)++;
+
+	STOPIF( hlp__calloc( list, *count+1, sizeof(**list)), NULL);
+
+	cp=buffer+pos;
+	for(i=0; i<*count; i++)
+	{
+		ent=(*list)+i;
+
+		if (sscanf(cp, "%u %o %llu %llu %llu %llu %llu "
+					"%llu %llu %llu %llu %n",
+					&cnt, &mode, &uid, &gid, &size, &dev, &ino,
+					&m_s, &m_ns, &c_s, &c_ns, &pos) != 11)
+			goto invalid;
+
+		ent->count=cnt;
+		ent->st.mode=mode;
+		ent->st.uid=uid;
+		ent->st.gid=gid;
+		ent->st.size=size;
+		ent->st.dev=dev;
+		ent->st.ino=ino;
+		ent->st.mtim.tv_sec=m_s;
+		ent->st.mtim.tv_nsec=m_ns;
+		ent->st.ctim.tv_sec=c_s;
+		ent->st.ctim.tv_nsec=c_ns;
+		STOPIF( hlp__strdup( &ent->path, cp+pos), NULL);
+
+		cp += pos + strlen(cp+pos) + 2;
+	}
+
+ex:
+	if (fh != -1) close(fh);
+	IF_FREE(buffer);
+	return status;
+
+invalid:
+	/* Only statistics - start again. */
+	DEBUGP("invalid change statistics");
+	for(i=0; i<*count && *list; i++)
+		IF_FREE((*list)[i].path);
+	*count=0;
+	*valid=0;
+	goto ex;
+}
+
+
+/** Sorts by descending count. */
+static int hot___cmp_count(const void *a, const void *b)
+{
+	const struct hot___entry_t *l=a, *r=b;
+
+	return l->count < r->count ? 1 : l->count > r->count ? -1 : 0;
+}
+
+
+/** Sorts by path; the entries below a directory come directly after it, 
+ * as the \c PATH_SEPARATOR sorts before every other character. */
+static int hot___cmp_path(const void *a, const void *b)
+{
+	const unsigned char *l=(unsigned char*)((struct hot___entry_t*)a)->path;
+	const unsigned char *r=(unsigned char*)((struct hot___entry_t*)b)->path;
+
+	while (*l && *l == *r) l++, r++;
+	return (*l == PATH_SEPARATOR ? 1 : *l) - (*r == PATH_SEPARATOR ? 1 : *r);
+}
+
+
+/** Finds the entries of \a list (\a count elements, sorted by 
+ * hot___cmp_path()) below \a dir; \a skip is the length of the path of 
+ * \a dir, including the separator.
+ *
+ * All paths with the same name at this level are next to each other, so 
+ * each directory is searched only once, however many of its entries are 
+ * listed. Entries that don't exist anymore are left at \c NULL. */
+static int hot___resolve(struct estat *dir, struct hot___entry_t *list,
+		int count, int skip)
+{
+	int status, i, j, len;
+	char *name, *cp, c;
+	struct estat *sts;
+
+
+	status=0;
+	for(i=0; i<count; i=j)
+	{
+		name=list[i].path+skip;
+		cp=strchr(name, PATH_SEPARATOR);
+		len= cp ? cp-name : strlen(name);
+
+		for(j=i+1; j<count; j++)
+			if (strncmp(list[j].path+skip, name, len) != 0 ||
+					(list[j].path[skip+len] && 
+					 list[j].path[skip+len] != PATH_SEPARATOR))
+				break;
+
+		/* ops__find_entry_byname() only looks at the last part of the path. 
+		 * */
+		c=name[len];
+		name[len]=0;
+		STOPIF( ops__find_entry_byname(dir, list[i].path, &sts, 1), NULL);
+		name[len]=c;
+		if (!sts) continue;
+
+		if (!c)
+		{
+			list[i].sts=sts;
+			i++;
+		}
+
+		if (i<j && S_ISDIR(sts->st.mode))
+			STOPIF( hot___resolve(sts, list+i, j-i, skip+len+1), NULL);
+	}
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * The \ref hot file is only written if some entry was committed with
+ * changes, or if it already exists; then the \c lstat() data is taken
+ * from \a root. */
+int hot__write(struct estat *root)
+{
+	int status, fh, count, valid, i, j, k, len;
+	struct hot___entry_t *list;
+	struct estat *sts;
+	struct stat dir_st;
+	char *path, buffer[256];
+
+
+	status=0;
+	fh=-1;
+	list=NULL;
+
+	STOPIF( hot___load(&list, &count, &valid), NULL);
+	if (!list && !hot___noted_count) goto ex;
+
+	if (hot___noted_count)
+		STOPIF( hlp__realloc( &list,
+					(count+hot___noted_count)*sizeof(*list)), NULL);
+
+	for(i=0; i<hot___noted_count; i++)
+	{
+		STOPIF( ops__build_path(&path, hot___noted[i]), NULL);
+		/* Without the "./". */
+		path+=2;
+
+		for(j=0; j<count; j++)
+			if (strcmp(list[j].path, path) == 0) break;
+
+		if (j == count)
+		{
+			memset(list+j, 0, sizeof(*list));
+			STOPIF( hlp__strdup( &list[j].path, path), NULL);
+			count++;
+		}
+
+		list[j].count++;
+		if (list[j].count > HOT___MAX_COUNT)
+			for(k=0; k<count; k++)
+				list[k].count = (list[k].count+1)/2;
+	}
+	hot___noted_count=0;
+
+	/* Find all entries in a single pass over the tree. */
+	qsort(list, count, sizeof(*list), hot___cmp_path);
+	for(i=0; i<count; i++)
+		list[i].sts=NULL;
+	STOPIF( hot___resolve(root, list, count, 0), NULL);
+
+	qsort(list, count, sizeof(*list), hot___cmp_count);
+
+	STOPIF( img__dir_stat(&dir_st), NULL);
+	STOPIF( waa__open_byext(wc_path, WAA__HOT_EXT, WAA__WRITE, &fh), NULL);
+
+	len=snprintf(buffer, sizeof(buffer), "%llu %llu %llu %llu %llu\n",
+			(t_ull)dir_st.st_dev, (t_ull)dir_st.st_ino,
+			(t_ull)dir_st.st_size,
+			(t_ull)dir_st.st_mtim.tv_sec, (t_ull)dir_st.st_mtim.tv_nsec);
+	STOPIF_CODE_ERR( write(fh, buffer, len) != len, errno,
+			"Cannot write the change statistics");
+
+	for(i=j=0; i<count && j<HOT___MAX_ENTRIES; i++)
+	{
+		/* Removed entries, and ones that are now directories, are dropped. */
+		sts=list[i].sts;
+		if (!sts || S_ISDIR(sts->st.mode)) continue;
+
+		len=snprintf(buffer, sizeof(buffer), "%u %o %llu %llu %llu %llu %llu "
+				"%llu %llu %llu %llu ",
+				list[i].count, sts->st.mode,
+				(t_ull)sts->st.uid, (t_ull)sts->st.gid, (t_ull)sts->st.size,
+				(t_ull)sts->st.dev, (t_ull)sts->st.ino,
+				(t_ull)sts->st.mtim.tv_sec, (t_ull)sts->st.mtim.tv_nsec,
+				(t_ull)sts->st.ctim.tv_sec, (t_ull)sts->st.ctim.tv_nsec);
+		STOPIF_CODE_ERR( write(fh, buffer, len) != len, errno,
+				"Cannot write the change statistics");
+
+		len=strlen(list[i].path)+1;
+		STOPIF_CODE_ERR( write(fh, list[i].path, len) != len ||
+				write(fh, "\n", 1) != 1, errno,
+				"Cannot write the change statistics");
+		j++;
+	}
+
+ex:
+	if (fh != -1)
+	{
+		i=waa__close(fh, status);
+		fh=-1;
+		STOPIF( i, "closing the change statistics");
+	}
+	if (list)
+	{
+		for(i=0; i<count; i++)
+			IF_FREE(list[i].path);
+		IF_FREE(list);
+	}
+	return status;
+}
+
+
+/** -.
+ * The current directory must be the working copy root.
+ *
+ * \a changed is only set if an entry is surely changed (as \ref status
+ * would show it); if a file might just have the same data again
+ * (only the \c ctime changed, with \ref o_chcheck "change_check" set to
+ * check the data), the normal run has to find out. */
+int hot__check(int *changed)
+{
+	int status, count, valid, i, chg;
+	struct hot___entry_t *list;
+	struct estat old;
+	struct sstat_t st;
+	char path[PATH_MAX];
+
+
+	status=0;
+	*changed=0;
+	STOPIF( hot___load(&list, &count, &valid), NULL);
+	if (!valid) goto ex;
+
+	memset(&old, 0, sizeof(old));
+	for(i=0; i<count && !*changed; i++)
+	{
+		snprintf(path, sizeof(path), ".%c%s", PATH_SEPARATOR, list[i].path);
+		if (hlp__lstat(path, &st))
+		{
+			DEBUGP("%s is removed", path);
+			*changed=1;
+			break;
+		}
+
+		old.st=list[i].st;
+		chg=ops__stat_to_action(&old, &st);
+		if ((chg & ~FS_LIKELY) ||
+				(chg && !(opt__get_int(OPT__CHANGECHECK) & CHCHECK_FILE)))
+		{
+			DEBUGP("%s is changed: 0x%X", path, chg);
+			*changed=1;
+		}
+	}
+
+	DEBUGP("checked %d hot entries: %d", i, *changed);
+
+ex:
+	if (list)
+	{
+		for(i=0; i<count; i++)
+			IF_FREE(list[i].path);
+		IF_FREE(list);
+	}
+	return status;
+}
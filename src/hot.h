@@ -0,0 +1,27 @@
+/************************************************************************
+ * Copyright (C) 2009 Philipp Marek.
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ ************************************************************************/
+
+#ifndef __HOT_H__
+#define __HOT_H__
+
+#include "global.h"
+
+/** \file
+ * Change frequency statistics header file. */
+
+/** Remembers that \a sts gets committed with changes. */
+int hot__note(struct estat *sts);
+/** Writes the \ref hot file, with the noted changes counted; \a root is
+ * the tree that was just written. */
+int hot__write(struct estat *root);
+/** Checks the most often changed entries; \a changed is set if one of
+ * them is changed now. */
+int hot__check(int *changed);
+
+#endif
+
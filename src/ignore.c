@@ -22,6 +22,7 @@
 #include "direnum.h"
 #include "ignore.h"
 #include "url.h"
+#include "snapshot.h"
 
 
 /** \file
@@ -329,6 +330,8 @@
  * <tt>auto-prop <i>property-name</i> <i>property-value</i></tt> can be 
  * given; \e property-name may not include whitespace, as there's no 
  * parsing of any quote characters yet.
+ * <li><tt>blockhash no</tt> (or the default, <tt>blockhash yes</tt>); see 
+ * \ref ign_blockhash.
  * </UL>
  *
  * An example:
@@ -342,6 +345,31 @@
  * \endcode
  *
  *
+ * \subsection ign_blockhash Block checksums
+ *
+ * For files bigger than a few kB \c FSVS stores the checksums of 
+ * variable-sized blocks (see \ref md5s); that allows a faster change 
+ * detection, but means an additional pass over the data on each commit 
+ * and update.
+ *
+ * For files that are known to change completely every time (compressed 
+ * media, archives, encrypted data) these block checksums are useless; with 
+ * <tt>blockhash no</tt> they are not calculated, and the files are 
+ * compared by their full MD5.
+ *
+ * This only changes what is stored locally; the data is sent to and 
+ * received from the repository as before.
+ *
+ * Like the auto-props this is remembered for the entry when it's added, 
+ * see \ref RF_NO_BLOCKHASH; changing the group definition later doesn't 
+ * change already versioned entries.
+ *
+ * \note The compression of the data sent to the repository can only be 
+ * chosen for a whole connection by subversion; use the \c http-compression 
+ * setting in the \c servers file of the subversion configuration for 
+ * that.
+ *
+ *
  * \section groups_format Specification of groups and patterns
  *
  * While an ignore pattern just needs the pattern itself (in one of the 
@@ -1302,14 +1330,13 @@ ex:
  * */
 int ign__load_list(char *dir)
 {
-	int status, fh, l;
-	struct stat st;
+	int status, l;
+	size_t len;
 	char *cp,*cp2;
 	int count;
 
 
-	fh=-1;
-	status=waa__open_byext(dir, WAA__IGNORE_EXT, WAA__READ, &fh);
+	status=snap__read_byext(dir, WAA__IGNORE_EXT, &memory, &len);
 	if (status == ENOENT)
 	{
 		DEBUGP("no ignore list found");
@@ -1318,21 +1345,9 @@ int ign__load_list(char *dir)
 	}
 	else STOPIF_CODE_ERR(status, status, "reading ignore list");
 
-	STOPIF_CODE_ERR( fstat(fh, &st), errno, NULL);
-
-	memory=(char*)mmap(NULL, st.st_size, 
-			PROT_READ, MAP_SHARED, 
-			fh, 0);
-	/* If there's an error, return it.
-	 * Always close the file. Check close() return code afterwards. */
-	status=errno;
-	l=close(fh);
-	STOPIF_CODE_ERR( memory == MAP_FAILED, status, "mmap failed");
-	STOPIF_CODE_ERR( l, errno, "close() failed");
-
 
 	/* make header \0 terminated */
-	cp=(char*)memchr(memory, '\n', st.st_size);
+	cp=(char*)memchr(memory, '\n', len);
 	if (!cp)
 	{
 		/* This means no entries.
@@ -1353,7 +1368,7 @@ int ign__load_list(char *dir)
 
 
 	/* fill the list */
-	cp2=memory+st.st_size;
+	cp2=memory+len;
 	for(l=0; l<count; l++)
 	{
 		STOPIF( ign__new_pattern(1, &cp, cp2, 1, PATTERN_POSITION_END), NULL);
@@ -1491,10 +1506,10 @@ int ign___load_group(struct ignore_t *ign)
 
 
 	DEBUGP("try specific group: %s", copy);
-	g_in=fopen(copy, "rt");
+	status=snap__fopen(copy, &g_in);
 	if (!g_in)
 	{
-		STOPIF_CODE_ERR(errno != ENOENT, errno,
+		STOPIF_CODE_ERR(status != ENOENT, status,
 				"!Cannot read group definition \"%s\"", copy);
 
 		/* This range is overlapping:
@@ -1508,8 +1523,8 @@ int ign___load_group(struct ignore_t *ign)
 				strlen(CONFIGDIR_GROUP) + 1 + gn_len + 1); /* ==strlen(eos)+1 */
 
 		DEBUGP("try for common: %s", copy);
-		g_in=fopen(copy, "rt");
-		STOPIF_CODE_ERR(!g_in && errno != ENOENT, errno,
+		status=snap__fopen(copy, &g_in);
+		STOPIF_CODE_ERR(!g_in && status != ENOENT, status,
 				"!Cannot read group definition \"%s\"", copy);
 	}
 
@@ -1552,6 +1567,21 @@ int ign___load_group(struct ignore_t *ign)
 			group->is_ignore=1;
 			continue;
 		}
+		else if (strcmp(conf_start, "blockhash") == 0)
+		{
+			cause="no blockhash value";
+			if (!eos) goto invalid;
+			eos=hlp__skip_ws(eos);
+			if (strcmp(eos, "no") == 0)
+				group->no_blockhash=1;
+			else if (strcmp(eos, "yes") == 0)
+				group->no_blockhash=0;
+			else
+			{
+				cause="invalid blockhash value";
+				goto invalid;
+			}
+		}
 		else if (strcmp(conf_start, "auto-prop") == 0)
 		{
 			cause="no property name";
@@ -31,8 +31,14 @@ struct grouping_t {
 	char *group_name;
 	apr_hash_t *auto_props;
 	struct url_t *url;
+	/** Key of the stored auto-properties in the \ref gprop database, 
+	 * once they were written in this run. */
+	char *prop_ref;
 	int is_ignore:1;
 	int is_take:1;
+	/** Set by <tt>blockhash no</tt>; new entries get \ref RF_NO_BLOCKHASH, 
+	 * see \ref ign_blockhash. */
+	int no_blockhash:1;
 };
 
 
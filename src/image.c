@@ -0,0 +1,573 @@
+/************************************************************************
+ * Copyright (C) 2009 Philipp Marek.
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ ************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "global.h"
+#include "waa.h"
+#include "url.h"
+#include "est_ops.h"
+#include "helper.h"
+#include "options.h"
+#include "image.h"
+
+
+/** \file
+ * Pointer-free image of the entries tree.
+ *
+ * Reading the \ref dir file means parsing each line, and allocating and
+ * linking a \c struct \c estat for every entry - even if the action only
+ * needs a few of them, or doesn't change anything.
+ *
+ * So, if the \ref o_tree_image option is set, a second file (see \ref
+ * tree) is written whenever the \ref dir file changes. It holds the same
+ * data in fixed-size records, with the names and the (by name sorted)
+ * children of each directory as offsets and indices instead of pointers;
+ * so it can simply be \c mmap()ed, and traversed without any allocation.
+ *
+ * The \ref dir file stays authoritative: the image records the device,
+ * inode, size and mtime of the \ref dir file it was built from, and isn't
+ * used if they don't match. Read-only users fall back to the \ref dir file
+ * then.
+ *
+ * Entries are only made into a \c struct \c estat when they're needed;
+ * img__promote() does that for a single path. Actions that change entries
+ * still read the whole tree. */
+
+
+/** Identifies the image format. */
+static const char img___magic[16]="FSVS image 2\n";
+
+/** Header of the \ref tree file. */
+struct img___header_t
+{
+	char magic[sizeof(img___magic)];
+	/** Number of records. */
+	uint32_t count;
+	/** Size of a record, as a simple compatibility check. */
+	uint32_t record_size;
+	/** The \ref dir file this image was built from. */
+	uint64_t dir_dev, dir_ino, dir_size, dir_mtime_sec, dir_mtime_nsec;
+	/** Offsets of the child index and the names, from the start of the
+	 * file. */
+	uint32_t children_off, names_off;
+};
+
+/** An entry in the \ref tree file.
+ * The records are in the order of the \ref dir file, so the root entry is
+ * the first one. */
+struct img___entry_t
+{
+	uint64_t size, dev, ino, rdev;
+	uint64_t ctime, mtime;
+	/** The entry ID, see \ref ids. */
+	uint64_t entry_id;
+	int64_t repos_rev;
+	uint32_t mode, uid, gid, flags;
+	/** The internal number of the URL, or \c 0. */
+	uint32_t url;
+	/** The line number of the parent, ie. its index+1; \c 0 for the root
+	 * entry. */
+	uint32_t parent;
+	/** Offset of the name, relative to the names. */
+	uint32_t name_off;
+	/** Index of the first child in the child index, and the number of
+	 * children. */
+	uint32_t children, child_count;
+	uint32_t padding;
+	md5_digest_t md5;
+};
+
+
+/** \name The mapped image.
+ * @{ */
+static char *img___map;
+static struct img___header_t *img___hdr;
+static struct img___entry_t *img___recs;
+static uint32_t *img___children;
+static char *img___names;
+/** \c 0 if not yet looked for, \c +1 if mapped, and \c -1 if not
+ * available. */
+static int img___state=0;
+/** @} */
+
+/** \name Data collected for writing.
+ * @{ */
+static struct img___entry_t *img___new;
+static unsigned img___new_count;
+static char *img___new_names;
+static size_t img___names_len, img___names_alloc;
+/** @} */
+
+
+/** -.
+ * */
+int img__dir_stat(struct stat *st)
+{
+	int status, fh;
+
+
+	fh=-1;
+	status=waa__open_dir(NULL, WAA__READ, &fh);
+	if (status == ENOENT) goto ex;
+	STOPIF(status, NULL);
+
+	STOPIF_CODE_ERR( fstat(fh, st) == -1, errno,
+			"Cannot get data of the entries file");
+
+ex:
+	if (fh != -1) close(fh);
+	return status;
+}
+
+
+/** Stores the entry \a sts, read from the \ref dir file.
+ * The root entry is line number \c 1. */
+static int img___collect(struct estat *sts, char *name,
+		unsigned line, unsigned parent)
+{
+	int status;
+	struct img___entry_t *rec;
+	size_t len;
+
+
+	status=0;
+	if (line == 1)
+	{
+		img___new_count=approx_entry_count;
+		STOPIF( hlp__calloc( &img___new, img___new_count,
+					sizeof(*img___new)), NULL);
+	}
+	BUG_ON(line > img___new_count);
+
+	len=strlen(name)+1;
+	if (img___names_len + len > img___names_alloc)
+	{
+		img___names_alloc = (img___names_alloc + len) * 2;
+		STOPIF( hlp__realloc( &img___new_names, img___names_alloc), NULL);
+	}
+	memcpy(img___new_names + img___names_len, name, len);
+
+	rec=img___new + line-1;
+	rec->name_off=img___names_len;
+	img___names_len += len;
+
+	rec->parent=parent;
+	if (parent)
+		img___new[parent-1].child_count++;
+
+	rec->mode=sts->st.mode;
+	rec->size=sts->st.size;
+	rec->dev=sts->st.dev;
+	rec->ino=sts->st.ino;
+	rec->rdev=sts->st.rdev;
+	rec->ctime=sts->st.ctim.tv_sec;
+	rec->mtime=sts->st.mtim.tv_sec;
+	rec->uid=sts->st.uid;
+	rec->gid=sts->st.gid;
+	rec->flags=sts->flags;
+	rec->entry_id=sts->entry_id;
+	rec->repos_rev=sts->repos_rev;
+	/* The root entry always gets the highest priority URL. */
+	rec->url= (parent && sts->url) ? sts->url->internal_number : 0;
+	/* For directories that's the entry count. */
+	if (!S_ISDIR(sts->st.mode))
+		memcpy(rec->md5, sts->md5, sizeof(rec->md5));
+
+ex:
+	return status;
+}
+
+
+/** Compares the names of two children, given by their index. */
+static int img___cmp_names(const void *a, const void *b)
+{
+	return strcmp(
+			img___new_names + img___new[ *(uint32_t*)a ].name_off,
+			img___new_names + img___new[ *(uint32_t*)b ].name_off);
+}
+
+
+/** Writes \a len bytes at \a data. */
+static int img___write(int fh, const void *data, size_t len)
+{
+	int status;
+
+
+	status=0;
+	STOPIF_CODE_ERR( write(fh, data, len) != (ssize_t)len, errno,
+			"Cannot write the tree image");
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * If the option is not set, an old image is removed. */
+int img__write(void)
+{
+	int status, fh, i;
+	unsigned child_count, parent;
+	struct img___header_t hdr;
+	uint32_t *children, *filled;
+	struct stat st;
+	size_t size;
+
+
+	fh=-1;
+	children=filled=NULL;
+	img___new=NULL;
+	img___new_names=NULL;
+	img___names_len=img___names_alloc=0;
+
+	if (opt__get_int(OPT__TREE_IMAGE) == OPT__NO)
+	{
+		STOPIF( waa__delete_byext(wc_path, WAA__TREE_IMAGE_EXT, 1), NULL);
+		goto ex;
+	}
+
+	status=img__dir_stat(&st);
+	if (status == ENOENT)
+	{
+		status=0;
+		goto ex;
+	}
+	STOPIF(status, NULL);
+
+	status=waa__stream_entries(img___collect);
+	if (status == -ENOENT)
+	{
+		status=0;
+		goto ex;
+	}
+	STOPIF(status, NULL);
+
+
+	/* Give each directory its range in the child index ... */
+	child_count=0;
+	for(i=0; i<(int)img___new_count; i++)
+	{
+		img___new[i].children=child_count;
+		child_count += img___new[i].child_count;
+	}
+
+	/* ... fill them ... */
+	STOPIF( hlp__calloc( &children, child_count+1, sizeof(*children)), NULL);
+	STOPIF( hlp__calloc( &filled, img___new_count, sizeof(*filled)), NULL);
+	for(i=1; i<(int)img___new_count; i++)
+	{
+		parent=img___new[i].parent-1;
+		children[ img___new[parent].children + filled[parent]++ ]=i;
+	}
+
+	/* ... and sort them by name, for the lookup. */
+	for(i=0; i<(int)img___new_count; i++)
+		if (img___new[i].child_count > 1)
+			qsort(children + img___new[i].children, img___new[i].child_count,
+					sizeof(*children), img___cmp_names);
+
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, img___magic, sizeof(hdr.magic));
+	hdr.count=img___new_count;
+	hdr.record_size=sizeof(*img___new);
+	hdr.dir_dev=st.st_dev;
+	hdr.dir_ino=st.st_ino;
+	hdr.dir_size=st.st_size;
+	hdr.dir_mtime_sec=st.st_mtim.tv_sec;
+	hdr.dir_mtime_nsec=st.st_mtim.tv_nsec;
+	hdr.children_off=sizeof(hdr) + img___new_count*sizeof(*img___new);
+	hdr.names_off=hdr.children_off + child_count*sizeof(*children);
+
+	size=(size_t)hdr.names_off + img___names_len;
+	STOPIF_CODE_ERR( size != (uint32_t)size, EFBIG,
+			"!The tree image would be too big.");
+
+	DEBUGP("writing tree image with %u entries", img___new_count);
+	STOPIF( waa__open_byext(wc_path, WAA__TREE_IMAGE_EXT, WAA__WRITE, &fh),
+			NULL);
+	STOPIF( img___write(fh, &hdr, sizeof(hdr)), NULL);
+	STOPIF( img___write(fh, img___new,
+				img___new_count*sizeof(*img___new)), NULL);
+	STOPIF( img___write(fh, children, child_count*sizeof(*children)), NULL);
+	STOPIF( img___write(fh, img___new_names, img___names_len), NULL);
+
+ex:
+	if (fh != -1)
+	{
+		i=waa__close(fh, status);
+		fh=-1;
+		STOPIF( i, "closing the tree image");
+	}
+	IF_FREE(img___new);
+	IF_FREE(img___new_names);
+	IF_FREE(children);
+	IF_FREE(filled);
+	return status;
+}
+
+
+/** -.
+ * The image is mapped only once. */
+int img__open(void)
+{
+	int status, fh;
+	unsigned i;
+	struct stat st, dir_st;
+	size_t length, child_count, names_len;
+	struct img___entry_t *rec;
+
+
+	status=0;
+	fh=-1;
+	if (img___state) goto done;
+	img___state=-1;
+
+	status=waa__open_byext(wc_path, WAA__TREE_IMAGE_EXT, WAA__READ, &fh);
+	if (status == ENOENT) goto done;
+	STOPIF(status, NULL);
+
+	STOPIF_CODE_ERR( fstat(fh, &st) == -1, errno,
+			"Cannot get length of the tree image");
+	length=st.st_size;
+	if (length < sizeof(*img___hdr)) goto invalid;
+
+	img___map=mmap(NULL, length, PROT_READ, MAP_SHARED, fh, 0);
+	STOPIF_CODE_ERR( img___map == MAP_FAILED, errno,
+			"Cannot map the tree image");
+
+	img___hdr=(struct img___header_t*)img___map;
+	if (memcmp(img___hdr->magic, img___magic, sizeof(img___magic)) != 0 ||
+			img___hdr->record_size != sizeof(*img___recs) ||
+			img___hdr->count == 0 ||
+			img___hdr->children_off != sizeof(*img___hdr) +
+			(size_t)img___hdr->count * sizeof(*img___recs) ||
+			img___hdr->names_off < img___hdr->children_off ||
+			img___hdr->names_off >= length ||
+			img___map[length-1] != 0)
+		goto invalid;
+
+	/* Only an image of the current entries file is valid. */
+	status=img__dir_stat(&dir_st);
+	if (status == ENOENT) goto invalid;
+	STOPIF(status, NULL);
+	if (img___hdr->dir_dev != (uint64_t)dir_st.st_dev ||
+			img___hdr->dir_ino != (uint64_t)dir_st.st_ino ||
+			img___hdr->dir_size != (uint64_t)dir_st.st_size ||
+			img___hdr->dir_mtime_sec != (uint64_t)dir_st.st_mtim.tv_sec ||
+			img___hdr->dir_mtime_nsec != (uint64_t)dir_st.st_mtim.tv_nsec)
+	{
+		DEBUGP("tree image is stale");
+		goto invalid;
+	}
+
+	img___recs=(struct img___entry_t*)(img___hdr+1);
+	img___children=(uint32_t*)(img___map + img___hdr->children_off);
+	img___names=img___map + img___hdr->names_off;
+	child_count=(img___hdr->names_off - img___hdr->children_off) /
+		sizeof(*img___children);
+	names_len=length - img___hdr->names_off;
+
+	/* Check the offsets once, so that they can be used directly. */
+	for(i=0; i<img___hdr->count; i++)
+	{
+		rec=img___recs+i;
+		if (rec->parent > i || (i == 0) != (rec->parent == 0) ||
+				rec->name_off >= names_len ||
+				rec->children + (size_t)rec->child_count > child_count)
+			goto invalid;
+	}
+	for(i=0; i<child_count; i++)
+		if (img___children[i] == 0 || img___children[i] >= img___hdr->count)
+			goto invalid;
+
+	/* For progress display */
+	approx_entry_count=img___hdr->count;
+	img___state=+1;
+	DEBUGP("tree image with %u entries mapped", img___hdr->count);
+
+done:
+	status= img___state > 0 ? 0 : ENOENT;
+
+ex:
+	if (fh != -1) close(fh);
+	return status;
+
+invalid:
+	DEBUGP("tree image invalid, ignored");
+	if (img___map && img___map != MAP_FAILED)
+		munmap(img___map, length);
+	img___map=NULL;
+	goto done;
+}
+
+
+/** Fills \a sts with the data of the record \a index.
+ * The name is taken from the mapped image, and must not be changed. */
+static int img___to_estat(uint32_t index, struct estat *sts)
+{
+	int status;
+	struct img___entry_t *rec;
+
+
+	status=0;
+	rec=img___recs+index;
+	memset(sts, 0, sizeof(*sts));
+
+	sts->name=img___names + rec->name_off;
+	sts->st.mode=rec->mode;
+	sts->old_rev_mode_packed =
+		sts->new_rev_mode_packed =
+		sts->local_mode_packed = MODE_T_to_PACKED(sts->st.mode);
+	sts->st.size=rec->size;
+	sts->st.dev=rec->dev;
+	sts->st.ino=rec->ino;
+	sts->st.rdev=rec->rdev;
+	sts->st.ctim.tv_sec=rec->ctime;
+	sts->st.mtim.tv_sec=rec->mtime;
+	sts->st.uid=rec->uid;
+	sts->st.gid=rec->gid;
+	sts->flags=rec->flags;
+	sts->entry_id=rec->entry_id;
+	sts->old_rev=sts->repos_rev=rec->repos_rev;
+
+	if (S_ISDIR(sts->st.mode))
+		sts->entry_count=rec->child_count;
+	else
+		memcpy(sts->md5, rec->md5, sizeof(sts->md5));
+
+	/* Same as in ops__load_1entry(). */
+	if (rec->parent)
+	{
+		if (rec->url)
+			STOPIF( url__find_by_intnum(rec->url, &(sts->url)), NULL);
+	}
+	else
+		sts->url= urllist_count ? urllist[urllist_count-1] : NULL;
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * As for waa__stream_entries(), the \c struct \c estat is only valid
+ * during the \a callback.
+ *
+ * Returns \c ENOENT silently if there's no (current) image. */
+int img__stream_entries(waa__stream_t *callback)
+{
+	int status;
+	uint32_t i;
+	struct estat sts;
+
+
+	status=img__open();
+	if (status == ENOENT) goto ex;
+	STOPIF(status, NULL);
+
+	for(i=0; i<img___hdr->count; i++)
+	{
+		STOPIF( img___to_estat(i, &sts), NULL);
+		STOPIF( callback(&sts, sts.name, i+1, img___recs[i].parent), NULL);
+	}
+
+ex:
+	return status;
+}
+
+
+/** Finds the child named \a name of the record \a dir. */
+static int img___find_child(uint32_t dir, const char *name,
+		uint32_t *index)
+{
+	struct img___entry_t *rec;
+	uint32_t *children;
+	int low, high, mid, cmp;
+
+
+	rec=img___recs+dir;
+	children=img___children + rec->children;
+	low=0;
+	high=rec->child_count-1;
+	while (low <= high)
+	{
+		mid=(low+high)/2;
+		cmp=strcmp(name, img___names + img___recs[ children[mid] ].name_off);
+		if (cmp == 0)
+		{
+			*index=children[mid];
+			return 0;
+		}
+
+		if (cmp < 0) high=mid-1;
+		else low=mid+1;
+	}
+
+	return ENOENT;
+}
+
+
+/** -.
+ * \a root is filled from the image; for the entry and each of its parent
+ * directories a \c struct \c estat is allocated, and linked via
+ * estat::parent. \n
+ * The children lists of these directories are \b not filled, so this is
+ * only usable for actions that need some data of single entries (and
+ * their path).
+ *
+ * Returns \c ENOENT silently if there's no (current) image, or if \a path
+ * is not in it; the caller should use img__open() to tell these cases
+ * apart. */
+int img__promote(struct estat *root, const char *path, struct estat **sts)
+{
+	int status;
+	uint32_t index;
+	struct estat *parent, *cur;
+	char *copy, *part, *next;
+
+
+	copy=NULL;
+	status=img__open();
+	if (status == ENOENT) goto ex;
+	STOPIF(status, NULL);
+
+	STOPIF( img___to_estat(0, root), NULL);
+
+	STOPIF( hlp__strdup( &copy, path), NULL);
+	index=0;
+	parent=root;
+	for(part=copy; part; part=next)
+	{
+		next=strchr(part, PATH_SEPARATOR);
+		if (next) *(next++)=0;
+
+		if (!*part || strcmp(part, ".") == 0) continue;
+
+		status=img___find_child(index, part, &index);
+		if (status == ENOENT) goto ex;
+
+		STOPIF( ops__allocate(1, &cur, NULL), NULL);
+		STOPIF( img___to_estat(index, cur), NULL);
+		cur->parent=parent;
+		parent=cur;
+	}
+
+	*sts=parent;
+	status=0;
+
+ex:
+	IF_FREE(copy);
+	return status;
+}
+
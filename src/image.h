@@ -0,0 +1,35 @@
+/************************************************************************
+ * Copyright (C) 2009 Philipp Marek.
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ ************************************************************************/
+
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+
+#include "global.h"
+#include "waa.h"
+
+/** \file
+ * Pointer-free tree image header file. */
+
+/** Writes the \ref tree image from the current \ref dir file, if the \ref
+ * o_tree_image option says so. */
+int img__write(void);
+/** Maps the \ref tree image; \c ENOENT if there's none, or if it's
+ * stale. */
+int img__open(void);
+/** Calls \a callback for every entry in the image, like
+ * waa__stream_entries(). */
+int img__stream_entries(waa__stream_t *callback);
+/** Returns the entry for the wc-relative \a path as a \c struct \c estat,
+ * along with its parents. */
+int img__promote(struct estat *root, const char *path, struct estat **sts);
+/** Gets the data of the current \ref dir file, to identify it; \c 
+ * ENOENT if there's none. */
+int img__dir_stat(struct stat *st);
+
+#endif
+
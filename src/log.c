@@ -66,6 +66,7 @@
 #include "update.h"
 #include "racallback.h"
 #include "helper.h"
+#include "image.h"
 
 
 #define MAX_LOG_OUTPUT_LINE (1024)
@@ -283,7 +284,7 @@ int log__work(struct estat *root, int argc, char *argv[])
 	svn_error_t *status_svn;
 	char *path;
 	apr_array_header_t *paths;
-	int limit;
+	int limit, have_image;
 	char **normalized;
 	const char *base_url;
 
@@ -300,13 +301,23 @@ int log__work(struct estat *root, int argc, char *argv[])
 
 	STOPIF( waa__find_common_base( argc, argv, &normalized), NULL);
 	STOPIF( url__load_nonempty_list(NULL, 0), NULL);
-	STOPIF( waa__input_tree(root, NULL, NULL), NULL);
+
+	/* Only the URL and the path of a single entry are needed; with a tree 
+	 * image just these get read. */
+	status=img__open();
+	have_image= (status == 0);
+	if (status == ENOENT)
+		STOPIF( waa__input_tree(root, NULL, NULL), NULL);
+	else
+		STOPIF( status, NULL);
 
 	if (argc)
 	{
 		STOPIF_CODE_ERR( argc>1, EINVAL,
 				"!The \"log\" command currently handles only a single path.");
-		STOPIF( ops__traverse(root, normalized[0], 0, 0, &sts), 
+		STOPIF( have_image ? 
+				img__promote(root, normalized[0], &sts) :
+				ops__traverse(root, normalized[0], 0, 0, &sts), 
 				"!The entry \"%s\" cannot be found.", normalized[0]);
 
 		log___path_parm_len=strlen(argv[0]);
@@ -318,6 +329,8 @@ int log__work(struct estat *root, int argc, char *argv[])
 		log___path_parm_len=0;
 		log___path_parm="";
 		sts=root;
+		if (have_image)
+			STOPIF( img__promote(root, ".", &sts), NULL);
 	}
 
 	current_url=NULL;
@@ -0,0 +1,164 @@
+/************************************************************************
+ * Copyright (C) 2009 Philipp Marek.
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ ************************************************************************/
+
+/** \file
+ * \ref manifest action.
+ *
+ * Prints the stored data of all entries, straight from the \ref dir file. */
+
+/** \addtogroup cmds
+ *
+ * \section manifest
+ *
+ * \code
+ * fsvs manifest [working copy base]
+ * \endcode
+ *
+ * This command prints the data stored for each versioned entry, as it was 
+ * known at the last commit or update; that is useful for an inventory of 
+ * many machines, which can be compared centrally.
+ *
+ * Neither the filesystem nor the repository is looked at; only the 
+ * entries list is read, without building a tree in memory, so this is 
+ * fast even for big working copies. With \ref o_tree_image the list 
+ * needn't even be parsed.
+ *
+ * Each entry is printed as a record terminated by a \c NUL character, with 
+ * the fields separated by a space:
+ * - the type, as in \ref info (\c file, \c directory, \c symlink, ...),
+ * - the permission bits in octal,
+ * - owner and group, numerically,
+ * - the size,
+ * - the modification time, in seconds since the epoch,
+ * - the MD5 (or \c - for directories and devices),
+ * - and the path, relative to the working copy base.
+ *
+ * As the path is the last field, it may contain any characters but \c NUL.
+ *
+ * Example:
+ * \code
+ *     $ fsvs manifest /etc | tr '\0' '\n'
+ *     directory 0755 0 0 4096 1244025013 - .
+ *     file 0644 0 0 1298 1243862730 3ac5fd5e4b0a2af6bb43bbd34d2e4d06 ./passwd
+ *     ...
+ * \endcode */
+
+
+#include "global.h"
+#include "waa.h"
+#include "url.h"
+#include "helper.h"
+#include "checksum.h"
+#include "status.h"
+#include "image.h"
+#include "manifest.h"
+
+
+/** Offsets of the directory paths in \c man___paths, by line number. */
+static size_t *man___path_off;
+/** The paths of all directories. */
+static char *man___paths;
+/** How many bytes of \c man___paths are used, and allocated. */
+static size_t man___paths_len, man___paths_alloc;
+
+
+/** Prints a single entry.
+ * Only the paths of directories are kept, as they're needed for their 
+ * children. */
+static int man___entry(struct estat *sts, char *name, 
+		unsigned line, unsigned parent)
+{
+	int status;
+	char *path;
+	size_t len, parent_len;
+
+
+	status=0;
+	if (line == 1)
+		STOPIF( hlp__calloc( &man___path_off, approx_entry_count+1, 
+					sizeof(*man___path_off)), NULL);
+	BUG_ON(line > approx_entry_count);
+
+	if (parent)
+		parent_len=strlen(man___paths + man___path_off[parent]);
+	else
+	{
+		/* The root entry. */
+		parent_len=0;
+		name=".";
+	}
+
+	len=parent_len + 1 + strlen(name) + 1;
+	if (man___paths_len + len > man___paths_alloc)
+	{
+		man___paths_alloc = (man___paths_alloc + len) * 2;
+		STOPIF( hlp__realloc( &man___paths, man___paths_alloc), NULL);
+	}
+
+	/* The path is built at the end of the buffer; for directories it's 
+	 * kept there. */
+	path=man___paths + man___paths_len;
+	if (parent)
+	{
+		memcpy(path, man___paths + man___path_off[parent], parent_len);
+		path[parent_len]=PATH_SEPARATOR;
+		strcpy(path+parent_len+1, name);
+	}
+	else
+		strcpy(path, name);
+
+	if (S_ISDIR(sts->st.mode))
+	{
+		man___path_off[line]=man___paths_len;
+		man___paths_len += len;
+	}
+
+	STOPIF_CODE_EPIPE( printf("%s %04o %u %u %llu %llu %s %s%c",
+				st__type_string(sts->st.mode),
+				(unsigned)(sts->st.mode & 07777),
+				(unsigned)sts->st.uid, (unsigned)sts->st.gid,
+				(t_ull)sts->st.size, (t_ull)sts->st.mtim.tv_sec,
+				S_ISREG(sts->st.mode) || S_ISLNK(sts->st.mode) ?
+				cs__md5tohex_buffered(sts->md5) : "-",
+				path, 0), NULL);
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * */
+int man__work(struct estat *root, int argc, char *argv[])
+{
+	int status;
+
+
+	STOPIF( waa__find_base(root, &argc, &argv), NULL);
+	STOPIF( url__load_list(NULL, 0), NULL);
+
+	/* The offset array is allocated on the first entry, as only then the 
+	 * number of entries is known. */
+	man___path_off=NULL;
+	man___paths=NULL;
+	man___paths_len=man___paths_alloc=0;
+
+	/* Prefer the tree image, if there's a current one. */
+	status=img__stream_entries(man___entry);
+	if (status == ENOENT)
+		status=waa__stream_entries(man___entry);
+	STOPIF_CODE_ERR( status == -ENOENT, ENOENT, 
+			"!No tree information available. Did you commit?");
+	STOPIF( status, NULL);
+
+ex:
+	IF_FREE(man___path_off);
+	IF_FREE(man___paths);
+	return status;
+}
+
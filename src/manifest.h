@@ -0,0 +1,21 @@
+/************************************************************************
+ * Copyright (C) 2009 Philipp Marek.
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ ************************************************************************/
+
+#ifndef __MANIFEST_H__
+#define __MANIFEST_H__
+
+#include "actions.h"
+
+/** \file
+ * \ref manifest command header file. */
+
+/** The \ref manifest action. */
+work_t man__work;
+
+#endif
+
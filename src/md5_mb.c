@@ -0,0 +1,296 @@
+/************************************************************************
+ * Copyright (C) 2009 Philipp Marek.
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ ************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "md5_mb.h"
+
+
+/** \file
+ * Multi-buffer MD5, for hashing many small files at once.
+ *
+ * MD5 is serial within a stream; but many small files are independent
+ * streams, so \ref MD5_MB__LANES of them are run side by side, with each
+ * 32bit word of the state as an array over the lanes.
+ * Every step of the compression function is then a short loop over the
+ * lanes, which the compiler turns into vector instructions.
+ *
+ * On x86-64 the compression function is built for AVX-512, AVX2 and the
+ * baseline SSE2, and the best variant for the CPU is chosen at runtime;
+ * elsewhere the plain C loops are used, which are still correct (just
+ * not faster than the single-stream MD5).
+ *
+ * As in the ISA-L \c md5_mb job manager, a lane that finishes its buffer
+ * gets the next one at once, so buffers of different length don't waste
+ * much. */
+
+
+#if defined(__x86_64__) && defined(__GNUC__) && defined(__linux__) && \
+	(__GNUC__ >= 6 || defined(__clang__))
+#define MD5_MB___CLONES \
+	__attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define MD5_MB___CLONES
+#endif
+
+
+/** The lane-sliced state, ie. \c [a,b,c,d][lane]. */
+typedef uint32_t md5_mb___state_t[4][MD5_MB__LANES];
+/** The lane-sliced message block, ie. \c [word][lane]. */
+typedef uint32_t md5_mb___block_t[16][MD5_MB__LANES];
+
+
+/** The state of a lane. */
+struct md5_mb___lane_t
+{
+	/** Index of the buffer, or \c -1 if the lane is idle. */
+	int job;
+	/** The next full block of data. */
+	const unsigned char *next;
+	/** How many full blocks are left in the data. */
+	size_t full_blocks;
+	/** How many blocks are left in \c tail. */
+	int tail_blocks;
+	/** Position of the next block in \c tail. */
+	int tail_pos;
+	/** The rest of the data, with the padding and length. */
+	unsigned char tail[128];
+};
+
+
+#define MD5_MB___F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_MB___G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_MB___H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_MB___I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define MD5_MB___ROTL(x, s) (((x) << (s)) | ((x) >> (32-(s))))
+
+#define MD5_MB___STEP(f, a, b, c, d, k, t, s) \
+	for(l=0; l<MD5_MB__LANES; l++) \
+	{ \
+		a[l] += f(b[l], c[l], d[l]) + w[k][l] + (uint32_t)(t); \
+		a[l] = b[l] + MD5_MB___ROTL(a[l], s); \
+	}
+
+
+/** Runs the MD5 compression function for one block in every lane. */
+MD5_MB___CLONES
+static void md5_mb___blocks(md5_mb___state_t st, const md5_mb___block_t w)
+{
+	uint32_t a[MD5_MB__LANES], b[MD5_MB__LANES],
+					 c[MD5_MB__LANES], d[MD5_MB__LANES];
+	int l;
+
+
+	for(l=0; l<MD5_MB__LANES; l++)
+	{
+		a[l]=st[0][l];
+		b[l]=st[1][l];
+		c[l]=st[2][l];
+		d[l]=st[3][l];
+	}
+
+	MD5_MB___STEP(MD5_MB___F, a, b, c, d,  0, 0xd76aa478,  7);
+	MD5_MB___STEP(MD5_MB___F, d, a, b, c,  1, 0xe8c7b756, 12);
+	MD5_MB___STEP(MD5_MB___F, c, d, a, b,  2, 0x242070db, 17);
+	MD5_MB___STEP(MD5_MB___F, b, c, d, a,  3, 0xc1bdceee, 22);
+	MD5_MB___STEP(MD5_MB___F, a, b, c, d,  4, 0xf57c0faf,  7);
+	MD5_MB___STEP(MD5_MB___F, d, a, b, c,  5, 0x4787c62a, 12);
+	MD5_MB___STEP(MD5_MB___F, c, d, a, b,  6, 0xa8304613, 17);
+	MD5_MB___STEP(MD5_MB___F, b, c, d, a,  7, 0xfd469501, 22);
+	MD5_MB___STEP(MD5_MB___F, a, b, c, d,  8, 0x698098d8,  7);
+	MD5_MB___STEP(MD5_MB___F, d, a, b, c,  9, 0x8b44f7af, 12);
+	MD5_MB___STEP(MD5_MB___F, c, d, a, b, 10, 0xffff5bb1, 17);
+	MD5_MB___STEP(MD5_MB___F, b, c, d, a, 11, 0x895cd7be, 22);
+	MD5_MB___STEP(MD5_MB___F, a, b, c, d, 12, 0x6b901122,  7);
+	MD5_MB___STEP(MD5_MB___F, d, a, b, c, 13, 0xfd987193, 12);
+	MD5_MB___STEP(MD5_MB___F, c, d, a, b, 14, 0xa679438e, 17);
+	MD5_MB___STEP(MD5_MB___F, b, c, d, a, 15, 0x49b40821, 22);
+
+	MD5_MB___STEP(MD5_MB___G, a, b, c, d,  1, 0xf61e2562,  5);
+	MD5_MB___STEP(MD5_MB___G, d, a, b, c,  6, 0xc040b340,  9);
+	MD5_MB___STEP(MD5_MB___G, c, d, a, b, 11, 0x265e5a51, 14);
+	MD5_MB___STEP(MD5_MB___G, b, c, d, a,  0, 0xe9b6c7aa, 20);
+	MD5_MB___STEP(MD5_MB___G, a, b, c, d,  5, 0xd62f105d,  5);
+	MD5_MB___STEP(MD5_MB___G, d, a, b, c, 10, 0x02441453,  9);
+	MD5_MB___STEP(MD5_MB___G, c, d, a, b, 15, 0xd8a1e681, 14);
+	MD5_MB___STEP(MD5_MB___G, b, c, d, a,  4, 0xe7d3fbc8, 20);
+	MD5_MB___STEP(MD5_MB___G, a, b, c, d,  9, 0x21e1cde6,  5);
+	MD5_MB___STEP(MD5_MB___G, d, a, b, c, 14, 0xc33707d6,  9);
+	MD5_MB___STEP(MD5_MB___G, c, d, a, b,  3, 0xf4d50d87, 14);
+	MD5_MB___STEP(MD5_MB___G, b, c, d, a,  8, 0x455a14ed, 20);
+	MD5_MB___STEP(MD5_MB___G, a, b, c, d, 13, 0xa9e3e905,  5);
+	MD5_MB___STEP(MD5_MB___G, d, a, b, c,  2, 0xfcefa3f8,  9);
+	MD5_MB___STEP(MD5_MB___G, c, d, a, b,  7, 0x676f02d9, 14);
+	MD5_MB___STEP(MD5_MB___G, b, c, d, a, 12, 0x8d2a4c8a, 20);
+
+	MD5_MB___STEP(MD5_MB___H, a, b, c, d,  5, 0xfffa3942,  4);
+	MD5_MB___STEP(MD5_MB___H, d, a, b, c,  8, 0x8771f681, 11);
+	MD5_MB___STEP(MD5_MB___H, c, d, a, b, 11, 0x6d9d6122, 16);
+	MD5_MB___STEP(MD5_MB___H, b, c, d, a, 14, 0xfde5380c, 23);
+	MD5_MB___STEP(MD5_MB___H, a, b, c, d,  1, 0xa4beea44,  4);
+	MD5_MB___STEP(MD5_MB___H, d, a, b, c,  4, 0x4bdecfa9, 11);
+	MD5_MB___STEP(MD5_MB___H, c, d, a, b,  7, 0xf6bb4b60, 16);
+	MD5_MB___STEP(MD5_MB___H, b, c, d, a, 10, 0xbebfbc70, 23);
+	MD5_MB___STEP(MD5_MB___H, a, b, c, d, 13, 0x289b7ec6,  4);
+	MD5_MB___STEP(MD5_MB___H, d, a, b, c,  0, 0xeaa127fa, 11);
+	MD5_MB___STEP(MD5_MB___H, c, d, a, b,  3, 0xd4ef3085, 16);
+	MD5_MB___STEP(MD5_MB___H, b, c, d, a,  6, 0x04881d05, 23);
+	MD5_MB___STEP(MD5_MB___H, a, b, c, d,  9, 0xd9d4d039,  4);
+	MD5_MB___STEP(MD5_MB___H, d, a, b, c, 12, 0xe6db99e5, 11);
+	MD5_MB___STEP(MD5_MB___H, c, d, a, b, 15, 0x1fa27cf8, 16);
+	MD5_MB___STEP(MD5_MB___H, b, c, d, a,  2, 0xc4ac5665, 23);
+
+	MD5_MB___STEP(MD5_MB___I, a, b, c, d,  0, 0xf4292244,  6);
+	MD5_MB___STEP(MD5_MB___I, d, a, b, c,  7, 0x432aff97, 10);
+	MD5_MB___STEP(MD5_MB___I, c, d, a, b, 14, 0xab9423a7, 15);
+	MD5_MB___STEP(MD5_MB___I, b, c, d, a,  5, 0xfc93a039, 21);
+	MD5_MB___STEP(MD5_MB___I, a, b, c, d, 12, 0x655b59c3,  6);
+	MD5_MB___STEP(MD5_MB___I, d, a, b, c,  3, 0x8f0ccc92, 10);
+	MD5_MB___STEP(MD5_MB___I, c, d, a, b, 10, 0xffeff47d, 15);
+	MD5_MB___STEP(MD5_MB___I, b, c, d, a,  1, 0x85845dd1, 21);
+	MD5_MB___STEP(MD5_MB___I, a, b, c, d,  8, 0x6fa87e4f,  6);
+	MD5_MB___STEP(MD5_MB___I, d, a, b, c, 15, 0xfe2ce6e0, 10);
+	MD5_MB___STEP(MD5_MB___I, c, d, a, b,  6, 0xa3014314, 15);
+	MD5_MB___STEP(MD5_MB___I, b, c, d, a, 13, 0x4e0811a1, 21);
+	MD5_MB___STEP(MD5_MB___I, a, b, c, d,  4, 0xf7537e82,  6);
+	MD5_MB___STEP(MD5_MB___I, d, a, b, c, 11, 0xbd3af235, 10);
+	MD5_MB___STEP(MD5_MB___I, c, d, a, b,  2, 0x2ad7d2bb, 15);
+	MD5_MB___STEP(MD5_MB___I, b, c, d, a,  9, 0xeb86d391, 21);
+
+	for(l=0; l<MD5_MB__LANES; l++)
+	{
+		st[0][l]+=a[l];
+		st[1][l]+=b[l];
+		st[2][l]+=c[l];
+		st[3][l]+=d[l];
+	}
+}
+
+
+/** Starts buffer \a job in \a lane.
+ * The data after the last full block gets copied into
+ * md5_mb___lane_t::tail, with the padding and the bit length. */
+static void md5_mb___start(struct md5_mb___lane_t *lane, int job,
+		const unsigned char *data, size_t len)
+{
+	size_t rest;
+	uint64_t bits;
+	int i, tail_len;
+
+
+	lane->job=job;
+	lane->next=data;
+	lane->full_blocks=len / 64;
+
+	rest=len % 64;
+	if (rest)
+		memcpy(lane->tail, data + len - rest, rest);
+	lane->tail[rest]=0x80;
+	/* The length needs 8 bytes after the 0x80. */
+	tail_len= rest < 56 ? 64 : 128;
+	memset(lane->tail + rest + 1, 0, tail_len - rest - 1 - 8);
+
+	bits=(uint64_t)len * 8;
+	for(i=0; i<8; i++)
+		lane->tail[tail_len - 8 + i] = (unsigned char)(bits >> (8*i));
+
+	lane->tail_blocks=tail_len / 64;
+	lane->tail_pos=0;
+}
+
+
+/** -.
+ * Buffers are given to the lanes in order; the digests are the same as
+ * from a single-stream MD5. */
+void md5_mb__hash(int count,
+		const unsigned char *const data[], const size_t len[],
+		unsigned char digest[][16])
+{
+	static const uint32_t iv[4]= {
+		0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+	static const unsigned char idle_block[64];
+	struct md5_mb___lane_t lanes[MD5_MB__LANES];
+	md5_mb___state_t st;
+	md5_mb___block_t w;
+	const unsigned char *block;
+	int l, i, k, next_job, active;
+
+
+	next_job=0;
+	active=0;
+	for(l=0; l<MD5_MB__LANES; l++)
+	{
+		for(k=0; k<4; k++) st[k][l]=iv[k];
+
+		if (next_job < count)
+		{
+			md5_mb___start(lanes+l, next_job, data[next_job], len[next_job]);
+			next_job++;
+			active++;
+		}
+		else
+			lanes[l].job=-1;
+	}
+
+	while (active)
+	{
+		/* Transpose the next block of every lane. */
+		for(l=0; l<MD5_MB__LANES; l++)
+		{
+			if (lanes[l].job == -1)
+				block=idle_block;
+			else if (lanes[l].full_blocks)
+				block=lanes[l].next;
+			else
+				block=lanes[l].tail + lanes[l].tail_pos;
+
+			for(i=0; i<16; i++)
+				w[i][l]= (uint32_t)block[4*i] |
+					((uint32_t)block[4*i+1] << 8) |
+					((uint32_t)block[4*i+2] << 16) |
+					((uint32_t)block[4*i+3] << 24);
+		}
+
+		md5_mb___blocks(st, (const uint32_t (*)[MD5_MB__LANES])w);
+
+		for(l=0; l<MD5_MB__LANES; l++)
+		{
+			if (lanes[l].job == -1) continue;
+
+			if (lanes[l].full_blocks)
+			{
+				lanes[l].full_blocks--;
+				lanes[l].next+=64;
+				continue;
+			}
+
+			lanes[l].tail_pos+=64;
+			if (--lanes[l].tail_blocks) continue;
+
+			/* Finished. */
+			for(k=0; k<4; k++)
+			{
+				for(i=0; i<4; i++)
+					digest[lanes[l].job][4*k+i] = (unsigned char)(st[k][l] >> (8*i));
+				st[k][l]=iv[k];
+			}
+
+			if (next_job < count)
+			{
+				md5_mb___start(lanes+l, next_job, data[next_job], len[next_job]);
+				next_job++;
+			}
+			else
+			{
+				lanes[l].job=-1;
+				active--;
+			}
+		}
+	}
+}
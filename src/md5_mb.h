@@ -0,0 +1,34 @@
+/************************************************************************
+ * Copyright (C) 2009 Philipp Marek.
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ ************************************************************************/
+
+#ifndef __MD5_MB_H__
+#define __MD5_MB_H__
+
+#include <stddef.h>
+
+/** \file
+ * Multi-buffer MD5 header file.
+ *
+ * This doesn't include global.h, so that the benchmark in \c tools/ can be
+ * built without the other libraries. */
+
+/** How many streams are hashed side by side.
+ * 16 lanes fill a single AVX-512 register, two AVX2 or four SSE2 ones. */
+#define MD5_MB__LANES (16)
+
+/** Below that many buffers the single-stream MD5 is faster. */
+#define MD5_MB__MIN_BATCH (4)
+
+/** Calculates the MD5 digests of \a count independent buffers at once.
+ * \a data and \a len describe the buffers; \a digest gets the results
+ * (16 bytes each). */
+void md5_mb__hash(int count,
+		const unsigned char *const data[], const size_t len[],
+		unsigned char digest[][16]);
+
+#endif
@@ -14,6 +14,7 @@
 #include "options.h"
 #include "helper.h"
 #include "warnings.h"
+#include "snapshot.h"
 
 
 /** \file
@@ -157,6 +158,15 @@ const struct opt___val_str_t opt___delay_strings[]= {
 };
 
 
+/** Hashing order.
+ * See \ref o_hash_order. */
+const struct opt___val_str_t opt___hash_order_strings[]= {
+	{ .val=HASH_ORDER_TREE,				.string="tree" },
+	{ .val=HASH_ORDER_DISK,				.string="disk" },
+	{ .string=NULL, }
+};
+
+
 /** Conflict resolution options.
  * See \ref o_conflict. */
 const struct opt___val_str_t opt___conflict_strings[]= {
@@ -248,6 +258,15 @@ struct opt__list_t opt__list[OPT__COUNT]=
 		.name="group_stats", .i_val=OPT__NO,
 		.parse=opt___string2val, .parm=opt___yes_no,
 	},
+	[OPT__WC_LIST] = {
+		.name="wc_list", .cp_val=NULL, .parse=opt___store_string,
+	},
+	[OPT__WC_LIST_JOBS] = {
+		.name="wc_list_jobs", .i_val=1, .parse=opt___atoi,
+	},
+	[OPT__PROGRESS_FILE] = {
+		.name="progress_file", .cp_val=NULL, .parse=opt___store_string,
+	},
 
 	[OPT__CONFLICT] = {
 		.name="conflict", .i_val=CONFLICT_MERGE,
@@ -326,6 +345,48 @@ struct opt__list_t opt__list[OPT__COUNT]=
 		.name="copyfrom_exp", .i_val=OPT__YES,
 		.parse=opt___string2val, .parm=opt___yes_no,
 	},
+	[OPT__HASH_ORDER] = {
+		.name="hash_order", .i_val=HASH_ORDER_TREE,
+		.parse=opt___string2val, .parm=opt___hash_order_strings,
+	},
+	[OPT__VERIFY_JOBS] = {
+		.name="verify_jobs", .i_val=1, .parse=opt___atoi,
+	},
+	[OPT__TREE_IMAGE] = {
+		.name="tree_image", .i_val=OPT__NO,
+		.parse=opt___string2val, .parm=opt___yes_no,
+	},
+	[OPT__COMMIT_LOCAL] = {
+		.name="commit_local", .i_val=OPT__NO,
+		.parse=opt___string2val, .parm=opt___yes_no,
+	},
+	[OPT__PUSH_RETRIES] = {
+		.name="push_retries", .i_val=5, .parse=opt___atoi,
+	},
+	[OPT__COMMIT_VIA_DUMP] = {
+		.name="commit_via_dump", .i_val=OPT__NO,
+		.parse=opt___string2val, .parm=opt___yes_no,
+	},
+	[OPT__IO_LIMIT] = {
+		.name="io_limit", .i_val=0, .parse=opt___atoi,
+	},
+	[OPT__CPU_LIMIT] = {
+		.name="cpu_limit", .i_val=100, .parse=opt___atoi,
+	},
+	[OPT__LIMIT_FILE] = {
+		.name="limit_file", .cp_val=NULL, .parse=opt___store_string,
+	},
+	[OPT__DEADLINE] = {
+		.name="deadline", .i_val=0, .parse=opt___atoi,
+	},
+	[OPT__DEADLINE_RESUME] = {
+		.name="deadline_resume", .i_val=OPT__NO,
+		.parse=opt___string2val, .parm=opt___yes_no,
+	},
+	[OPT__HOT_FIRST] = {
+		.name="hot_first", .i_val=OPT__NO,
+		.parse=opt___string2val, .parm=opt___yes_no,
+	},
 };
 
 
@@ -613,18 +674,15 @@ int opt__load_settings(char *path, char *name, enum opt__prio_e prio)
 
 	DEBUGP("reading settings from %s, with prio %d", 
 			fn, prio);
-	fp=fopen(fn, "rt");
-	if (!fp)
+	/* Known files are taken from the snapshot. */
+	status=snap__fopen(fn, &fp);
+	if (status == ENOENT)
 	{
-		status=errno;
-		if (status == ENOENT)
-		{
-			/* Ignore that. */
-			status=0;
-			goto ex;
-		}
-		STOPIF( status, "Open file '%s'", fn);
+		/* Ignore that. */
+		status=0;
+		goto ex;
 	}
+	STOPIF( status, "Open file '%s'", fn);
 
 	hlp__string_from_filep(NULL, NULL, NULL, SFF_RESET_LINENUM);
 	while (!feof(fp))
@@ -66,6 +66,16 @@ enum opt__settings_e {
 	/** Show grouping statistics.
 	 * See \ref o_group_stats. */
 	OPT__GROUP_STATS,
+	/** File with a list of working copies to check.
+	 * See \ref o_wc_list. */
+	OPT__WC_LIST,
+	/** How many working copies of the \ref o_wc_list "list" are checked 
+	 * in parallel.
+	 * See \ref o_wc_list. */
+	OPT__WC_LIST_JOBS,
+	/** File that gets progress information written into.
+	 * See \ref o_progress_file. */
+	OPT__PROGRESS_FILE,
 
 	/* merge/diff options */
 	/** How conflicts on update should be handled.
@@ -119,6 +129,42 @@ enum opt__settings_e {
 	/** Do expensive copyfrom checks?
 	 * See \ref o_copyfrom_exp */
 	OPT__COPYFROM_EXP,
+	/** In which order files get hashed.
+	 * See \ref o_hash_order. */
+	OPT__HASH_ORDER,
+	/** How many processes verify a big file.
+	 * See \ref o_verify_jobs. */
+	OPT__VERIFY_JOBS,
+	/** Whether a \ref tree image is written.
+	 * See \ref o_tree_image. */
+	OPT__TREE_IMAGE,
+	/** Whether commits are only stored locally.
+	 * See \ref o_commit_local. */
+	OPT__COMMIT_LOCAL,
+	/** How often \ref push tries again.
+	 * See \ref o_push_retries. */
+	OPT__PUSH_RETRIES,
+	/** Whether an initial import may be loaded as dump stream.
+	 * See \ref o_commit_via_dump. */
+	OPT__COMMIT_VIA_DUMP,
+	/** Maximum bytes per second read for hashing, in KiB.
+	 * See \ref o_limits. */
+	OPT__IO_LIMIT,
+	/** Maximum CPU usage in percent.
+	 * See \ref o_limits. */
+	OPT__CPU_LIMIT,
+	/** File to re-read the limits from.
+	 * See \ref o_limits. */
+	OPT__LIMIT_FILE,
+	/** Seconds after which \ref status stops.
+	 * See \ref o_deadline. */
+	OPT__DEADLINE,
+	/** Whether the next \ref status continues after a deadline.
+	 * See \ref o_deadline. */
+	OPT__DEADLINE_RESUME,
+	/** Whether \ref o_stop_change checks the often changed entries first.
+	 * See \ref o_hot_first. */
+	OPT__HOT_FIRST,
 
 	/** Set a global password, for anonymous co/ci.
 	 * See \ref o_passwd. */
@@ -304,6 +350,15 @@ enum opt__delay_e {
 /** @} */
 
 
+/** \name List of constants for \ref o_hash_order option.
+ * @{ */
+enum opt__hash_order_e {
+	HASH_ORDER_TREE=0,
+	HASH_ORDER_DISK,
+};
+/** @} */
+
+
 /** \name List of constants for \ref o_chcheck option.
  * @{ */
 enum opt__chcheck_e {
@@ -339,38 +339,464 @@ const char prp___to_be_removed_value[]=
 	"FSVS:INTERNAL-to-be-removed-- 91b88fdf-c285-4b73-a988-32d333c7548";
 
 
+/** \name Group auto-property references
+ *
+ * Adding a large tree with auto-properties used to write one \ref prop 
+ * database per entry - and \c gdbm_close() does a \c fsync() for each of 
+ * them.
+ * Now the user-defined auto-properties are stored once per group in the 
+ * \ref gprop database, and the new entries only reference them; a real 
+ * \ref prop file is only materialized when the entry's properties get 
+ * changed.
+ * @{ */
+/** The opened \ref gprop database. */
+static hash_t prp___group_db=NULL;
+/** Mode \ref prp___group_db was opened with, or \c -1 if there's no 
+ * database; \c 0 (like \c GDBM_READER) before the first open.  */
+static int prp___group_db_mode=0;
+
+
+/** Opens the \ref gprop database.
+ *
+ * For \c GDBM_READER and \c GDBM_WRITER \c ENOENT is returned silently 
+ * if there's no database; that is remembered, so that checking many 
+ * entries costs nothing if no group references exist. */
+static int prp___group_db_open(int gdbm_mode)
+{
+	int status;
+
+
+	status=0;
+	if (prp___group_db)
+	{
+		if (gdbm_mode == GDBM_READER || prp___group_db_mode != GDBM_READER)
+			goto ex;
+
+		/* We need to write now. */
+		STOPIF( hsh__close(prp___group_db, 0), NULL);
+		prp___group_db=NULL;
+	}
+	else if (prp___group_db_mode == -1 && gdbm_mode != GDBM_WRCREAT)
+	{
+		status=ENOENT;
+		goto ex;
+	}
+
+	status=hsh__new(wc_path, WAA__GROUP_PROP_EXT, gdbm_mode, 
+			&prp___group_db);
+	if (status == ENOENT)
+	{
+		prp___group_db_mode=-1;
+		goto ex;
+	}
+	STOPIF( status, "Opening the group properties database");
+
+	prp___group_db_mode=gdbm_mode;
+
+ex:
+	return status;
+}
+
+
+/** Returns the key of \a sts in the \ref gprop database, in a static 
+ * buffer.
+ *
+ * That's the entry ID; if \a sts has none yet, one is assigned if \a 
+ * new_id is set, else \c ENOENT is returned silently.
+ * With \a by_path the key that was used up to \ref WAA_VERSION 6 is 
+ * returned, ie. the path. */
+static int prp___group_ref_key(struct estat *sts, int new_id, int by_path,
+		datum *key)
+{
+	static char buffer[16+1];
+	int status;
+	char *cp;
+
+
+	status=0;
+	if (by_path)
+	{
+		STOPIF( ops__build_path(&key->dptr, sts), NULL);
+	}
+	else
+	{
+		if (!sts->entry_id)
+		{
+			if (!new_id) 
+			{
+				status=ENOENT;
+				goto ex;
+			}
+			STOPIF( waa__get_entry_directory(sts, &cp, NULL, NULL, GWD_NEW_ID), 
+					NULL);
+		}
+
+		sprintf(buffer, "%llx", sts->entry_id);
+		key->dptr=buffer;
+	}
+	key->dsize=strlen(key->dptr)+1;
+
+ex:
+	return status;
+}
+
+
+/** Stores the reference of \a sts to the auto-properties of \a group.
+ *
+ * \a list and \a len are the <tt>name\\0value\\0...</tt> list of the 
+ * user-defined properties; they are written only for the first entry of 
+ * the group in this run.
+ * If the group's definition changed since an earlier run, a new list 
+ * gets stored, so that existing entries keep their properties. */
+static int prp___group_ref_set(struct estat *sts, 
+		struct grouping_t *group,
+		char *list, int len)
+{
+	int status;
+	int i, gn_len;
+	datum key, value, old;
+
+
+	STOPIF( prp___group_db_open(GDBM_WRCREAT), NULL);
+
+	if (!group->prop_ref)
+	{
+		gn_len=strlen(group->group_name);
+		STOPIF( hlp__alloc( &group->prop_ref, 1 + gn_len + 1 + 12), NULL);
+
+		value.dptr=list;
+		value.dsize=len;
+		for(i=0; ; i++)
+		{
+			sprintf(group->prop_ref, ":%s:%d", group->group_name, i);
+			key.dptr=group->prop_ref;
+			key.dsize=strlen(key.dptr)+1;
+
+			status=hsh__fetch(prp___group_db, key, &old);
+			if (status == ENOENT)
+			{
+				STOPIF( hsh__store(prp___group_db, key, value), NULL);
+				break;
+			}
+			STOPIF(status, NULL);
+
+			status= old.dsize == len && memcmp(old.dptr, list, len) == 0;
+			IF_FREE(old.dptr);
+			if (status) break;
+		}
+		status=0;
+
+		DEBUGP("auto-props of group %s in %s", 
+				group->group_name, group->prop_ref);
+	}
+
+	STOPIF( prp___group_ref_key(sts, 1, 0, &key), NULL);
+	STOPIF( hsh__store_charp(prp___group_db, key.dptr, group->prop_ref), 
+			NULL);
+
+ex:
+	return status;
+}
+
 
 /** -.
- * Just a wrapper for the normal property operation.
+ * The list is in the \ref gprop format.
  *
- * Must be silent for \c ENOENT, so that <tt>fsvs pl *</tt> doesn't give an 
- * error.  */
-int prp__open_byname(char *wcfile, int gdbm_mode, hash_t *db)
+ * Returns \c ENOENT silently if there's no reference.
+ * The memory of datum::dptr is \c malloc()ed.
+ *
+ * If the entry has a \ref prop file, the reference is stale (its removal 
+ * was discarded, because the action failed after writing the file), and 
+ * \c ENOENT is returned, too. */
+int prp__group_ref_get(struct estat *sts, datum *list)
 {
-  int status;
-	
-	status=hsh__new(wcfile, WAA__PROP_EXT, gdbm_mode, db);
-	if (status != ENOENT)
-		STOPIF(status, "Opening property file for %s", wcfile);
+	int status, fh;
+	datum key, ref;
+
+
+	status=prp___group_db_open(GDBM_READER);
+	if (status == ENOENT) goto ex;
+	STOPIF(status, NULL);
+
+	status=prp___group_ref_key(sts, 0, 0, &key);
+	if (!status)
+		status=hsh__fetch(prp___group_db, key, &ref);
+	/* Not moved yet. */
+	if (status == ENOENT && waa__is_path_keyed(sts))
+	{
+		STOPIF( prp___group_ref_key(sts, 0, 1, &key), NULL);
+		status=hsh__fetch(prp___group_db, key, &ref);
+	}
+	if (status == ENOENT) goto ex;
+	STOPIF(status, NULL);
+
+	status=hsh__fetch(prp___group_db, ref, list);
+	IF_FREE(ref.dptr);
+	STOPIF(status, "No auto-properties for %s", key.dptr);
+
+	status=waa__open_entry(sts, WAA__PROP_EXT, WAA__READ, &fh);
+	if (status == ENOENT) 
+	{
+		status=0;
+		goto ex;
+	}
+	STOPIF(status, NULL);
+	close(fh);
+
+	DEBUGP("stale group reference for %s", sts->name);
+	IF_FREE(list->dptr);
+	status=ENOENT;
 
 ex:
 	return status;
 }
 
 
+/** Writes the properties in \a list into \a db. */
+static int prp___group_ref_fill(hash_t db, datum list)
+{
+	int status;
+	char *name, *value, *end;
+
+
+	status=0;
+	name=list.dptr;
+	end=list.dptr+list.dsize;
+	while (name < end)
+	{
+		value=name+strlen(name)+1;
+		BUG_ON(value >= end, "Invalid auto-property list");
+
+		STOPIF( prp__set(db, name, value, strlen(value)+1), NULL);
+		name=value+strlen(value)+1;
+	}
+
+ex:
+	return status;
+}
+
+
+/** -. */
+int prp__group_ref_drop(struct estat *sts)
+{
+	int status;
+	datum key;
+
+
+	status=prp___group_db_open(GDBM_WRITER);
+	if (status == ENOENT)
+	{
+		status=0;
+		goto ex;
+	}
+	STOPIF(status, NULL);
+
+	status=prp___group_ref_key(sts, 0, 0, &key);
+	if (status == ENOENT)
+	{
+		status=0;
+		goto ex;
+	}
+	STOPIF(status, NULL);
+
+	status=hsh__delete(prp___group_db, key);
+	/* ENOENT is fine. */
+	if (status == ENOENT)
+		status=0;
+	else
+	{
+		STOPIF(status, NULL);
+		DEBUGP("dropped group reference of %s", key.dptr);
+	}
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * The old key is the path of \a sts. */
+int prp__group_ref_rekey(struct estat *sts)
+{
+	int status;
+	datum key, ref;
+
+
+	ref.dptr=NULL;
+	status=prp___group_db_open(GDBM_WRITER);
+	if (status == ENOENT)
+	{
+		status=0;
+		goto ex;
+	}
+	STOPIF(status, NULL);
+
+	STOPIF( prp___group_ref_key(sts, 0, 1, &key), NULL);
+	status=hsh__fetch(prp___group_db, key, &ref);
+	if (status == ENOENT) 
+	{
+		status=0;
+		goto ex;
+	}
+	STOPIF(status, NULL);
+
+	STOPIF( hsh__delete(prp___group_db, key), 
+			"Removing the group reference of %s", key.dptr);
+	STOPIF( prp___group_ref_key(sts, 1, 0, &key), NULL);
+	STOPIF( hsh__store(prp___group_db, key, ref), NULL);
+
+ex:
+	IF_FREE(ref.dptr);
+	return status;
+}
+
+
+/** Copies the group reference of \a src to \a dest, and recurses into 
+ * the entries below, as they were matched by waa__copy_entries(). */
+static int prp___group_ref_copy(struct estat *src, struct estat *dest)
+{
+	int status;
+	datum key, ref;
+	struct estat **child, *src_child;
+
+
+	ref.dptr=NULL;
+	status=prp___group_ref_key(src, 0, 0, &key);
+	if (!status)
+		status=hsh__fetch(prp___group_db, key, &ref);
+	if (!status)
+	{
+		STOPIF( prp___group_ref_key(dest, 1, 0, &key), NULL);
+		DEBUGP("group reference %s => %s", src->name, key.dptr);
+		STOPIF( hsh__store(prp___group_db, key, ref), NULL);
+	}
+	else if (status != ENOENT)
+		STOPIF(status, NULL);
+	status=0;
+
+	if (ops__has_children(dest))
+	{
+		for(child=dest->by_inode; *child; child++)
+		{
+			STOPIF( ops__find_entry_byname(src, (*child)->name, &src_child, 1), 
+					NULL);
+			if (src_child)
+				STOPIF( prp___group_ref_copy(src_child, *child), NULL);
+		}
+	}
+
+ex:
+	IF_FREE(ref.dptr);
+	return status;
+}
+
+
+/** -.
+ * \a src and \a dest are the base entries; the references of the entries 
+ * below \a src are copied, too. The references are looked up by entry ID, 
+ * so only the copied entries are visited.
+ *
+ * The reference of \a src is kept; if it was a rename, the removal of \a 
+ * src drops it. */
+int prp__group_ref_copy(struct estat *src, struct estat *dest)
+{
+	int status;
+
+
+	status=prp___group_db_open(GDBM_WRITER);
+	if (status == ENOENT)
+	{
+		status=0;
+		goto ex;
+	}
+	STOPIF(status, NULL);
+
+	STOPIF( prp___group_ref_copy(src, dest), NULL);
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * Has to be called before exiting, so that the data gets written.
+ *
+ * If \a has_failed is set, the changes are discarded. A \ref prop file 
+ * that was materialized in the meantime makes the reference of its entry 
+ * stale; see prp__group_ref_get(). */
+int prp__group_db_close(int has_failed)
+{
+	int status;
+
+
+	status=0;
+	if (prp___group_db)
+	{
+		status=hsh__close(prp___group_db, has_failed);
+		prp___group_db=NULL;
+		prp___group_db_mode=0;
+		STOPIF(status, "Closing the group properties database");
+	}
+
+ex:
+	return status;
+}
+/** @} */
+
+
+
 /** -.
  * Returns ENOENT silently.
+ *
+ * If \a sts only references the auto-properties of its group (see \ref 
+ * gprop), a \c GDBM_READER open gets them in a read-only hash, without 
+ * writing anything into the WAA; for the other modes a real \ref prop 
+ * file is materialized from them, and the reference removed.
+ * A \c GDBM_NEWDB open just removes the reference.
  * */
 int prp__open_byestat(struct estat *sts, int gdbm_mode, hash_t *db)
 {
 	int status;
 	char *fn;
+	datum list;
 
-	STOPIF( ops__build_path(&fn, sts), NULL);
-	status=prp__open_byname(fn, gdbm_mode, db);
-	if (status != ENOENT) STOPIF(status, NULL);
+
+	list.dptr=NULL;
+	if ((gdbm_mode & ~HASH_REMEMBER_FILENAME) == GDBM_NEWDB)
+		STOPIF( prp__group_ref_drop(sts), NULL);
+	else
+	{
+		status=prp__group_ref_get(sts, &list);
+		if (status != ENOENT) 
+		{
+			STOPIF(status, NULL);
+
+			if ((gdbm_mode & ~HASH_REMEMBER_FILENAME) == GDBM_READER)
+			{
+				STOPIF( hsh__new_from_list(list, db), NULL);
+				goto ex;
+			}
+
+			STOPIF( ops__build_path(&fn, sts), NULL);
+			DEBUGP("materializing auto-props for %s", fn);
+			STOPIF( hsh__new_for_entry(sts, WAA__PROP_EXT,
+						GDBM_NEWDB | (gdbm_mode & HASH_REMEMBER_FILENAME), db), 
+					"Opening property file for %s", fn);
+			STOPIF( prp___group_ref_fill(*db, list), NULL);
+			STOPIF( prp__group_ref_drop(sts), NULL);
+			goto ex;
+		}
+	}
+
+	status=hsh__new_for_entry(sts, WAA__PROP_EXT, gdbm_mode, db);
+	if (status != ENOENT)
+	{
+		STOPIF( ops__build_path(&fn, sts), NULL);
+		STOPIF(status, "Opening property file for %s", fn);
+	}
 
 ex:
+	IF_FREE(list.dptr);
 	return status;
 }
 
@@ -471,10 +897,16 @@ int prp__set_from_aprhash(struct estat *sts,
 	hash_t db;
 	int to_store, count;
 	void *k, *v;
+	struct grouping_t *group;
+	char *list;
+	int list_len, len;
 
 
 	status=0;
 	count=0;
+	group=NULL;
+	list=NULL;
+	list_len=0;
 
 	/* The old behaviour was to always open the database file. If no 
 	 * user-specified properties are given, old properties were removed that 
@@ -509,6 +941,11 @@ int prp__set_from_aprhash(struct estat *sts,
 		STOPIF( prp__open_byestat(sts, 
 					GDBM_NEWDB | HASH_REMEMBER_FILENAME, &db), NULL);
 	}
+	else if (flags & STORE_BY_GROUP)
+	{
+		BUG_ON(!sts->match_pattern || props_db);
+		group=sts->match_pattern->group_def;
+	}
 
 	for (; hi; hi = apr_hash_next(hi)) 
 	{
@@ -533,6 +970,17 @@ int prp__set_from_aprhash(struct estat *sts,
 				 * UTF-8. */
 				STOPIF( prp__set_svnstr(db, prop_key, prop_val), NULL);
 			}
+			else if (group && !group->prop_ref)
+			{
+				/* Auto-props come from the configuration, so they're strings.  */
+				len=strlen(prop_key)+1;
+				STOPIF( hlp__realloc( &list, list_len + len + prop_val->len+1), 
+						NULL);
+				memcpy(list+list_len, prop_key, len);
+				list_len += len;
+				memcpy(list+list_len, prop_val->data, prop_val->len+1);
+				list_len += prop_val->len+1;
+			}
 			count++;
 		}
 		else
@@ -543,12 +991,46 @@ int prp__set_from_aprhash(struct estat *sts,
 		}
 	}
 
+	if (group)
+	{
+		/* An earlier property file is superseded by the group; if there are 
+		 * only meta-data properties, there's nothing to reference. */
+		STOPIF( prp__unlink_db_for_estat(sts), NULL);
+		if (count)
+			STOPIF( prp___group_ref_set(sts, group, list, list_len), NULL);
+	}
+
 	DEBUGP("%d properties stored", count);
 	if (props_db)
 		*props_db=db;
 	else
 		STOPIF( hsh__close(db, status), NULL);
 
+ex:
+	IF_FREE(list);
+	return status;
+}
+
+
+/** Loads the entry list for prop-get and prop-list; the property files 
+ * are found via the entries. 
+ * Without a \ref dir file nothing has properties, so \a *have_tree is 
+ * set to \c 0 instead of returning an error. */
+static int prp___load_tree(struct estat *root, int *have_tree)
+{
+	int status;
+
+
+	*have_tree=0;
+	status=waa__input_tree(root, NULL, NULL);
+	if (status == -ENOENT)
+		status=0;
+	else
+	{
+		STOPIF(status, NULL);
+		*have_tree=1;
+	}
+
 ex:
 	return status;
 }
@@ -563,6 +1045,8 @@ int prp__g_work(struct estat *root, int argc, char *argv[])
 	hash_t db;
 	FILE *output;
 	char **normalized;
+	struct estat *sts;
+	int have_tree;
 
 
 	db=NULL;
@@ -578,11 +1062,16 @@ int prp__g_work(struct estat *root, int argc, char *argv[])
 
 	STOPIF( waa__find_common_base(argc, argv, &normalized), NULL);
 
+	STOPIF( prp___load_tree(root, &have_tree), NULL);
+
 
-	for(; *argv; argv++)
+	for(; *normalized; normalized++)
 	{
 		db=NULL;
-		status=prp__open_byname( *normalized, GDBM_READER, &db);
+		status=have_tree ? 
+			ops__traverse(root, *normalized, 0, 0, &sts) : ENOENT;
+		if (!status)
+			status=prp__open_byestat(sts, GDBM_READER, &db);
 		if (!status)
 			status=prp__fetch(db, key, &value);
 
@@ -785,6 +1274,8 @@ int prp__l_work(struct estat *root, int argc, char *argv[])
 	FILE *output;
 	datum key, data;
 	char **normalized;
+	struct estat *sts;
+	int have_tree;
 
 
 	status=0;
@@ -794,6 +1285,8 @@ int prp__l_work(struct estat *root, int argc, char *argv[])
 
 	STOPIF( waa__find_common_base(argc, argv, &normalized), NULL);
 
+	STOPIF( prp___load_tree(root, &have_tree), NULL);
+
 
 	output=stdout;
 	many_files= argc>1;
@@ -801,7 +1294,10 @@ int prp__l_work(struct estat *root, int argc, char *argv[])
 
 	for(; *normalized; normalized++)
 	{
-		status=prp__open_byname( *normalized, GDBM_READER, &db);
+		status=have_tree ? 
+			ops__traverse(root, *normalized, 0, 0, &sts) : ENOENT;
+		if (!status)
+			status=prp__open_byestat(sts, GDBM_READER, &db);
 		if (status == ENOENT) goto noprops;
 
 		if (status)
@@ -869,18 +1365,11 @@ ex:
 int prp__unlink_db_for_estat(struct estat *sts)
 {
 	int status;
-	char *cp, *eos, *path;
-
-	STOPIF( ops__build_path(&path, sts), NULL);
 
-	STOPIF( waa__get_waa_directory(path, &cp, &eos, NULL,
-				waa__get_gwd_flag(WAA__PROP_EXT)), NULL);
-	strcpy(eos, WAA__PROP_EXT);
 
-	status= unlink(cp) == -1 ? errno : 0;
-	if (status == ENOENT)
-		status=0;
-	else STOPIF(status, "deleting properties of %s (%s)", path, cp);
+	STOPIF( prp__group_ref_drop(sts), NULL);
+	STOPIF( waa__delete_entry(sts, WAA__PROP_EXT, 1), 
+			"deleting properties of %s", sts->name);
 
 ex:
 	return status;
@@ -894,6 +1383,14 @@ int prp__sts_has_no_properties(struct estat *sts, int *result)
 	datum key;
 
 	status=0;
+	/* No need to materialize the referenced properties. */
+	rv = prp__group_ref_get(sts, NULL);
+	if (rv != ENOENT)
+	{
+		STOPIF(rv, NULL);
+		goto done;
+	}
+
 	rv = prp__open_byestat( sts, GDBM_READER, &db);
 	if (rv == ENOENT)
 		goto done;
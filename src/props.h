@@ -27,8 +27,6 @@
  * - GDBM_NEWDB
  * */
 /** @{ */
-/** Open a property file, by WC-path. */
-int prp__open_byname(char *wcfile, int gdbm_mode, hash_t *db);
 /** Open a property file, by struct estat. */
 int prp__open_byestat(struct estat *sts, int gdbm_mode, hash_t *db);
 /** @} */
@@ -46,6 +44,9 @@ enum prp__set_from_aprhash_e {
 	DEFAULT=0,
 	STORE_IN_FS=1,
 	ONLY_KEEP_USERDEF=2,
+	/** Store the user-defined properties only once per group (of \c 
+	 * estat::match_pattern), and reference them for the entry. */
+	STORE_BY_GROUP=4,
 };
 
 /** Writes the given set of properties of \a sts into its \ref prop file.  
@@ -113,6 +114,17 @@ int prp__open_get_close(struct estat *sts, char *name,
 int prp__unlink_db_for_estat(struct estat *sts);
 /** @} */
 
+/** Returns the list of group auto-properties \a sts references. */
+int prp__group_ref_get(struct estat *sts, datum *list);
+/** Removes the reference of \a sts to its group's auto-properties. */
+int prp__group_ref_drop(struct estat *sts);
+/** Gives the entries at \a dest the group references of \a src. */
+int prp__group_ref_copy(struct estat *src, struct estat *dest);
+/** Moves the group reference of \a sts from the path to the entry ID. */
+int prp__group_ref_rekey(struct estat *sts);
+/** Closes the database of group auto-properties, if it was opened. */
+int prp__group_db_close(int has_failed);
+
 
 /** Prop-get worker function. */
 work_t prp__g_work;
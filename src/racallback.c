@@ -33,6 +33,8 @@
 #include "racallback.h"
 
 
+/** -.
+ * Only the first call does something. */
 svn_error_t *cb__init(apr_pool_t *pool)
 {
 	int status;
@@ -40,7 +42,14 @@ svn_error_t *cb__init(apr_pool_t *pool)
 	apr_hash_t *cfg_hash;
 	svn_config_t *cfg;
 	char *cfg_usr_path;
+	static int is_initialized=0;
+
 
+	status=0;
+	if (is_initialized) goto ex;
+
+	DEBUGP("initializing RA layer and authentication");
+	STOPIF_SVNERR( svn_ra_initialize, (pool));
 
 	cfg_usr_path = NULL;
 	STOPIF( hlp__get_svn_config(&cfg_hash), NULL);
@@ -68,6 +77,7 @@ svn_error_t *cb__init(apr_pool_t *pool)
 			);
 
 	BUG_ON(!cb__cb_table.auth_baton);
+	is_initialized=1;
 
 ex:
 	RETURN_SVNERR(status);
@@ -247,6 +257,9 @@ int cb__add_entry(struct estat *dir,
 		sts->st.gid=getgid(); 
 	}
 
+	/* An entry getting another URL isn't in the index of that URL. */
+	if (sts->url != current_url)
+		url__subtree_index_valid=0;
 	sts->url=current_url;
 	ops__mark_parent_cc(sts, remote_status);
 
@@ -707,7 +720,19 @@ const svn_delta_editor_t cb___change_recorder =
 /** @} */
 
 
-int cb___report_path_rev(struct estat *dir, 
+/** Reports the entries below \a dir whose revision differs from \a 
+ * dir_rev, which is the revision \a dir was reported at.
+ *
+ * Only deviations from the parent are sent; a subtree that's completely 
+ * at another revision is reported with a single call for its top 
+ * directory, as estat::other_revs (set while loading the entries) tells 
+ * that nothing below differs.
+ * So the report size depends only on the number of revision boundaries, 
+ * not on the number of entries.
+ *
+ * Entries of other URLs, and entries that were never committed, are not 
+ * reported; they would have no meaning in this repository. */
+int cb___report_path_rev(struct estat *dir, svn_revnum_t dir_rev,
 		const svn_ra_reporter2_t *reporter,
 		void *report_baton, 
 		apr_pool_t *pool)
@@ -715,6 +740,7 @@ int cb___report_path_rev(struct estat *dir,
 	int status, i;
 	struct estat *sts;
 	svn_error_t *status_svn;
+	svn_revnum_t rev;
 	char *fn;
 
 
@@ -722,25 +748,28 @@ int cb___report_path_rev(struct estat *dir,
 	for(i=0; i<dir->entry_count; i++)
 	{
 		sts=dir->by_inode[i];
+		rev=dir_rev;
 
-		STOPIF( ops__build_path(&fn, sts), NULL );
-		/* We have to cut the "./" in front. */
-		/* We report the directories' revision too. */
-		/* As we're doing the children of a directory, there must always
-		 * be a parent. */
-		/* \todo: the parent might be from another URL. What should we do? */
-		if ( sts->repos_rev != sts->parent->repos_rev)
+		/* The path is only built for reported entries. */
+		if (sts->url == current_url && 
+				sts->repos_rev > 0 && 
+				sts->repos_rev != SET_REVNUM &&
+				sts->repos_rev != dir_rev)
 		{
-			DEBUGP("reporting %s at %llu", fn, (t_ull)sts->repos_rev);
+			rev=sts->repos_rev;
+			STOPIF( ops__build_path(&fn, sts), NULL );
+			DEBUGP("reporting %s at %llu", fn, (t_ull)rev);
+			/* We have to cut the "./" in front. */
 			STOPIF_SVNERR( reporter->set_path,
-					(report_baton, fn+2, sts->repos_rev, 0, "", pool));
+					(report_baton, fn+2, rev, 0, "", pool));
 		}
 
-		if (S_ISDIR(sts->st.mode) && sts->other_revs)
-		{
-			STOPIF( cb___report_path_rev(sts, reporter, report_baton, pool),
-					NULL);
-		}	
+		/* If this directory wasn't reported although its revision differs, 
+		 * other_revs doesn't tell about the children. */
+		if (S_ISDIR(sts->st.mode) && 
+				(sts->other_revs || sts->repos_rev != rev))
+			STOPIF( cb___report_path_rev(sts, rev, 
+						reporter, report_baton, pool), NULL);
 	}
 
 ex:
@@ -781,6 +810,8 @@ int cb___remover(struct estat *sts, struct url_t *to_remove,
 			 * parent, unless this gets removed now. */
 			BUG_ON(sts->url != to_remove && url__sorter(hp_url, sts->url) < 0);
 
+			if (sts->url != hp_url)
+				url__subtree_index_valid=0;
 			sts->url=hp_url;
 		}
 	}
@@ -820,11 +851,59 @@ ex:
 }
 
 
+/** Removes \a to_remove from the whole tree by walking only its subtrees.
+ *
+ * Uses the url_t::subtrees index; subtrees below another one of the same 
+ * URL are done with their parent.
+ * The directories above the subtrees don't change their URL, as no 
+ * entries of \a to_remove are below them (directly).
+ *
+ * As the index covers the whole working copy, this must only be used when 
+ * the complete URL gets removed.
+ *
+ * Returns \c ENOENT if the index cannot be used. */
+static int cb___remove_indexed(struct url_t *to_remove, int *has_changes)
+{
+	int status;
+	unsigned i;
+	struct estat *sts, *parent;
+	struct url_t *nevermind;
+
+
+	status=0;
+	if (!url__subtree_index_valid)
+	{
+		status=ENOENT;
+		goto ex;
+	}
+
+	DEBUGP("%u subtrees for %s", to_remove->subtree_count, to_remove->url);
+	for(i=0; i<to_remove->subtree_count; i++)
+	{
+		sts=to_remove->subtrees[i];
+
+		/* Don't stop at the root; that is never removed. */
+		for(parent=sts->parent; parent->parent; parent=parent->parent)
+			if (parent->url == to_remove) break;
+		if (parent->parent) continue;
+
+		nevermind=NULL;
+		STOPIF( cb___remover(sts, to_remove, &nevermind, has_changes), NULL);
+	}
+
+ex:
+	return status;
+}
+
+
 /** -.
  * While recursion we look for the highest priority URL in the children 
  * (within each level); if there is one, we mark the directory as belonging 
  * to that URL.
  *
+ * Only the entries below \a root are looked at; the url_t::subtrees index 
+ * is only used if that's the whole working copy.
+ *
  * Will be easier with mixed-WC operation; currently it's not correct if 
  * there are overlaid non-directory entries.
  * */
@@ -835,7 +914,12 @@ int cb__remove_from_url(struct estat *root, struct url_t *to_remove,
 	int status;
 
 	*was_changed=0;
-	STOPIF( cb___remover(root, to_remove, &nevermind, was_changed), NULL);
+	status= root->parent ? ENOENT : 
+		cb___remove_indexed(to_remove, was_changed);
+	if (status == ENOENT)
+		STOPIF( cb___remover(root, to_remove, &nevermind, was_changed), NULL);
+	else
+		STOPIF( status, NULL);
 	to_remove->current_rev=0;
 
 ex:
@@ -843,14 +927,23 @@ ex:
 }
 
 
-/** -. */
+/** -.
+ * The complete URL is removed, so the url_t::subtrees index can be used. */
 int cb__remove_url(struct estat *root, struct url_t *to_remove)
 {
 	int status;
 	struct url_t *nevermind;
 	int vvoid;
 
-	STOPIF( cb___remover(root, to_remove, &nevermind, &vvoid), NULL);
+	vvoid=0;
+	status=cb___remove_indexed(to_remove, &vvoid);
+	if (status == ENOENT)
+	{
+		nevermind=NULL;
+		STOPIF( cb___remover(root, to_remove, &nevermind, &vvoid), NULL);
+	}
+	else
+		STOPIF( status, NULL);
 	to_remove->current_rev=0;
 	url__must_write_defs=1;
 
@@ -994,9 +1087,12 @@ int cb__record_changes_mixed(struct estat *root,
 	DEBUGP("Getting changes from %llu to %llu", 
 			(t_ull)current_url->current_rev,
 			(t_ull)target);
-#if 0
-	STOPIF( cb___report_path_rev( root, reporter, report_baton, pool), NULL);
-#endif
+	/* Entries at other revisions than the root, eg. after committing only 
+	 * some entries; not for a checkout (the root is reported empty), and 
+	 * not if the user wants the given paths at a specific revision. */
+	if (!other_paths && current_url->current_rev)
+		STOPIF( cb___report_path_rev( root, current_url->current_rev,
+					reporter, report_baton, pool), NULL);
 
 	STOPIF_SVNERR( reporter->finish_report, 
 			(report_baton, global_pool));
@@ -17,7 +17,9 @@
 /** The callback table for cb__record_changes(). */
 extern struct svn_ra_callbacks_t cb__cb_table;
 
-/** Initialize the callback functions.
+/** Initialize the RA layer, the callback functions and authentication.
+ * Called before the first repository access, so that local-only actions 
+ * needn't read the subversion configuration.
  * \todo Authentication providers. */
 svn_error_t *cb__init(apr_pool_t *pool);
 
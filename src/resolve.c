@@ -64,7 +64,7 @@ int res__mark_conflict(struct estat *sts, ...)
 	filehdl=-1;
 
 	STOPIF( ops__build_path(&filename, sts), NULL);
-	STOPIF( waa__open_byext(filename, WAA__CONFLICT_EXT, 
+	STOPIF( waa__open_entry(sts, WAA__CONFLICT_EXT, 
 				(sts->flags & RF_CONFLICT) ? WAA__APPEND : WAA__WRITE,
 				&	filehdl), NULL );
 
@@ -135,7 +135,7 @@ int res__remove_aux_files(struct estat *sts)
 	mapped=MAP_FAILED;
 
 	STOPIF( ops__build_path(&filename, sts), NULL);
-	STOPIF( waa__open_byext(filename, WAA__CONFLICT_EXT, 
+	STOPIF( waa__open_entry(sts, WAA__CONFLICT_EXT, 
 				WAA__READ, &filehdl), NULL );
 
 	STOPIF( hlp__fstat( filehdl, &st), NULL);
@@ -160,7 +160,7 @@ int res__remove_aux_files(struct estat *sts)
 
 	sts->flags &= ~RF_CONFLICT;
 
-	STOPIF( waa__delete_byext(filename, WAA__CONFLICT_EXT, 0), NULL);
+	STOPIF( waa__delete_entry(sts, WAA__CONFLICT_EXT, 0), NULL);
 
 ex:
 	if (filehdl != -1)
@@ -454,7 +454,7 @@ int rev__install_file(struct estat *sts, svn_revnum_t revision,
 	/* When we get a file, old manber-hashes are stale.
 	 * So remove them; if the file is big enough, we'll recreate it with 
 	 * correct data. */
-	STOPIF( waa__delete_byext(filename, WAA__FILE_MD5s_EXT, 1), NULL);
+	STOPIF( waa__delete_entry(sts, WAA__FILE_MD5s_EXT, 1), NULL);
 
 
 	/* Files get written in files; we use the temporarily generated name for  
@@ -777,6 +777,34 @@ ex:
 }
 
 
+/** Returns in \a *result whether only the meta-data (owner, group, mode, 
+ * mtime) of the file \a sts has changed, so that it can be reverted to \c 
+ * BASE without fetching the data again.
+ *
+ * The data gets compared, as eg. a changed mtime doesn't say anything 
+ * about the content. */
+static int rev___meta_only(struct estat *sts, char *path, int *result)
+{
+	int status, changed;
+
+
+	status=0;
+	*result=0;
+	if (opt_target_revisions_given ||
+			!sts->url ||
+			!S_ISREG(sts->st.mode) ||
+			!(sts->entry_status & FS_META_CHANGED) ||
+			(sts->entry_status & FS__CHANGE_MASK & ~FS_META_CHANGED))
+		goto ex;
+
+	STOPIF( cs__compare_file(sts, path, &changed), NULL);
+	*result = changed == 0;
+
+ex:
+	return status;
+}
+
+
 /** Revert action, called for every wanted entry.
  * Please note that contacting the repository is allowed, as we're only 
  * looping through the local entries. 
@@ -798,7 +826,7 @@ int rev___revert_to_base(struct estat *sts,
 		enum rev___dir_change_flag_e *dir_change_flag,
 		apr_pool_t *pool)
 {
-	int status;
+	int status, i;
 	svn_revnum_t wanted;
 	char *path;
 
@@ -875,18 +903,27 @@ int rev___revert_to_base(struct estat *sts,
 		/* Parent directories might just have been created. */
 		if (!S_ISDIR(sts->st.mode))
 		{
-			DEBUGP("file was changed, reverting");
+			STOPIF( rev___meta_only(sts, path, &i), NULL);
+			if (i)
+			{
+				/* Only meta-data changed; we know the old values, so there's no 
+				 * need to go to the repository. */
+				DEBUGP("only meta-data changed, resetting");
+				sts->remote_status=sts->entry_status;
+				STOPIF( up__set_meta_data(sts, path), NULL);
+			}
+			else
+			{
+				DEBUGP("file was changed, reverting");
 
-			/* \todo It would be nice if we could solve meta-data *for the current 
-			 * revision* only changes without going to the repository - after all, 
-			 * we know the old values.
-			 * \todo Maybe we'd need some kind of parameter, --meta-only? Keep 
-			 * data, reset rights.
-			 * */
-			/* TODO - opt_target_revision ? */
-			STOPIF( rev__install_file(sts, wanted, sts->decoder, pool),
-					"Unable to revert entry '%s'", path);
-			*dir_change_flag |= REVERT_MTIME;
+				/* \todo Maybe we'd need some kind of parameter, --meta-only? Keep 
+				 * data, reset rights.
+				 * */
+				/* TODO - opt_target_revision ? */
+				STOPIF( rev__install_file(sts, wanted, sts->decoder, pool),
+						"Unable to revert entry '%s'", path);
+				*dir_change_flag |= REVERT_MTIME;
+			}
 		}
 		else
 		{
@@ -1151,6 +1188,14 @@ int rev___undo_change(struct estat *sts,
 
 	unique_name_mine=NULL;
 
+	/* Already fetched by an interrupted update? */
+	STOPIF( up__resume_check(sts, fn, &j), NULL);
+	if (j)
+	{
+		*dir_change_flag|=REVERT_MTIME;
+		goto ex;
+	}
+
 	/* Conflict handling; depends whether it has changed locally. */
 	if (sts->entry_status & FS_CHANGED)
 		switch (opt__get_int(OPT__CONFLICT))
@@ -1249,6 +1294,9 @@ int rev___undo_change(struct estat *sts,
 		STOPIF( rev__install_file(sts, 0, sts->decoder, pool), NULL);
 		*dir_change_flag|=REVERT_MTIME;
 
+		if (!unique_name_mine)
+			STOPIF( up__resume_record(sts, fn), NULL);
+
 		/* We had a conflict; rename the file fetched from the 
 		 * repository to a unique name. */
 		if (unique_name_mine)
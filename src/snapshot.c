@@ -0,0 +1,526 @@
+/************************************************************************
+ * Copyright (C) 2009 Philipp Marek.
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ ************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "global.h"
+#include "waa.h"
+#include "helper.h"
+#include "actions.h"
+#include "snapshot.h"
+
+
+/** \file
+ * Snapshot of the configuration files.
+ *
+ * On every run the working copy specific configuration, the URL list, the
+ * ignore list and the group definitions are read; with the fallback
+ * logic for the groups that are quite a few files.
+ *
+ * Their contents are kept in a single file in the WAA (see \ref snap),
+ * which is \c mmap()ed at startup; a source file is then only checked by
+ * a \c stat(), comparing device, inode, size and mtime with the recorded
+ * values. Non-existing files are remembered, too.
+ *
+ * The data is still parsed on every run; the parsed structures (compiled
+ * patterns, property hashes, ...) are full of pointers.
+ *
+ * As read-only actions may not write into the WAA, the snapshot is only
+ * refreshed by actions that may change the working copy; but all of them
+ * do that, so eg. a commit or update brings it up-to-date again.
+ * */
+
+
+/** Identifies the snapshot format. */
+static const char snap___magic[16]="FSVS snapshot 1\n";
+
+/** Header of the \ref snap file. */
+struct snap___header_t
+{
+	char magic[sizeof(snap___magic)];
+	/** Number of records. */
+	uint32_t count;
+	/** Size of a record, as a simple compatibility check. */
+	uint32_t record_size;
+};
+
+/** A record in the \ref snap file.
+ * The offsets are from the start of the file; the path and the data are
+ * \c \\0 -terminated. */
+struct snap___rec_t
+{
+	uint64_t dev, ino, size;
+	uint64_t mtime_sec, mtime_nsec;
+	uint32_t path_off, data_off;
+	uint32_t is_absent;
+	uint32_t padding;
+};
+
+/** A source file, read from disk or from the snapshot. */
+struct snap___src_t
+{
+	/** The path, as given to snap__read(). */
+	char *path;
+	/** The contents, \c \\0 -terminated; \c NULL if the file doesn't
+	 * exist.
+	 * This memory is never freed, as the callers might keep pointers into
+	 * it. */
+	char *data;
+	size_t len;
+	/** The values the \a data belongs to. */
+	struct sstat_t st;
+	/** Whether this source was asked for in this run. */
+	int is_used;
+};
+
+
+/** All known sources. */
+static struct snap___src_t *snap___list=NULL;
+/** Number of used and allocated elements in \c snap___list. */
+static int snap___count=0, snap___alloc=0;
+/** Whether snap__load() has been called, ie. whether sources are
+ * tracked. */
+static int snap___loaded=0;
+/** Whether some source had to be read from disk. */
+static int snap___changed=0;
+
+
+/** Compares the stored values with the current ones. */
+static inline int snap___is_current(struct snap___src_t *src,
+		struct sstat_t *st)
+{
+	return src->data &&
+		src->st.dev == st->dev &&
+		src->st.ino == st->ino &&
+		src->st.size == st->size &&
+		src->st.mtim.tv_sec == st->mtim.tv_sec &&
+		src->st.mtim.tv_nsec == st->mtim.tv_nsec;
+}
+
+
+/** Returns the known source for \a path, or \c NULL. */
+static struct snap___src_t *snap___find(const char *path)
+{
+	int i;
+
+	for(i=0; i<snap___count; i++)
+		if (strcmp(snap___list[i].path, path) == 0)
+			return snap___list+i;
+	return NULL;
+}
+
+
+/** Returns a new element in \c snap___list for \a path. */
+static int snap___new(const char *path, struct snap___src_t **src)
+{
+	int status;
+
+
+	status=0;
+	if (snap___count >= snap___alloc)
+	{
+		snap___alloc = snap___alloc*2 + 16;
+		STOPIF( hlp__realloc( &snap___list,
+					snap___alloc * sizeof(*snap___list)), NULL);
+	}
+
+	*src=snap___list + snap___count;
+	memset(*src, 0, sizeof(**src));
+	STOPIF( hlp__strdup( &(*src)->path, path), NULL);
+	snap___count++;
+
+ex:
+	return status;
+}
+
+
+/** Reads the file \a path into \a src.
+ * Returns \c ENOENT if it doesn't exist. */
+static int snap___read_file(const char *path, struct snap___src_t *src)
+{
+	int status, fh;
+	struct stat st;
+	ssize_t got;
+	size_t done;
+
+
+	status=0;
+	src->data=NULL;
+	src->len=0;
+	fh=open(path, O_RDONLY);
+	if (fh == -1)
+	{
+		status=errno;
+		if (status == ENOENT) goto ex;
+		STOPIF(status, "Cannot open \"%s\"", path);
+	}
+
+	STOPIF_CODE_ERR( fstat(fh, &st) == -1, errno,
+			"Cannot get length of \"%s\"", path);
+	hlp__copy_stats(&st, &src->st);
+
+	STOPIF( hlp__alloc( &src->data, st.st_size+1), NULL);
+	for(done=0; done < (size_t)st.st_size; done+=got)
+	{
+		got=read(fh, src->data+done, st.st_size-done);
+		STOPIF_CODE_ERR( got == -1, errno, "Cannot read \"%s\"", path);
+		if (!got) break;
+	}
+	src->data[done]=0;
+	src->len=done;
+	DEBUGP("read %llu bytes from %s", (t_ull)done, path);
+
+ex:
+	if (fh != -1) close(fh);
+	return status;
+}
+
+
+/** -.
+ * The \a data is \c \\0 -terminated, and must not be changed or freed.
+ *
+ * \c ENOENT is returned silently if \a path doesn't exist. */
+int snap__read(const char *path, char **data, size_t *len)
+{
+	int status;
+	struct snap___src_t *src, local;
+	struct stat st;
+	struct sstat_t sst;
+
+
+	status=0;
+	src=snap___loaded ? snap___find(path) : NULL;
+
+	if (stat(path, &st) == -1)
+	{
+		status=errno;
+		STOPIF_CODE_ERR( status != ENOENT, status,
+				"Cannot get data of \"%s\"", path);
+		DEBUGP("%s doesn't exist", path);
+
+		if (snap___loaded)
+		{
+			if (!src) 
+			{
+				STOPIF( snap___new(path, &src), NULL);
+				snap___changed=1;
+			}
+			else if (src->data)
+				snap___changed=1;
+			src->data=NULL;
+			src->is_used=1;
+		}
+		status=ENOENT;
+		goto ex;
+	}
+
+	hlp__copy_stats(&st, &sst);
+	if (src && snap___is_current(src, &sst))
+		DEBUGP("%s taken from snapshot", path);
+	else
+	{
+		if (!snap___loaded)
+			src=&local;
+		else if (!src)
+			STOPIF( snap___new(path, &src), NULL);
+
+		status=snap___read_file(path, src);
+		if (status == ENOENT) goto ex;
+		STOPIF(status, NULL);
+		snap___changed=1;
+	}
+
+	src->is_used=1;
+	*data=src->data;
+	if (len) *len=src->len;
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * \a dir and \a extension are as for waa__open_byext(). */
+int snap__read_byext(const char *dir, const char *extension,
+		char **data, size_t *len)
+{
+	int status;
+	char *entry, *path, *eos;
+
+
+	entry=NULL;
+	STOPIF( waa__given_or_current_wd(dir, &entry), NULL );
+	STOPIF( waa__get_waa_directory(entry, &path, &eos, NULL,
+				waa__get_gwd_flag(extension)), NULL);
+	strcpy(eos, extension);
+
+	status=snap__read(path, data, len);
+	if (status == ENOENT) goto ex;
+	STOPIF(status, NULL);
+
+ex:
+	IF_FREE(entry);
+	return status;
+}
+
+
+/** Returns a \c FILE* for reading \a len bytes at \a data. */
+static int snap___fmemopen(char *data, size_t len, FILE **fp)
+{
+	int status;
+
+
+	status=0;
+	/* fmemopen() doesn't accept a size of 0. */
+	*fp= len ? fmemopen(data, len, "r") : fopen("/dev/null", "r");
+	STOPIF_CODE_ERR( !*fp, errno, "Cannot open memory stream");
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * \c ENOENT is returned silently, and \a *fp is set to \c NULL then. */
+int snap__fopen(const char *path, FILE **fp)
+{
+	int status;
+	char *data;
+	size_t len;
+
+
+	*fp=NULL;
+	status=snap__read(path, &data, &len);
+	if (status == ENOENT) goto ex;
+	STOPIF(status, NULL);
+
+	STOPIF( snap___fmemopen(data, len, fp), NULL);
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * \c ENOENT is returned silently, and \a *fp is set to \c NULL then. */
+int snap__fopen_byext(const char *dir, const char *extension, FILE **fp)
+{
+	int status;
+	char *data;
+	size_t len;
+
+
+	*fp=NULL;
+	status=snap__read_byext(dir, extension, &data, &len);
+	if (status == ENOENT) goto ex;
+	STOPIF(status, NULL);
+
+	STOPIF( snap___fmemopen(data, len, fp), NULL);
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * A missing or invalid snapshot is no error; it just means that all
+ * files have to be read. */
+int snap__load(void)
+{
+	int status, fh, i;
+	struct stat st;
+	char *map;
+	struct snap___header_t *hdr;
+	struct snap___rec_t *rec;
+	struct snap___src_t *src;
+	size_t end;
+
+
+	status=0;
+	if (snap___loaded) goto ex;
+	snap___loaded=1;
+
+	status=waa__open_byext(wc_path, WAA__SNAPSHOT_EXT, WAA__READ, &fh);
+	if (status == ENOENT)
+	{
+		DEBUGP("no snapshot");
+		status=0;
+		goto ex;
+	}
+	STOPIF(status, NULL);
+
+	STOPIF_CODE_ERR( fstat(fh, &st) == -1, errno,
+			"Cannot get length of snapshot");
+	map=NULL;
+	if (st.st_size >= (off_t)sizeof(*hdr))
+		map=mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fh, 0);
+	STOPIF_CODE_ERR( close(fh) == -1, errno, "close() failed");
+	if (!map || map == MAP_FAILED) goto ex;
+
+	/* The mapping is kept, as the data is used directly. */
+	hdr=(struct snap___header_t*)map;
+	rec=(struct snap___rec_t*)(hdr+1);
+	if (memcmp(hdr->magic, snap___magic, sizeof(hdr->magic)) != 0 ||
+			hdr->record_size != sizeof(*rec) ||
+			sizeof(*hdr) + (size_t)hdr->count*sizeof(*rec) > (size_t)st.st_size)
+	{
+		DEBUGP("snapshot invalid, ignored");
+		goto ex;
+	}
+
+	DEBUGP("snapshot has %u sources", hdr->count);
+	for(i=0; i<(int)hdr->count; i++, rec++)
+	{
+		end= rec->is_absent ? 0 : rec->data_off + rec->size;
+		if (rec->path_off >= (size_t)st.st_size || end >= (size_t)st.st_size ||
+				map[st.st_size-1] != 0)
+		{
+			DEBUGP("snapshot record %d invalid", i);
+			break;
+		}
+
+		STOPIF( snap___new(map + rec->path_off, &src), NULL);
+		src->data= rec->is_absent ? NULL : map + rec->data_off;
+		src->len=rec->size;
+		src->st.dev=rec->dev;
+		src->st.ino=rec->ino;
+		src->st.size=rec->size;
+		src->st.mtim.tv_sec=rec->mtime_sec;
+		src->st.mtim.tv_nsec=rec->mtime_nsec;
+	}
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * The sources used in this run are checked again, as the action might
+ * have changed some of them (eg. the URL revisions); only if something
+ * changed the file is written. */
+int snap__save(void)
+{
+	int status, fh, i, changed, count;
+	struct snap___src_t *src, tmp;
+	struct snap___header_t *hdr;
+	struct snap___rec_t *rec;
+	struct stat st;
+	struct sstat_t sst;
+	char *buffer, *cp;
+	size_t size;
+
+
+	status=0;
+	fh=-1;
+	buffer=NULL;
+	if (!snap___loaded ||
+			action->is_readonly || action->is_import_export)
+		goto ex;
+
+	changed=snap___changed;
+	count=0;
+	size=sizeof(*hdr);
+	for(i=0; i<snap___count; i++)
+	{
+		src=snap___list+i;
+		/* Sources not needed by this action are kept; they're checked on 
+		 * use anyway. */
+		if (!src->is_used)
+			goto add_size;
+
+		if (stat(src->path, &st) == -1)
+		{
+			STOPIF_CODE_ERR( errno != ENOENT, errno,
+					"Cannot get data of \"%s\"", src->path);
+			if (src->data) changed=1;
+			src->data=NULL;
+		}
+		else
+		{
+			hlp__copy_stats(&st, &sst);
+			if (!snap___is_current(src, &sst))
+			{
+				DEBUGP("%s changed", src->path);
+				changed=1;
+				tmp=*src;
+				status=snap___read_file(src->path, &tmp);
+				if (status == ENOENT) 
+				{
+					tmp.data=NULL;
+					status=0;
+				}
+				STOPIF(status, NULL);
+				*src=tmp;
+			}
+		}
+
+add_size:
+		count++;
+		size += sizeof(*rec) + strlen(src->path)+1 +
+			(src->data ? src->len+1 : 0);
+	}
+
+	if (!changed)
+	{
+		DEBUGP("snapshot up-to-date");
+		goto ex;
+	}
+
+	STOPIF( hlp__calloc( &buffer, size, 1), NULL);
+	hdr=(struct snap___header_t*)buffer;
+	memcpy(hdr->magic, snap___magic, sizeof(hdr->magic));
+	hdr->count=count;
+	hdr->record_size=sizeof(*rec);
+
+	rec=(struct snap___rec_t*)(hdr+1);
+	cp=(char*)(rec+count);
+	for(i=0; i<snap___count; i++)
+	{
+		src=snap___list+i;
+		rec->path_off=cp-buffer;
+		strcpy(cp, src->path);
+		cp+=strlen(cp)+1;
+
+		rec->is_absent= !src->data;
+		if (src->data)
+		{
+			rec->dev=src->st.dev;
+			rec->ino=src->st.ino;
+			rec->size=src->len;
+			rec->mtime_sec=src->st.mtim.tv_sec;
+			rec->mtime_nsec=src->st.mtim.tv_nsec;
+			rec->data_off=cp-buffer;
+			memcpy(cp, src->data, src->len);
+			cp+=src->len+1;
+		}
+		rec++;
+	}
+	BUG_ON(cp-buffer != size);
+
+	DEBUGP("writing snapshot with %d sources", count);
+	STOPIF( waa__open_byext(wc_path, WAA__SNAPSHOT_EXT, WAA__WRITE, &fh),
+			NULL);
+	STOPIF_CODE_ERR( write(fh, buffer, size) != (ssize_t)size, errno,
+			"Cannot write the snapshot");
+
+ex:
+	if (fh != -1)
+	{
+		i=waa__close(fh, status);
+		fh=-1;
+		STOPIF_CODE_ERR( i && !status, i, NULL);
+	}
+	IF_FREE(buffer);
+	return status;
+}
+
@@ -0,0 +1,34 @@
+/************************************************************************
+ * Copyright (C) 2009 Philipp Marek.
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ ************************************************************************/
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <stdio.h>
+
+/** \file
+ * Snapshot of the configuration files header file. */
+
+/** Maps the \ref snap file of the current working copy. */
+int snap__load(void);
+/** Writes the \ref snap file, if something changed. */
+int snap__save(void);
+
+/** Returns the contents of the file \a path, possibly from the snapshot.
+ * */
+int snap__read(const char *path, char **data, size_t *len);
+/** Like snap__read(), but for a file in the WAA or CONF area. */
+int snap__read_byext(const char *dir, const char *extension,
+		char **data, size_t *len);
+/** Returns a \c FILE* for reading \a path, possibly from the snapshot. */
+int snap__fopen(const char *path, FILE **fp);
+/** Like snap__fopen(), but for a file in the WAA or CONF area. */
+int snap__fopen_byext(const char *dir, const char *extension, FILE **fp);
+
+#endif
+
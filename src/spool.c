@@ -0,0 +1,706 @@
+/************************************************************************
+ * Copyright (C) 2009 Philipp Marek.
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ ************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "global.h"
+#include "waa.h"
+#include "helper.h"
+#include "est_ops.h"
+#include "options.h"
+#include "actions.h"
+#include "commit.h"
+#include "spool.h"
+
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
+
+
+/** \file
+ * Local commit spool and the \ref push action.
+ *
+ * With the \ref o_commit_local option a \ref commit doesn't talk to the
+ * repository; instead the changed entries are stored in the \ref spool
+ * directory of the WAA, and the command returns.
+ *
+ * Each spooled commit is a directory, numbered in ascending order; it
+ * has
+ * - a file \c msg with the commit message,
+ * - a file \c list with a line per entry (status, \c lstat() data, the
+ *   name of the data copy and the path), and
+ * - copies of the changed files and symlinks, named \c d0, \c d1, ...
+ *
+ * The file copies are done via \c FICLONE (a reflink) where the
+ * filesystem supports that, so they cost nearly nothing.
+ *
+ * A commit is built under a temporary name and renamed when it's
+ * complete, so \ref push sees only finished commits.
+ *
+ * \ref push does a normal commit for each spooled commit, in order; but
+ * takes the data and \c lstat() values from the spool, so later changes
+ * in the working copy are not sent. As \c ci__work() isn't written to be
+ * called twice in a process, each commit is done in a child process.
+ *
+ * The working copy itself is not changed by a local commit; so \ref
+ * status still shows the entries as changed, until they are pushed.
+ * */
+
+/** \addtogroup cmds
+ *
+ * \section push
+ *
+ * \code
+ * fsvs push [working copy base]
+ * \endcode
+ *
+ * Sends the commits that were stored locally (see \ref o_commit_local)
+ * to the repository, in the order they were made.
+ *
+ * The data that is sent is the one from the time of the local commit;
+ * changes done afterwards are shown by \ref status as usual, and can be
+ * committed later.
+ *
+ * If a commit fails (eg. because the network is down), it is tried again
+ * after a delay; see \ref o_push_retries. A commit that was pushed is
+ * removed from the spool.
+ *
+ * This command can be run in the background, eg. via \c cron, while
+ * the working copy is being used; only one process at a time can commit,
+ * though.
+ *
+ * As long as there are local commits that are not pushed, a normal \ref
+ * commit is refused - it might be overwritten by the older data.
+ * */
+
+
+/** The seconds before the first retry of a failed push; doubled for each
+ * further try. */
+#define SPL___RETRY_DELAY (10)
+/** The maximum delay between two tries. */
+#define SPL___MAX_DELAY (600)
+
+
+/** The spool directory of the current working copy. */
+static char *spl___dir=NULL;
+/** The commit being pushed by this process; \c NULL if none. */
+static char *spl___record=NULL;
+/** The entries of the commit being pushed. */
+static struct spl__entry_t *spl___list=NULL;
+/** Number of entries in \ref spl___list. */
+static int spl___count=0;
+/** Number of entries written by spl__write(). */
+static int spl___written;
+
+
+/** Returns the spool directory of the current working copy in \a dir.
+ * */
+static int spl___get_dir(char **dir)
+{
+	int status;
+	char *path, *eos;
+
+
+	status=0;
+	if (!spl___dir)
+	{
+		STOPIF( waa__get_waa_directory(wc_path, &path, &eos, NULL, GWD_WAA),
+				NULL);
+		strcpy(eos, WAA__SPOOL_EXT);
+		STOPIF( hlp__strdup( &spl___dir, path), NULL);
+	}
+
+	*dir=spl___dir;
+
+ex:
+	return status;
+}
+
+
+/** Returns the number of spooled commits, and the lowest and highest
+ * number in use. */
+static int spl___scan(int *count, unsigned long *first,
+		unsigned long *last)
+{
+	int status;
+	DIR *dirp;
+	struct dirent *de;
+	char *dir, *cp;
+	unsigned long nr, lo, hi;
+
+
+	status=0;
+	dirp=NULL;
+	*count=0;
+	lo=hi=0;
+
+	STOPIF( spl___get_dir(&dir), NULL);
+	dirp=opendir(dir);
+	if (!dirp)
+	{
+		STOPIF_CODE_ERR( errno != ENOENT, errno,
+				"Cannot read spool directory %s", dir);
+		goto ex;
+	}
+
+	while ( (de=readdir(dirp)) )
+	{
+		/* Temporary directories and "." are not commits. */
+		nr=strtoul(de->d_name, &cp, 10);
+		if (*cp || cp == de->d_name) continue;
+
+		if (!*count || nr<lo) lo=nr;
+		if (!*count || nr>hi) hi=nr;
+		(*count)++;
+	}
+
+ex:
+	if (dirp) closedir(dirp);
+	if (first) *first=lo;
+	if (last) *last=hi;
+	return status;
+}
+
+
+/** Removes the directory \a dir, with the files in it. */
+static int spl___remove(char *dir)
+{
+	int status;
+	DIR *dirp;
+	struct dirent *de;
+	char fn[PATH_MAX];
+
+
+	status=0;
+	dirp=opendir(dir);
+	STOPIF_CODE_ERR( !dirp, errno, "Cannot read %s", dir);
+
+	while ( (de=readdir(dirp)) )
+	{
+		if (strcmp(de->d_name, ".") == 0 ||
+				strcmp(de->d_name, "..") == 0)
+			continue;
+
+		snprintf(fn, sizeof(fn), "%s%c%s", dir, PATH_SEPARATOR, de->d_name);
+		STOPIF_CODE_ERR( unlink(fn) == -1, errno, "Cannot remove %s", fn);
+	}
+
+	STOPIF_CODE_ERR( rmdir(dir) == -1, errno, "Cannot remove %s", dir);
+
+ex:
+	if (dirp) closedir(dirp);
+	return status;
+}
+
+
+/** Copies \a src to \a dest.
+ *
+ * For regular files \a st is updated from the opened file, so that the
+ * data and the stored \c lstat() values match. */
+static int spl___copy(char *src, char *dest, struct sstat_t *st)
+{
+	int status;
+	int in, out;
+	ssize_t len;
+	char buffer[16384];
+
+
+	status=0;
+	in=out=-1;
+
+	if (S_ISLNK(st->mode))
+	{
+		len=readlink(src, buffer, sizeof(buffer)-1);
+		STOPIF_CODE_ERR( len == -1, errno, "can't read link %s", src);
+		buffer[len]=0;
+
+		STOPIF_CODE_ERR( symlink(buffer, dest) == -1, errno,
+				"Cannot create %s", dest);
+		goto ex;
+	}
+
+	in=open(src, O_RDONLY);
+	STOPIF_CODE_ERR( in == -1, errno, "Cannot open %s", src);
+	STOPIF( hlp__fstat(in, st), NULL);
+
+	out=open(dest, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	STOPIF_CODE_ERR( out == -1, errno, "Cannot create %s", dest);
+
+#ifdef FICLONE
+	/* Sharing the blocks is much faster, and needs no space. */
+	if (ioctl(out, FICLONE, in) == 0)
+		DEBUGP("reflinked %s", src);
+	else
+#endif
+	{
+		DEBUGP("copying %s", src);
+		while ( (len=read(in, buffer, sizeof(buffer))) > 0)
+			STOPIF_CODE_ERR( write(out, buffer, len) != len, errno,
+					"Cannot write %s", dest);
+		STOPIF_CODE_ERR( len == -1, errno, "Cannot read %s", src);
+	}
+
+	len=close(out);
+	out=-1;
+	STOPIF_CODE_ERR( len == -1, errno, "Cannot write %s", dest);
+
+ex:
+	if (in != -1) close(in);
+	if (out != -1) close(out);
+	return status;
+}
+
+
+/** Stores the changed entries below \a dir into the \a list, and the
+ * data into the directory \a record. */
+static int spl___add_dir(struct estat *dir, char *record, FILE *list)
+{
+	int status;
+	uint32_t i;
+	struct estat *sts;
+	struct sstat_t st;
+	char *path, data[16], fn[PATH_MAX];
+
+
+	status=0;
+	for(i=0; i<dir->entry_count; i++)
+	{
+		sts=dir->by_inode[i];
+
+		/* Same selection as in ci__directory(). */
+		if (!( (sts->flags & RF___COMMIT_MASK) && sts->do_this_entry) &&
+				!(sts->entry_status & ~FS_CHILD_CHANGED))
+			goto children;
+
+		STOPIF( ops__build_path(&path, sts), NULL);
+
+		strcpy(data, "-");
+		st=sts->st;
+		if (!(sts->entry_status & FS_REMOVED) &&
+				!(sts->flags & RF_UNVERSION))
+		{
+			if (hlp__lstat(path, &st))
+			{
+				STOPIF_CODE_ERR( sts->flags & RF_ADD, ENOENT,
+						"Entry %s should be added, but doesn't exist.", path);
+
+				DEBUGP("%s doesn't exist, ignoring", path);
+				continue;
+			}
+
+			if (S_ISREG(st.mode) || S_ISLNK(st.mode))
+			{
+				sprintf(data, "d%d", spl___written);
+				snprintf(fn, sizeof(fn), "%s%c%s", record, PATH_SEPARATOR, data);
+				STOPIF( spl___copy(path, fn, &st), NULL);
+			}
+		}
+
+		STOPIF_CODE_ERR( fprintf(list, "%X %o %llu %llu %llu %llu %llu "
+					"%llu %llu %llu %llu %s %s%c\n",
+					sts->entry_status & ~(FS_CHILD_CHANGED | FS_LIKELY),
+					(unsigned)st.mode, (t_ull)st.uid, (t_ull)st.gid,
+					(t_ull)st.size, (t_ull)st.dev, (t_ull)st.ino,
+					(t_ull)st.mtim.tv_sec, (t_ull)st.mtim.tv_nsec,
+					(t_ull)st.ctim.tv_sec, (t_ull)st.ctim.tv_nsec,
+					data, path, 0) < 0, errno,
+				"Cannot write the spool list");
+		spl___written++;
+
+		/* A removed directory is removed with its children. */
+		if ((sts->entry_status & FS_REMOVED) ||
+				(sts->flags & RF_UNVERSION))
+			continue;
+
+children:
+		if (S_ISDIR(sts->st.mode) &&
+				(sts->entry_status & FS_CHILD_CHANGED))
+			STOPIF( spl___add_dir(sts, record, list), NULL);
+	}
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * \a root must have been read via waa__read_or_build_tree(), like for a
+ * normal commit. */
+int spl__write(struct estat *root, const char *message)
+{
+	int status, count, fh;
+	unsigned long last;
+	char *dir, tmp[PATH_MAX], dest[PATH_MAX], fn[PATH_MAX];
+	FILE *list;
+	size_t len;
+
+
+	status=0;
+	list=NULL;
+	fh=-1;
+	tmp[0]=0;
+
+	STOPIF( spl___scan(&count, NULL, &last), NULL);
+	STOPIF( spl___get_dir(&dir), NULL);
+	STOPIF( waa__mkdir(dir, 1), NULL);
+
+	/* Built under a temporary name, so that push never sees a partial
+	 * commit. */
+	snprintf(tmp, sizeof(tmp), "%s%ctmp-%llu",
+			dir, PATH_SEPARATOR, (t_ull)getpid());
+	STOPIF_CODE_ERR( mkdir(tmp, 0700) == -1, errno,
+			"Cannot create %s", tmp);
+
+	snprintf(fn, sizeof(fn), "%s%cmsg", tmp, PATH_SEPARATOR);
+	fh=open(fn, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	STOPIF_CODE_ERR( fh == -1, errno, "Cannot create %s", fn);
+	len=strlen(message);
+	STOPIF_CODE_ERR( write(fh, message, len) != (ssize_t)len ||
+			close(fh) == -1, errno, "Cannot write %s", fn);
+	fh=-1;
+
+	snprintf(fn, sizeof(fn), "%s%clist", tmp, PATH_SEPARATOR);
+	list=fopen(fn, "w");
+	STOPIF_CODE_ERR( !list, errno, "Cannot create %s", fn);
+
+	spl___written=0;
+	STOPIF( spl___add_dir(root, tmp, list), NULL);
+
+	STOPIF_CODE_ERR( fclose(list) == EOF, errno, "Cannot write %s", fn);
+	list=NULL;
+
+	snprintf(dest, sizeof(dest), "%s%c%08lu",
+			dir, PATH_SEPARATOR, count ? last+1 : 1);
+	STOPIF_CODE_ERR( rename(tmp, dest) == -1, errno,
+			"Cannot rename %s to %s", tmp, dest);
+	tmp[0]=0;
+
+	if (opt__verbosity() > VERBOSITY_VERYQUIET)
+		printf("Stored %d entries as local commit %08lu.\n",
+				spl___written, count ? last+1 : 1);
+
+ex:
+	if (fh != -1) close(fh);
+	if (list) fclose(list);
+	/* Don't leave a partial commit behind. */
+	if (status && tmp[0])
+		spl___remove(tmp);
+	return status;
+}
+
+
+/** -. */
+int spl__count(int *count)
+{
+	return spl___scan(count, NULL, NULL);
+}
+
+
+/** -. */
+int spl__active(void)
+{
+	return spl___record != NULL;
+}
+
+
+/** Reads the \c list of the spooled commit \a spl___record. */
+static int spl___load(void)
+{
+	int status, fh, i, pos;
+	char fn[PATH_MAX], data[16];
+	char *buffer, *cp, *eol;
+	struct stat st;
+	struct spl__entry_t *ent;
+	unsigned es, mode;
+	t_ull uid, gid, size, dev, ino, m_s, m_ns, c_s, c_ns;
+
+
+	status=0;
+	fh=-1;
+	buffer=NULL;
+
+	snprintf(fn, sizeof(fn), "%s%clist", spl___record, PATH_SEPARATOR);
+	fh=open(fn, O_RDONLY);
+	STOPIF_CODE_ERR( fh == -1, errno, "Cannot open %s", fn);
+	STOPIF_CODE_ERR( fstat(fh, &st) == -1, errno, "Cannot stat %s", fn);
+
+	STOPIF( hlp__alloc( &buffer, st.st_size+1), NULL);
+	STOPIF_CODE_ERR( read(fh, buffer, st.st_size) != st.st_size, errno,
+			"Cannot read %s", fn);
+	buffer[st.st_size]=0;
+
+	/* Each line ends with "\0\n"; count them for the allocation. */
+	spl___count=0;
+	for(cp=buffer; cp < buffer+st.st_size; cp++)
+		if (!cp[0] && cp[1] == '\n') spl___count++;
+
+	STOPIF( hlp__calloc( &spl___list, spl___count+1, sizeof(*spl___list)),
+			NULL);
+
+	cp=buffer;
+	for(i=0; i<spl___count; i++)
+	{
+		ent=spl___list+i;
+		eol=cp+strlen(cp);
+
+		STOPIF_CODE_ERR( sscanf(cp, "%X %o %llu %llu %llu %llu %llu "
+					"%llu %llu %llu %llu %15s %n",
+					&es, &mode, &uid, &gid, &size, &dev, &ino,
+					&m_s, &m_ns, &c_s, &c_ns, data, &pos) != 12, EINVAL,
+				"!Invalid line %d in %s", i+1, fn);
+
+		ent->entry_status=es;
+		ent->st.mode=mode;
+		ent->st.uid=uid;
+		ent->st.gid=gid;
+		ent->st.size=size;
+		ent->st.dev=dev;
+		ent->st.ino=ino;
+		ent->st.mtim.tv_sec=m_s;
+		ent->st.mtim.tv_nsec=m_ns;
+		ent->st.ctim.tv_sec=c_s;
+		ent->st.ctim.tv_nsec=c_ns;
+		ent->path=cp+pos;
+
+		if (strcmp(data, "-") != 0)
+			STOPIF( hlp__strmnalloc( strlen(spl___record)+1+strlen(data)+1,
+						&ent->data, spl___record, "/", data, NULL), NULL);
+
+		/* The buffer is kept, the paths point into it. */
+		cp=eol+2;
+	}
+	buffer=NULL;
+
+ex:
+	if (fh != -1) close(fh);
+	IF_FREE(buffer);
+	return status;
+}
+
+
+/** Pushes the spooled commit number \a nr.
+ * Runs in the child process; the commit is done as if it had been given
+ * on the command line, with the spooled entries as arguments. */
+static int spl___replay(struct estat *root, unsigned long nr)
+{
+	int status, i;
+	char *dir, **args;
+
+
+	STOPIF( spl___get_dir(&dir), NULL);
+	STOPIF( hlp__strnalloc( strlen(dir)+1+16, &spl___record, NULL), NULL);
+	sprintf(spl___record, "%s%c%08lu", dir, PATH_SEPARATOR, nr);
+
+	STOPIF( spl___load(), NULL);
+
+	/* Absolute paths, as the relative ones would be taken from the
+	 * starting directory. */
+	STOPIF( hlp__calloc( &args, spl___count+1, sizeof(*args)), NULL);
+	for(i=0; i<spl___count; i++)
+		STOPIF( hlp__strmnalloc( wc_path_len + strlen(spl___list[i].path),
+					args+i, wc_path, spl___list[i].path+1, NULL), NULL);
+
+	STOPIF( hlp__strmnalloc( strlen(spl___record)+5,
+				&opt_commitmsgfile, spl___record, "/msg", NULL), NULL);
+	opt_commitmsg=NULL;
+
+	/* Only the given entries, not their children. */
+	opt_recursive=-1;
+	root->arg=NULL;
+
+	STOPIF( act__find_action_by_name("commit", &action), NULL);
+
+	if (opt__verbosity() > VERBOSITY_VERYQUIET)
+		printf("Pushing local commit %08lu.\n", nr);
+
+	STOPIF( ci__work(root, spl___count, args), NULL);
+
+ex:
+	return status;
+}
+
+
+/** Comparison function for the estat pointers of \ref spl___list. */
+static int spl___compare(const void *a, const void *b)
+{
+	const struct spl__entry_t *x=a, *y=b;
+
+	if (x->sts == y->sts) return 0;
+	return x->sts < y->sts ? -1 : 1;
+}
+
+
+/** -.
+ * The entries get the status they had at the time of the local commit,
+ * so that they are sent even if they were changed back in the meantime.
+ *
+ * But that status was relative to the WAA at that time; as a local commit
+ * doesn't change the WAA, a new file is recorded as new in every local
+ * commit until the first of them is pushed. So the status is adjusted to
+ * the current WAA data:
+ * - entries that are versioned by now are not added again, but sent as
+ *   changed;
+ * - entries that were removed by an earlier push are skipped.
+ * */
+int spl__apply(struct estat *root)
+{
+	int status, i, versioned, es;
+	struct spl__entry_t *ent;
+	struct estat *sts;
+
+
+	status=0;
+	/* We hold the lock now; another push might have been faster. */
+	STOPIF_CODE_ERR( access(spl___record, F_OK) == -1, errno,
+			"!The local commit %s has already been pushed.", spl___record);
+
+	for(i=0; i<spl___count; i++)
+	{
+		ent=spl___list+i;
+		es=ent->entry_status;
+
+		status=ops__traverse(root, ent->path, 0, 0, &sts);
+		if (status == ENOENT && (es & FS_REMOVED))
+		{
+			DEBUGP("%s is already removed", ent->path);
+			status=0;
+			continue;
+		}
+		STOPIF( status, 
+				"!The entry \"%s\" of the local commit is gone.", ent->path);
+
+		ent->sts=sts;
+		versioned= sts->repos_rev && !(sts->flags & RF_ISNEW);
+
+		if (versioned && (es & FS_REPLACED) == FS_NEW)
+		{
+			/* Added by an earlier local commit that has been pushed since; the 
+			 * data might be different now, though. */
+			DEBUGP("%s is versioned now", ent->path);
+			es = (es & ~FS_NEW) | FS_META_CHANGED;
+			if (!S_ISDIR(ent->st.mode)) es |= FS_CHANGED;
+			sts->flags &= ~RF_ADD;
+		}
+		else if (!versioned && (es & FS_REPLACED) == FS_REMOVED)
+		{
+			/* Never committed, so there's nothing to remove. */
+			DEBUGP("%s was never committed", ent->path);
+			sts->entry_status=FS_NO_CHANGE;
+			continue;
+		}
+
+		sts->entry_status = es | (sts->entry_status & FS_CHILD_CHANGED);
+		ops__mark_parent_cc(sts, entry_status);
+	}
+
+	qsort(spl___list, spl___count, sizeof(*spl___list), spl___compare);
+
+ex:
+	return status;
+}
+
+
+/** -. */
+struct spl__entry_t *spl__find(struct estat *sts)
+{
+	struct spl__entry_t key;
+
+	if (!spl___count) return NULL;
+
+	key.sts=sts;
+	return bsearch(&key, spl___list, spl___count, sizeof(*spl___list),
+			spl___compare);
+}
+
+
+/** -. */
+int spl__done(void)
+{
+	int status;
+
+	STOPIF( spl___remove(spl___record), NULL);
+	DEBUGP("pushed %s", spl___record);
+
+ex:
+	return status;
+}
+
+
+/** -.
+ *
+ * Each spooled commit is done by a child process; the child returns from
+ * here through \c main(), so the normal cleanup is done for it.  */
+int spl__push(struct estat *root, int argc, char *argv[])
+{
+	int status, count, tries, delay, child_status;
+	unsigned long nr, pushed, now;
+	pid_t pid;
+
+
+	status=0;
+	STOPIF( waa__find_base(root, &argc, &argv), NULL);
+
+	tries=0;
+	pushed=0;
+	while (1)
+	{
+		STOPIF( spl___scan(&count, &nr, NULL), NULL);
+		if (!count) break;
+
+		STOPIF_CODE_ERR( nr == pushed, EINVAL,
+				"The local commit %08lu wasn't removed after pushing.", nr);
+
+		/* Else the buffered output would be printed twice. */
+		fflush(NULL);
+		pid=fork();
+		STOPIF_CODE_ERR( pid == -1, errno, "Cannot fork");
+
+		if (pid == 0)
+		{
+			STOPIF( spl___replay(root, nr), NULL);
+			goto ex;
+		}
+
+		STOPIF_CODE_ERR( waitpid(pid, &child_status, 0) == -1, errno,
+				"Waiting for the commit process failed");
+
+		if (WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0)
+		{
+			pushed=nr;
+			tries=0;
+			continue;
+		}
+
+		/* If another process pushed that commit, just take the next one. */
+		STOPIF( spl___scan(&count, &now, NULL), NULL);
+		if (!count || now != nr) continue;
+
+		tries++;
+		STOPIF_CODE_ERR( tries > opt__get_int(OPT__PUSH_RETRIES), EAGAIN,
+				"!Pushing the local commit %08lu failed; it is kept for later.",
+				nr);
+
+		delay= tries > 8 ? SPL___MAX_DELAY : SPL___RETRY_DELAY << (tries-1);
+		if (delay > SPL___MAX_DELAY) delay=SPL___MAX_DELAY;
+		if (opt__verbosity() > VERBOSITY_VERYQUIET)
+			printf("Trying again in %d seconds.\n", delay);
+		sleep(delay);
+	}
+
+ex:
+	return status;
+}
+
@@ -0,0 +1,52 @@
+/************************************************************************
+ * Copyright (C) 2009 Philipp Marek.
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ ************************************************************************/
+
+#ifndef __SPOOL_H__
+#define __SPOOL_H__
+
+#include "global.h"
+#include "actions.h"
+
+/** \file
+ * Local commit spool header file. */
+
+/** An entry of the spooled commit that is being pushed. */
+struct spl__entry_t
+{
+	/** The entry in the tree, after spl__apply(). */
+	struct estat *sts;
+	/** The \c lstat() data at the time of the local commit. */
+	struct sstat_t st;
+	/** The estat::entry_status at the time of the local commit. */
+	int entry_status;
+	/** Path of the copied data in the spool; \c NULL if there is none. */
+	char *data;
+	/** The wc-relative path. */
+	char *path;
+};
+
+
+/** The \ref push action. */
+work_t spl__push;
+
+/** Stores the changes in \a root into a new spooled commit. */
+int spl__write(struct estat *root, const char *message);
+/** Returns the number of spooled commits for the current working copy. */
+int spl__count(int *count);
+
+/** Whether a spooled commit is being pushed by this process. */
+int spl__active(void);
+/** Sets the status of the spooled entries in \a root. */
+int spl__apply(struct estat *root);
+/** Returns the spooled data for \a sts, or \c NULL. */
+struct spl__entry_t *spl__find(struct estat *sts);
+/** Removes the spooled commit after it has been committed. */
+int spl__done(void);
+
+#endif
+
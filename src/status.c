@@ -10,6 +10,7 @@
 #include <unistd.h>
 #include <time.h>
 #include <assert.h>
+#include <sys/wait.h>
 
 #include "global.h"
 #include "actions.h"
@@ -24,7 +25,9 @@
 #include "est_ops.h"
 #include "waa.h"
 #include "checksum.h"
+#include "warnings.h"
 #include "url.h"
+#include "hot.h"
 
 
 /** \file
@@ -100,6 +103,9 @@
  * Furthermore please take a look at the \ref o_status_color "stat_color" 
  * option, and for more information about displayed data the \ref o_verbose 
  * "verbose" option.
+ *
+ * To check many working copies in a single run see the \ref o_wc_list 
+ * "wc_list" option.
  * */
 
 
@@ -384,11 +390,10 @@ ex:
 }
 
 
-/** -.
- * */
-int st__work(struct estat *root, int argc, char *argv[])
+/** Does the status run for a single working copy. */
+static int st___work_single(struct estat *root, int argc, char *argv[])
 {
-	int status;
+	int status, changed, whole_wc;
 	char **normalized;
 
 
@@ -406,6 +411,36 @@ int st__work(struct estat *root, int argc, char *argv[])
 
 	STOPIF( ign__load_list(NULL), NULL);
 
+	/* The whole working copy, not just the current directory. */
+	whole_wc= !argc && normalized[0] && strcmp(normalized[0], ".") == 0;
+
+	/* Look at the often changed entries before reading the whole tree. */
+	if (opt__get_int(OPT__STOP_ON_CHANGE) &&
+			opt__get_int(OPT__HOT_FIRST) == OPT__YES &&
+			whole_wc && opt__get_int(OPT__FILTER) == FILTER__ALL)
+	{
+		STOPIF( hot__check(&changed), NULL);
+		/* Same as in st__action(). */
+		if (changed)
+			exit(1);
+	}
+
+	if (opt__get_int(OPT__DEADLINE) > 0)
+	{
+		waa__deadline=hlp__usec_now() + 
+			opt__get_int(OPT__DEADLINE) * 1000000LL;
+
+		/* The list is about the whole working copy; in a subdirectory it 
+		 * may neither be used nor changed. */
+		if (!whole_wc)
+			opt__set_int(OPT__DEADLINE_RESUME, PRIO_MUSTHAVE, OPT__NO);
+		else if (opt__get_int(OPT__DEADLINE_RESUME) == OPT__YES)
+		{
+			STOPIF( waa__deadline_list(&argc, &normalized), NULL);
+			argv=normalized;
+		}
+	}
+
 	if (opt__get_int(OPT__DIR_SORT) && 
 			!opt__get_int(OPT__STOP_ON_CHANGE))
 	{
@@ -423,6 +458,13 @@ int st__work(struct estat *root, int argc, char *argv[])
 		STOPIF( waa__do_sorted_tree(root, ac__dispatch), NULL);
 	}
 
+	if (waa__unchecked)
+		printf("incomplete, %d entries unchecked\n", waa__unchecked);
+	else if (opt__get_int(OPT__DEADLINE) > 0 &&
+			opt__get_int(OPT__DEADLINE_RESUME) == OPT__YES)
+		/* Finished in time, so the next run starts from the top again. */
+		STOPIF( waa__delete_byext(wc_path, WAA__DEADLINE_EXT, 1), NULL);
+
 	if (opt__get_int(OPT__GROUP_STATS))
 		STOPIF( ign__print_group_stats(stdout), NULL);
 
@@ -431,6 +473,239 @@ ex:
 }
 
 
+/** Per working copy data for \ref o_wc_list "wc_list" processing. */
+struct st___wc_job_t {
+	/** The path as given in the list. */
+	char *path;
+	/** Where the child writes its status output to. */
+	FILE *output;
+	/** Child process, or \c 0 if not started yet. */
+	pid_t pid;
+	/** Exit code of the child. */
+	int exit_code;
+	/** Whether the child has finished. */
+	int done;
+};
+
+
+/** The work of a child process started by st___wc_job_start().
+ * Returns an error code instead of exiting, so that the caller can end 
+ * the process. */
+static int st___wc_job_child(struct estat *root, struct st___wc_job_t *job)
+{
+	int status;
+	char *args[2];
+
+
+	status=0;
+	STOPIF_CODE_ERR( dup2(fileno(job->output), STDOUT_FILENO) == -1, 
+			errno, "Cannot dup2");
+
+	args[0]=job->path;
+	args[1]=NULL;
+	STOPIF( st___work_single(root, 1, args), NULL);
+	STOPIF( wa__summary(), NULL);
+
+ex:
+	return status;
+}
+
+
+/** Runs the status for one working copy in a child process.
+ * The child inherits the already initialized libraries and settings; its 
+ * \c STDOUT goes into an unlinked temporary file, so that the output of 
+ * several concurrent children doesn't get mixed up. */
+static int st___wc_job_start(struct estat *root, struct st___wc_job_t *job)
+{
+	int status;
+
+
+	status=0;
+	job->output=tmpfile();
+	STOPIF_CODE_ERR( !job->output, errno, 
+			"Cannot create temporary file for the output of \"%s\"", job->path);
+
+	/* Don't give the buffered data to the child, too. */
+	fflush(NULL);
+
+	job->pid=fork();
+	STOPIF_CODE_ERR( job->pid == -1, errno, "Cannot fork()");
+
+	if (job->pid == 0)
+	{
+		/* Child. It must never get back into the loop of the parent, so 
+		 * every way out ends here. */
+		status=st___wc_job_child(root, job);
+		fflush(NULL);
+		_exit(status ? 2 : 0);
+	}
+
+	DEBUGP("started %llu for %s", (t_ull)job->pid, job->path);
+
+ex:
+	return status;
+}
+
+
+/** Prints the collected output of a finished working copy, with a header 
+ * line and (if not successful) the exit code. */
+static int st___wc_job_print(struct st___wc_job_t *job)
+{
+	int status;
+	char buffer[4096];
+	size_t len;
+
+
+	status=0;
+	STOPIF_CODE_EPIPE( printf("# %s\n", job->path), NULL);
+
+	rewind(job->output);
+	while ( (len=fread(buffer, 1, sizeof(buffer), job->output)) > 0)
+		STOPIF_CODE_EPIPE( fwrite(buffer, 1, len, stdout) == len ? 0 : -1, 
+				NULL);
+
+	if (job->exit_code)
+		STOPIF_CODE_EPIPE( printf("# %s: exit code %d\n", 
+					job->path, job->exit_code), NULL);
+
+	fclose(job->output);
+	job->output=NULL;
+
+ex:
+	return status;
+}
+
+
+/** Status for all working copies given in the \ref o_wc_list "wc_list" 
+ * file.
+ *
+ * The libraries, the configuration and the kernel caches are shared; each 
+ * working copy is handled by a child process, with at most \ref 
+ * o_wc_list "wc_list_jobs" running at the same time.
+ * The output is printed in the order of the list. */
+static int st___work_wc_list(struct estat *root)
+{
+	int status;
+	FILE *input;
+	char *cp;
+	const char *list_fn;
+	struct st___wc_job_t *jobs;
+	int count, max, i, started, printed, running, parallel;
+	int failed, changed, ret;
+	pid_t pid;
+
+
+	input=NULL;
+	jobs=NULL;
+	count=max=0;
+
+	list_fn=opt__get_string(OPT__WC_LIST);
+	if (strcmp(list_fn, "-") == 0)
+		input=stdin;
+	else
+	{
+		input=fopen(list_fn, "r");
+		STOPIF_CODE_ERR( !input, errno, 
+				"!Cannot open the working copy list \"%s\"", list_fn);
+	}
+
+	hlp__string_from_filep(NULL, NULL, NULL, SFF_RESET_LINENUM);
+	while (1)
+	{
+		status=hlp__string_from_filep(input, &cp, NULL, 
+				SFF_WHITESPACE | SFF_COMMENT);
+		if (status == EOF) break;
+		STOPIF( status, "Reading the working copy list");
+
+		if (count >= max)
+		{
+			max = max*2 + 16;
+			STOPIF( hlp__realloc( &jobs, max*sizeof(*jobs)), NULL);
+		}
+
+		memset(jobs+count, 0, sizeof(*jobs));
+		STOPIF( hlp__strdup( &jobs[count].path, cp), NULL);
+		count++;
+	}
+	status=0;
+	DEBUGP("%d working copies found", count);
+
+
+	parallel=opt__get_int(OPT__WC_LIST_JOBS);
+	if (parallel < 1) parallel=1;
+
+	started=printed=running=0;
+	failed=changed=0;
+	while (printed < count)
+	{
+		while (running < parallel && started < count)
+		{
+			STOPIF( st___wc_job_start(root, jobs+started), NULL);
+			started++;
+			running++;
+		}
+
+		pid=waitpid(-1, &ret, 0);
+		STOPIF_CODE_ERR( pid == -1, errno, "waitpid");
+
+		for(i=0; i<started; i++)
+			if (jobs[i].pid == pid) break;
+		/* Not one of ours? */
+		if (i == started) continue;
+
+		jobs[i].done=1;
+		jobs[i].exit_code = WIFEXITED(ret) ? WEXITSTATUS(ret) : 2;
+		running--;
+
+		DEBUGP("%s returned %d", jobs[i].path, jobs[i].exit_code);
+		if (jobs[i].exit_code == 1) 
+			changed++;
+		else if (jobs[i].exit_code)
+			failed++;
+
+		/* Print everything that's finished, in the given order. */
+		while (printed < count && jobs[printed].done)
+		{
+			STOPIF( st___wc_job_print(jobs+printed), NULL);
+			printed++;
+		}
+	}
+
+	STOPIF_CODE_ERR( failed, ECHILD, 
+			"!%d of %d working copies could not be checked.", failed, count);
+
+	/* Same behaviour as for a single working copy. */
+	if (changed && opt__get_int(OPT__STOP_ON_CHANGE))
+		exit(1);
+
+ex:
+	if (input && input != stdin) fclose(input);
+	return status;
+}
+
+
+/** -.
+ * */
+int st__work(struct estat *root, int argc, char *argv[])
+{
+	int status;
+
+
+	status=0;
+	if (opt__get_string(OPT__WC_LIST))
+	{
+		STOPIF_CODE_ERR( argc, EINVAL,
+				"!The \"wc_list\" option cannot be combined with paths.");
+		STOPIF( st___work_wc_list(root), NULL);
+	}
+	else
+		STOPIF( st___work_single(root, argc, argv), NULL);
+
+ex:
+	return status;
+}
+
+
 #define BAR_CHART_WIDTH 20
 /** -.
  * A secondary status function for commit and update (and other functions
@@ -456,6 +731,7 @@ int st__progress(struct estat *sts)
 
 
 	status=0;
+	STOPIF( st__progress_file(sts, 1), NULL);
 	now=time(NULL);
 
 	/* gcc won't let us initialize that - it's not a constant. */
@@ -580,6 +856,159 @@ ex:
 }
 
 
+/** \name Progress file
+ * See \ref o_progress_file.
+ * @{ */
+/** -. */
+t_ull st__bytes_hashed=0,
+			/** -. */
+			st__bytes_sent=0,
+			/** -. */
+			st__bytes_received=0;
+/** Number of entries done. */
+static unsigned st___entries_done=0;
+/** When the progress file was last written; the start time is taken on 
+ * the first call. */
+static time_t st___progress_last=0, st___progress_start=0;
+
+
+/** Writes the progress file.
+ *
+ * A temporary file gets written and renamed, so that readers always see 
+ * complete data. */
+static int st___progress_write(const char *fn, struct estat *sts, 
+		const char *state, time_t now)
+{
+	int status;
+	FILE *output;
+	char *tmp, *path;
+	time_t elapsed;
+	double rate;
+
+
+	status=0;
+	output=NULL;
+	tmp=NULL;
+	STOPIF( hlp__strmnalloc( strlen(fn)+5, &tmp, fn, ".tmp", NULL), NULL);
+
+	path="";
+	if (sts)
+		STOPIF( ops__build_path(&path, sts), NULL);
+
+	elapsed=now-st___progress_start;
+	if (elapsed <= 0) elapsed=1;
+	rate=(double)st___entries_done/elapsed;
+
+	output=fopen(tmp, "w");
+	STOPIF_CODE_ERR( !output, errno, 
+			"Cannot write progress file \"%s\"", tmp);
+
+	status= fprintf(output, 
+			"pid: %llu\n"
+			"action: %s\n"
+			"state: %s\n"
+			"elapsed: %llu\n"
+			"entries_done: %u\n"
+			"entries_total: %u\n"
+			"entries_per_second: %.1f\n"
+			"bytes_hashed: %llu\n"
+			"bytes_hashed_per_second: %llu\n"
+			"bytes_sent: %llu\n"
+			"bytes_received: %llu\n",
+			(t_ull)getpid(), action->name[0], state,
+			(t_ull)elapsed,
+			st___entries_done, approx_entry_count,
+			rate,
+			st__bytes_hashed, st__bytes_hashed/elapsed,
+			st__bytes_sent, st__bytes_received) < 0;
+
+	/* The total is only an estimate; if it's exceeded we don't know. */
+	if (!status)
+	{
+		if (rate > 0 && st___entries_done < approx_entry_count)
+			status= fprintf(output, "eta: %llu\n", 
+					(t_ull)((approx_entry_count-st___entries_done)/rate)) < 0;
+		else
+			status= fprintf(output, "eta: unknown\n") < 0;
+	}
+	if (!status)
+		status= fprintf(output, "current: %s\n", path) < 0;
+
+	status |= fclose(output) == EOF;
+	output=NULL;
+	STOPIF_CODE_ERR( status, errno,
+			"Cannot write progress file \"%s\"", tmp);
+
+	STOPIF_CODE_ERR( rename(tmp, fn) == -1, errno,
+			"Cannot rename \"%s\" to \"%s\"", tmp, fn);
+
+ex:
+	if (output) fclose(output);
+	IF_FREE(tmp);
+	return status;
+}
+
+
+/** -.
+ * \a entries more entries are counted as done.
+ *
+ * As this is called for every entry, the time is looked at only every 64 
+ * entries; calls for byte counters (with \a entries \c 0) are rare enough 
+ * to check every time. The file is written at most once per second.  */
+int st__progress_file(struct estat *sts, int entries)
+{
+	int status;
+	const char *fn;
+	time_t now;
+
+
+	status=0;
+	fn=opt__get_string(OPT__PROGRESS_FILE);
+	if (!fn || !*fn) goto ex;
+
+	st___entries_done += entries;
+	if (entries && (st___entries_done & 0x3f)) goto ex;
+
+	now=time(NULL);
+	if (!st___progress_start)
+		st___progress_start=now;
+	if (now == st___progress_last) goto ex;
+
+	STOPIF( st___progress_write(fn, sts, "running", now), NULL);
+	st___progress_last=now;
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * Writes the final state (depending on \a has_failed) into the progress 
+ * file. */
+int st__progress_file_finish(int has_failed)
+{
+	int status;
+	const char *fn;
+	time_t now;
+
+
+	status=0;
+	fn=opt__get_string(OPT__PROGRESS_FILE);
+	if (!fn || !*fn) goto ex;
+
+	now=time(NULL);
+	if (!st___progress_start)
+		st___progress_start=now;
+
+	STOPIF( st___progress_write(fn, NULL, 
+				has_failed ? "failed" : "finished", now), NULL);
+
+ex:
+	return status;
+}
+/** @} */
+
+
 struct st___bit_info
 {
 	int val;
@@ -666,6 +1095,7 @@ volatile char* st__flags_string_fromint(int mask)
 		BIT_INFO( RF_COPY_SUB,	"copy_sub"),
 		BIT_INFO( RF_CONFLICT,	"conflict"),
 		BIT_INFO( RF_PUSHPROPS,	"push_props"),
+		BIT_INFO( RF_NO_BLOCKHASH,	"no_blockhash"),
 	};	
 
 	return st___string_from_bits(mask, flags, "none");
@@ -764,13 +1194,22 @@ int st__print_entry_info(struct estat *sts)
 	STOPIF_CODE_EPIPE( printf("   CTime:  \t%.24s\n", 
 				ctime( &(sts->st.ctim.tv_sec) )), NULL);
 
-	STOPIF( waa__get_waa_directory(path, &waa_path, NULL, NULL,
-				GWD_WAA), NULL);
-	STOPIF_CODE_EPIPE( printf("   WAA-Path:\t%s\n", 
-				waa_path), NULL);
+	/* The per-entry files are addressed by the entry ID; the path of the 
+	 * working copy root is the base for the other files. */
+	if (sts->entry_id)
+	{
+		STOPIF( waa__get_entry_directory(sts, &waa_path, NULL, NULL, 0), 
+				NULL);
+		STOPIF_CODE_EPIPE( printf("   Data-Path:\t%s\n", 
+					waa_path), NULL);
+	}
 
 	if (!sts->parent)
 	{
+		STOPIF( waa__get_waa_directory(path, &waa_path, NULL, NULL,
+					GWD_WAA), NULL);
+		STOPIF_CODE_EPIPE( printf("   WAA-Path:\t%s\n", 
+					waa_path), NULL);
 		STOPIF( waa__get_waa_directory(path, &waa_path, NULL, NULL,
 					GWD_CONF), NULL);
 		STOPIF_CODE_EPIPE( printf("   Conf-Path:\t%s\n", 
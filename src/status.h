@@ -30,6 +30,15 @@ action_t st__progress;
 /** Uninitializer for \ref st__progress. */
 action_uninit_t st__progress_uninit;
 
+/** Byte counters for the \ref o_progress_file "progress file".
+ * @{ */
+extern t_ull st__bytes_hashed, st__bytes_sent, st__bytes_received;
+/** @} */
+/** Counts entries as done, and rewrites the progress file if needed. */
+int st__progress_file(struct estat *sts, int entries);
+/** Writes the final state into the progress file. */
+int st__progress_file_finish(int has_failed);
+
 /** Shows detailed information about the entry. */
 int st__print_entry_info(struct estat *sts);
 
@@ -249,10 +249,12 @@ int sync__progress(struct estat *sts)
 
 
 	status=0;
+	STOPIF( st__progress_file(sts, 1), NULL);
 	STOPIF( ops__build_path(&path, sts), NULL);
 
-	STOPIF( waa__delete_byext( path, WAA__FILE_MD5s_EXT, 1), NULL);
-	STOPIF( waa__delete_byext( path, WAA__PROP_EXT, 1), NULL);
+	STOPIF( waa__delete_entry(sts, WAA__FILE_MD5s_EXT, 1), NULL);
+	STOPIF( waa__delete_entry(sts, WAA__PROP_EXT, 1), NULL);
+	STOPIF( prp__group_ref_drop(sts), NULL);
 
 
 	/* We get the current type in sts->new_rev_mode_packed, but we need 
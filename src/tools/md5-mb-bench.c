@@ -0,0 +1,115 @@
+/************************************************************************
+ * Copyright (C) 2009 Philipp Marek.
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ ************************************************************************/
+
+
+/** \file
+ *
+ * Benchmark for the multi-buffer MD5.
+ *
+ * Hashes \c count buffers with random sizes between \c min and \c max
+ * bytes, once with \c apr_md5() (as used for single files) and once in
+ * batches of \c batch buffers with md5_mb__hash(); the digests are
+ * compared, and the throughput of both is printed.
+ *
+ * Built via <tt>make tools/md5-mb-bench</tt> in \c src/; usage is
+ * \code
+ *   tools/md5-mb-bench [count [min [max [batch]]]]
+ * \endcode
+ * The defaults are 20000 buffers of 1 to 50 KB, in batches of 64.
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <apr_md5.h>
+
+#include "../md5_mb.h"
+
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+
+int main(int argc, char *argv[])
+{
+	int count, min, max, batch, i, j, n, round;
+	unsigned char **data;
+	size_t *len, total;
+	unsigned char (*scalar)[16], (*multi)[16];
+	double t0, t_scalar, t_multi;
+
+
+	count= argc > 1 ? atoi(argv[1]) : 20000;
+	min=   argc > 2 ? atoi(argv[2]) : 1024;
+	max=   argc > 3 ? atoi(argv[3]) : 50*1024;
+	batch= argc > 4 ? atoi(argv[4]) : 64;
+	if (count < 1 || min < 0 || max < min || batch < 1)
+	{
+		fprintf(stderr, "usage: %s [count [min [max [batch]]]]\n", argv[0]);
+		return 1;
+	}
+
+	data=malloc(count * sizeof(*data));
+	len=malloc(count * sizeof(*len));
+	scalar=malloc(count * sizeof(*scalar));
+	multi=malloc(count * sizeof(*multi));
+	if (!data || !len || !scalar || !multi) return 2;
+
+	srandom(1);
+	total=0;
+	for(i=0; i<count; i++)
+	{
+		len[i]=min + random() % (max-min+1);
+		data[i]=malloc(len[i]+1);
+		if (!data[i]) return 2;
+		for(j=0; j<len[i]; j++)
+			data[i][j]=random();
+		total+=len[i];
+	}
+
+	/* Best of three, to get rid of cache and frequency effects. */
+	t_scalar=t_multi=1e9;
+	for(round=0; round<3; round++)
+	{
+		t0=now();
+		for(i=0; i<count; i++)
+			apr_md5(scalar[i], data[i], len[i]);
+		t0=now()-t0;
+		if (t0 < t_scalar) t_scalar=t0;
+
+		t0=now();
+		for(i=0; i<count; i+=n)
+		{
+			n= count-i < batch ? count-i : batch;
+			md5_mb__hash(n, (const unsigned char *const *)data+i, len+i,
+					multi+i);
+		}
+		t0=now()-t0;
+		if (t0 < t_multi) t_multi=t0;
+	}
+
+	if (memcmp(scalar, multi, count * sizeof(*scalar)) != 0)
+	{
+		fprintf(stderr, "Digests differ!\n");
+		return 3;
+	}
+
+	printf("%d buffers, %d-%d bytes, %.1f MB in batches of %d, %d lanes\n",
+			count, min, max, total/1e6, batch, MD5_MB__LANES);
+	printf("  apr_md5:      %8.1f MB/s\n", total/1e6/t_scalar);
+	printf("  md5_mb__hash: %8.1f MB/s (%.2fx)\n",
+			total/1e6/t_multi, t_scalar/t_multi);
+
+	return 0;
+}
@@ -424,8 +424,9 @@ int up__unlink(struct estat *sts, char *filename)
 	}
 	else
 	{
-		STOPIF( waa__delete_byext(filename, WAA__FILE_MD5s_EXT, 1), NULL);
-		STOPIF( waa__delete_byext(filename, WAA__PROP_EXT, 1), NULL);
+		STOPIF( waa__delete_entry(sts, WAA__FILE_MD5s_EXT, 1), NULL);
+		STOPIF( waa__delete_entry(sts, WAA__PROP_EXT, 1), NULL);
+		STOPIF( prp__group_ref_drop(sts), NULL);
 	}
 
 	DEBUGP("unlink(%s)", filename);
@@ -971,7 +972,13 @@ into_stringbufs:
 		svn_s_tgt=svn_stream_from_aprfile(target, sts->filehandle_pool);
 
 		/* How do we get the filesize here? */
-		if (!action->is_import_export)
+		if (sts->flags & RF_NO_BLOCKHASH)
+		{
+			/* The MD5 is done by svn_txdelta_apply(). */
+			DEBUGP("%s has no block hashes", filename);
+			STOPIF( waa__delete_entry(sts, WAA__FILE_MD5s_EXT, 1), NULL);
+		}
+		else if (!action->is_import_export)
 			STOPIF( cs__new_manber_filter(sts, svn_s_tgt, &svn_s_tgt, 
 						sts->filehandle_pool),
 					NULL);
@@ -1080,6 +1087,12 @@ svn_error_t *up__close_file(void *file_baton,
 	/* finished, report to user */
 	STOPIF( st__status(sts), NULL);
 
+	if (S_ISREG(sts->st.mode))
+	{
+		st__bytes_received += sts->st.size;
+		STOPIF( st__progress_file(sts, 0), NULL);
+	}
+
 ex:
 	RETURN_SVNERR(status);
 }
@@ -1155,6 +1168,200 @@ ex:
 }
 
 
+/** \name Resuming an interrupted update
+ *
+ * The entries file is only written after all changes have been fetched; 
+ * if a long update gets interrupted, the next try would fetch everything 
+ * again.
+ *
+ * So while fetching we append a record for each completely installed file 
+ * to the \ref upd journal; on the next update a file that's listed there 
+ * with the same target revision, and still has the listed MD5, is taken 
+ * as-is, and not fetched again.  The journal is removed when the update 
+ * finishes successfully.
+ *
+ * Only \ref update uses the journal; \ref checkout and \ref export 
+ * stream every file through the export editor, and don't keep one.
+ * @{ */
+/** One fetched file. */
+struct up___resume_t
+{
+	/** The revision it was fetched at. */
+	svn_revnum_t rev;
+	/** Its MD5. */
+	md5_digest_t md5;
+};
+
+/** The files fetched by an interrupted update, indexed by path. */
+static apr_hash_t *up___resume_list=NULL;
+/** Where to append the newly fetched files; \c -1 if not active. */
+static int up___resume_fh=-1;
+
+
+/** Loads the journal of an interrupted update, and opens it for 
+ * appending. */
+int up___resume_start(apr_pool_t *pool)
+{
+	int status, fh, count;
+	struct sstat_t st;
+	char *buffer, *cp, *eos, *end, *path;
+	struct up___resume_t *entry;
+
+
+	status=0;
+	fh=-1;
+	buffer=NULL;
+	count=0;
+	up___resume_list=apr_hash_make(pool);
+
+	status=waa__open_byext(wc_path, WAA__UPDATE_JOURNAL_EXT, WAA__READ, &fh);
+	if (status == ENOENT)
+		status=0;
+	else
+	{
+		STOPIF( status, NULL);
+		STOPIF( hlp__fstat(fh, &st), NULL);
+
+		STOPIF( hlp__alloc( &buffer, st.size+1), NULL);
+		STOPIF_CODE_ERR( read(fh, buffer, st.size) != st.size, errno,
+				"Reading the update journal");
+		buffer[st.size]=0;
+
+		/* Every record is "revision md5 path\0", so that any path can be 
+		 * stored; an incomplete last record (from an interrupted write) is 
+		 * ignored. */
+		cp=buffer;
+		end=buffer+st.size;
+		while ( cp < end && (eos=memchr(cp, 0, end-cp)) )
+		{
+			entry=apr_palloc(pool, sizeof(*entry));
+			entry->rev=strtoul(cp, &cp, 10);
+			if (*cp == ' ' &&
+					cs__char2md5(cp+1, &cp, entry->md5) == 0 &&
+					*cp == ' ')
+			{
+				path=apr_pstrdup(pool, cp+1);
+				apr_hash_set(up___resume_list, path, APR_HASH_KEY_STRING, entry);
+				count++;
+			}
+			cp=eos+1;
+		}
+
+		STOPIF_CODE_ERR( close(fh) == -1, errno, 
+				"Closing the update journal");
+		fh=-1;
+
+		if (count && opt__verbosity() > VERBOSITY_VERYQUIET)
+			printf("Resuming an interrupted update; %d files were already "
+					"fetched.\n", count);
+	}
+
+	STOPIF( waa__open_byext(wc_path, WAA__UPDATE_JOURNAL_EXT, WAA__APPEND, 
+				&up___resume_fh), NULL);
+
+ex:
+	if (fh != -1) close(fh);
+	IF_FREE(buffer);
+	return status;
+}
+
+
+/** Closes the journal; if the update was successful, it gets removed. */
+int up___resume_finish(int has_failed)
+{
+	int status;
+
+
+	status=0;
+	if (up___resume_fh != -1)
+	{
+		STOPIF_CODE_ERR( close(up___resume_fh) == -1, errno,
+				"Closing the update journal");
+		up___resume_fh=-1;
+
+		if (!has_failed)
+			STOPIF( waa__delete_byext(wc_path, WAA__UPDATE_JOURNAL_EXT, 1), 
+					NULL);
+	}
+	up___resume_list=NULL;
+
+ex:
+	return status;
+}
+
+
+/** -. */
+int up__resume_record(struct estat *sts, char *fn)
+{
+	int status, len;
+	char *line;
+
+
+	status=0;
+	if (up___resume_fh == -1) goto ex;
+
+	line=NULL;
+	len=strlen(fn) + 64;
+	STOPIF( hlp__alloc( &line, len), NULL);
+	/* Including the \0. */
+	len=snprintf(line, len, "%llu %s %s", 
+			(t_ull)sts->repos_rev, cs__md5tohex_buffered(sts->md5), fn) + 1;
+	status= write(up___resume_fh, line, len) != len ? errno : 0;
+	IF_FREE(line);
+	STOPIF( status, "Writing the update journal");
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * \a *done is set if the file at \a fn has already been fetched with the 
+ * revision \c sts->repos_rev; the entry data is then taken from the file. 
+ * */
+int up__resume_check(struct estat *sts, char *fn, int *done)
+{
+	int status, changed;
+	struct up___resume_t *entry;
+	md5_digest_t md5;
+
+
+	status=0;
+	*done=0;
+	if (!up___resume_list || sts->old || 
+			!S_ISREG(sts->st.mode) ||
+			!(sts->remote_status & (FS_CHANGED | FS_REPLACED)))
+		goto ex;
+
+	entry=apr_hash_get(up___resume_list, fn, APR_HASH_KEY_STRING);
+	if (!entry || entry->rev != sts->repos_rev) goto ex;
+
+	/* Compare against the MD5 of the fetched data. */
+	memcpy(md5, sts->md5, sizeof(md5));
+	memcpy(sts->md5, entry->md5, sizeof(sts->md5));
+	sts->change_flag=CF_UNKNOWN;
+	STOPIF( cs__compare_file(sts, fn, &changed), NULL);
+
+	if (changed)
+	{
+		DEBUGP("%s changed since it was fetched", fn);
+		memcpy(sts->md5, md5, sizeof(sts->md5));
+		goto ex;
+	}
+
+	DEBUGP("%s already fetched at %llu", fn, (t_ull)entry->rev);
+	STOPIF( hlp__lstat( fn, &(sts->st)), NULL);
+	sts->entry_status &= ~FS__CHANGE_MASK;
+	*done=1;
+	STOPIF( up__resume_record(sts, fn), NULL);
+
+ex:
+	return status;
+}
+
+/** @} */
+
+
 /** Main update action.
  *
  * We do most of the setup before checking the whole tree. 
@@ -1223,6 +1430,7 @@ int up__work(struct estat *root, int argc, char *argv[])
 	else
 	{
 		DEBUGP("fetching from repository");
+		STOPIF( up___resume_start(global_pool), NULL);
 		STOPIF( rev__do_changed(root, global_pool), NULL);
 
 		/* See the comment at the end of commit.c - atomicity for writing
@@ -1230,6 +1438,7 @@ int up__work(struct estat *root, int argc, char *argv[])
 		delay_start=time(NULL);
 		STOPIF( waa__output_tree(root), NULL);
 		STOPIF( url__output_list(), NULL);
+		STOPIF( up___resume_finish(0), NULL);
 		STOPIF( hlp__delay(delay_start, DELAY_UPDATE), NULL);
 	}
 
@@ -1237,6 +1446,8 @@ int up__work(struct estat *root, int argc, char *argv[])
 ex:
 	STOP_HANDLE_SVNERR(status_svn);
 ex2:
+	/* Keep the journal for the next try. */
+	up___resume_finish(1);
 	return status;
 }
 
@@ -25,6 +25,11 @@ int up__parse_prop(struct estat *sts,
 		int *not_handled,
 		apr_pool_t *pool);
 
+/** Checks whether an interrupted update already fetched this entry. */
+int up__resume_check(struct estat *sts, char *fn, int *done);
+/** Remembers that this entry was fetched completely. */
+int up__resume_record(struct estat *sts, char *fn);
+
 /** Set the meta-data for this entry. */
 int up__set_meta_data(struct estat *sts,
 		const char *filename);
@@ -21,6 +21,7 @@
 #include "est_ops.h"
 #include "checksum.h"
 #include "racallback.h"
+#include "snapshot.h"
 
 
 /** \file
@@ -236,6 +237,12 @@ int url__parm_list_len=0,
 
 int url__must_write_defs=0;
 
+/** -.
+ * Gets cleared as soon as entries are inserted or freed, or their URLs 
+ * changed, as the index could then point to the wrong entries or miss 
+ * some.  */
+int url__subtree_index_valid=0;
+
 
 /** -.
  *
@@ -776,6 +783,40 @@ ex:
 }
 
 
+/** -.
+ * The index is only valid if there are URLs loaded. */
+void url__subtree_index_start(void)
+{
+	int i;
+
+	for(i=0; i<urllist_count; i++)
+		urllist[i]->subtree_count=0;
+	url__subtree_index_valid = urllist_count > 0;
+}
+
+
+/** -. */
+int url__subtree_index_add(struct estat *sts)
+{
+	int status;
+	struct url_t *url=sts->url;
+
+
+	status=0;
+	if (url->subtree_count >= url->subtree_alloc)
+	{
+		url->subtree_alloc = url->subtree_alloc ? url->subtree_alloc*2 : 16;
+		STOPIF( hlp__realloc( &url->subtrees, 
+					url->subtree_alloc * sizeof(*url->subtrees)), NULL);
+	}
+
+	url->subtrees[url->subtree_count++] = sts;
+
+ex:
+	return status;
+}
+
+
 /** -. */
 int url__indir_sorter(const void *a, const void *b)
 {
@@ -804,9 +845,9 @@ int url__indir_sorter(const void *a, const void *b)
  * \see waa_files. */
 int url__load_list(char *dir, int reserve_space)
 {
-	int status, fh, l, i;
-	struct stat st;
-	char *urllist_mem;
+	int status, l, i;
+	char *urllist_mem, *data;
+	size_t len;
 	int inum, cnt, new_count;
 	svn_revnum_t rev;
 	int intnum;
@@ -815,12 +856,12 @@ int url__load_list(char *dir, int reserve_space)
 	char *buffer;
 
 
-	fh=-1;
 	urllist_mem=NULL;
+	rev_in=NULL;
 
 	/* ENOENT must be possible without an error message. 
 	 * The space must always be allocated. */
-	status=waa__open_byext(dir, WAA__URLLIST_EXT, WAA__READ, &fh);
+	status=snap__read_byext(dir, WAA__URLLIST_EXT, &data, &len);
 	if (status==ENOENT)
 	{
 		STOPIF( url__allocate(reserve_space), NULL);
@@ -830,21 +871,15 @@ int url__load_list(char *dir, int reserve_space)
 
 	STOPIF_CODE_ERR(status, status, "Cannot read URL list");
 
-	STOPIF_CODE_ERR( fstat(fh, &st) == -1, errno,
-			"fstat() of url-list");
-
-	/* add 1 byte to ensure \0 */
-	STOPIF( hlp__alloc( &urllist_mem, st.st_size+1), NULL);
-
-	status=read(fh, urllist_mem, st.st_size);
-	STOPIF_CODE_ERR( status != st.st_size, errno, 
-			"error reading url-list");
-
-	urllist_mem[st.st_size]=0;
+	/* The URL strings live in this copy; the snapshot data must not be 
+	 * changed. Add 1 byte to ensure \0. */
+	STOPIF( hlp__alloc( &urllist_mem, len+1), NULL);
+	memcpy(urllist_mem, data, len);
+	urllist_mem[len]=0;
 
 	/* count urls */
 	new_count=0;
-	for(l=0; l<st.st_size; )
+	for(l=0; l<(int)len; )
 	{
 		while (isspace(urllist_mem[l])) l++;
 
@@ -883,15 +918,13 @@ int url__load_list(char *dir, int reserve_space)
 		l++;
 	}
 
-	STOPIF_CODE_ERR( close(fh) == -1, errno, "closing the url-list");
-	fh=-1;
 
 
 	/* Read the current revisions from the WAA definition.
 	 * If we got data before, we need this here too. */
 	/* Exception for 1.1.18: Upgrade from 1.1.17. A non-existing file is 
 	 * allowed, but will convert the data next time. */
-	status=waa__open_byext(dir, WAA__URL_REVS, WAA__READ, &fh);
+	status=snap__fopen_byext(dir, WAA__URL_REVS, &rev_in);
 	if (status==ENOENT)
 	{
 		DEBUGP("No file; upgrading?");
@@ -899,8 +932,9 @@ int url__load_list(char *dir, int reserve_space)
 	}
 	else
 	{
+		STOPIF( status, "Cannot read %s", WAA__URL_REVS);
+
 		/* Read the associated revisions. */
-		rev_in=fdopen(fh, "r");
 		while (1)
 		{
 			status=hlp__string_from_filep(rev_in, &buffer, NULL, 0);
@@ -923,7 +957,7 @@ int url__load_list(char *dir, int reserve_space)
 		}
 		STOPIF_CODE_ERR( fclose(rev_in)==-1, errno, 
 			"error closing %s", WAA__URL_REVS);
-		fh=-1;
+		rev_in=NULL;
 	}
 
 
@@ -935,11 +969,7 @@ int url__load_list(char *dir, int reserve_space)
 
 ex:
 	/* urllist_mem must not be freed - our url-strings still live there! */
-	if (fh!=-1) 
-	{
-		l=close(fh);
-		STOPIF_CODE_ERR(l == -1 && !status, errno, "closing the url-list");
-	}
+	if (rev_in) fclose(rev_in);
 
 	return status;
 }
@@ -1093,6 +1123,9 @@ int url__open_session(svn_ra_session_t **session, char **missing_dirs)
 
 	if (current_url->session) goto ex;
 
+	/* Not done at startup, as most local actions never get here. */
+	STOPIF_SVNERR( cb__init, (global_pool));
+
 
 	/* We wouldn't need to allocate this memory if the URL was ok; but we
 	 * don't know that here, and it doesn't hurt that much.
@@ -21,6 +21,8 @@ extern char **url__parm_list;
 extern int url__parm_list_used;
 /** Whether the URL list in FSVS_CONF must be written. */
 extern int url__must_write_defs;
+/** Whether the url_t::subtrees index can be used. */
+extern int url__subtree_index_valid;
 
 /** URLs action. */
 work_t url__work;
@@ -70,6 +72,10 @@ int url__close_sessions(void);
 
 /** Marks URLs for handling. */
 int url__mark_todo(void);
+/** Starts a new url_t::subtrees index. */
+void url__subtree_index_start(void);
+/** Remembers \a sts as topmost entry of its URL. */
+int url__subtree_index_add(struct estat *sts);
 /** Remember URL name parameter for later processing. */
 int url__store_url_name(char *parm);
 /** Returns whether \a url should be handled. */
@@ -18,6 +18,7 @@
 #include <strings.h>
 #include <time.h>
 #include <sys/mman.h>
+#include <sys/file.h>
 
 
 #include "waa.h"
@@ -33,6 +34,11 @@
 #include "est_ops.h"
 #include "ignore.h"
 #include "actions.h"
+#include "url.h"
+#include "snapshot.h"
+#include "image.h"
+#include "hot.h"
+#include "props.h"
 
 
 /** \file
@@ -98,6 +104,23 @@ int waa_tmp_path_len;
 /** -. */
 struct waa__entry_blocks_t waa__entry_block;
 
+/** -. */
+long long waa__deadline;
+/** -. */
+int waa__unchecked;
+
+/** The next free entry ID, or \c 0 if not known yet. */
+static t_ull waa___next_id;
+/** If a \ref dir file of version 6 was read, the entries got their line 
+ * numbers as IDs; their per-entry files may still be at the path-based 
+ * location, if they haven't been moved yet. This is the highest such ID. 
+ * */
+static t_ull waa___legacy_ids;
+/** Copy of the constant part of the per-entry paths, ie. \c waa_tmp_path 
+ * up to and including \ref WAA__ENTRY_DIR. */
+static char *waa___entry_base;
+static int waa___entry_base_len;
+
 
 /** -.
  * Valid after a successful call to \ref waa__find_common_base(). */
@@ -115,9 +138,10 @@ const char
  * - number of entries (for space allocation), 
  * - subdirectory count (currently only informational), 
  * - needed string space (in bytes), 
- * - length of longest path in bytes.
+ * - length of longest path in bytes,
+ * - the next free entry ID (since version 7).
  * */
-waa__header_line[]="%u %lu %u %u %u %u";
+waa__header_line[]="%u %lu %u %u %u %u %llu";
 
 
 /** Convenience function for creating two paths. */
@@ -205,7 +229,7 @@ int waa__init(void)
 
 
 	/* This memory has lifetime of the process.
-	 *   /path/to/waa / 01/02/03..0F/ extension .tmp
+	 *   /path/to/waa / 01/02/03..0F/ [ids/ 0f/ 123..f/] extension .tmp
 	 * The memory allocated is enough for the longest possible path. */
 	waa_tmp_path_len=
 		opt__get_int(OPT__SOFTROOT) + 1 +
@@ -213,6 +237,7 @@ int waa__init(void)
 					opt__get_int(OPT__CONF_PATH)) ) + 1 + 
 		WAA_WC_MD5_CHARS + 1 +
 		APR_MD5_DIGESTSIZE*2 + 3 + 
+		strlen(WAA__ENTRY_DIR) + 1 + 2 + 1 + 16 + 1 +
 		WAA__MAX_EXT_LENGTH + strlen(ext_tmp) + 1 +4;
 	DEBUGP("using %d bytes for temporary WAA+conf paths", waa_tmp_path_len);
 
@@ -310,6 +335,62 @@ ex:
 }
 
 
+/** -.
+ *
+ * The lock is a \c flock() on the \ref lock file in the WAA directory of 
+ * the working copy; it's held until the process (and its children) exit.  
+ * The file contains the PID of the holder, for the error message.
+ *
+ * Read-only actions don't take the lock, and so never wait; the files 
+ * they read are written under temporary names and renamed into place (see 
+ * waa__open() and hsh__new()), so they see either the old or the new 
+ * data. */
+int waa__lock_wc(void)
+{
+	int status;
+	static int fh=-1;
+	char *cp, *eos;
+	char buffer[32];
+	int len;
+
+
+	status=0;
+	if (fh != -1) goto ex;
+
+	STOPIF( waa__get_waa_directory(wc_path, &cp, &eos, NULL, 
+				GWD_WAA | GWD_MKDIR), NULL);
+	strcpy(eos, WAA__LOCK_EXT);
+
+	fh=open(cp, O_RDWR | O_CREAT, 0666);
+	STOPIF_CODE_ERR( fh == -1, errno, "Cannot open lock file %s", cp);
+
+	if (flock(fh, LOCK_EX | LOCK_NB) == -1)
+	{
+		status=errno;
+		STOPIF_CODE_ERR( status != EWOULDBLOCK, status, 
+				"Cannot lock %s", cp);
+
+		len=read(fh, buffer, sizeof(buffer)-1);
+		buffer[len > 0 ? len : 0]=0;
+		close(fh);
+		fh=-1;
+		STOPIF( EBUSY, "!The working copy \"%s\" is being changed by "
+				"another process (PID %s).", wc_path, 
+				len > 0 ? buffer : "unknown");
+	}
+
+	len=sprintf(buffer, "%llu\n", (t_ull)getpid());
+	STOPIF_CODE_ERR( ftruncate(fh, 0) == -1 ||
+			pwrite(fh, buffer, len, 0) != len, errno,
+			"Cannot write lock file %s", cp);
+
+	DEBUGP("locked %s", cp);
+
+ex:
+	return status;
+}
+
+
 /** -.
  *
  * \note The mask used is \c 0777 - so mind your umask! */
@@ -541,36 +622,15 @@ ex:
 }
 
 
-/** Base function to open files in the WAA.
- *
- * For the \a flags the values of \c creat or \c open are used;
- * the mode is \c 0777, so take care of your umask. 
- *
- * If the flags include one or more of \c O_WRONLY, \c O_TRUNC or \c O_RDWR
- * the file is opened as a temporary file and \b must be closed with 
- * waa__close(); depending on the success value given there it is renamed
- * to the destination name or deleted. 
- *
- * This temporary path is stored in a per-filehandle array, so there's no
- * limit here on the number of written-to files. 
- *
- * If the flags include \c O_APPEND, no temporary file is used, and no 
- * filehandle is stored - do simply a \c close().
- *
- * For read-only files simply do a \c close() on their filehandles.
- *
- * Does return \c ENOENT without telling the user.
- *
- * \note If \a extension is given as \c NULL, only the existence of the 
- * given WAA directory is checked. So the caller gets a \c 0 or an error 
- * code (like \c ENOENT); \a flags and \a filehandle are ignored.
- * */
-int waa__open(char *path,
+/** The part of waa__open() after the directory is known.
+ * \a dest, \a eos and \a start_spec are as returned by 
+ * waa__get_waa_directory(). */
+static int waa___open(char *dest, char *eos, char *start_spec,
 		const char *extension,
 		int flags,
 		int *filehandle)
 {
-	char *cp, *orig, *eos, *dest, *start_spec;
+	char *cp, *orig;
 	int fh, status;
 	int use_temp_file;
 	int old_len;
@@ -586,9 +646,6 @@ int waa__open(char *path,
 	use_temp_file=(flags & O_APPEND) ? 0 : 
 		(flags & (O_WRONLY | O_RDWR | O_CREAT));
 
-	STOPIF( waa__get_waa_directory(path, &dest, &eos, &start_spec,
-				waa__get_gwd_flag(extension) ), NULL);
-
 	if (!extension)
 	{
 		/* Remove the last PATH_SEPARATOR. */
@@ -684,6 +741,73 @@ ex:
 }
 
 
+/** Base function to open files in the WAA.
+ *
+ * For the \a flags the values of \c creat or \c open are used;
+ * the mode is \c 0777, so take care of your umask. 
+ *
+ * If the flags include one or more of \c O_WRONLY, \c O_TRUNC or \c O_RDWR
+ * the file is opened as a temporary file and \b must be closed with 
+ * waa__close(); depending on the success value given there it is renamed
+ * to the destination name or deleted. 
+ *
+ * This temporary path is stored in a per-filehandle array, so there's no
+ * limit here on the number of written-to files. 
+ *
+ * If the flags include \c O_APPEND, no temporary file is used, and no 
+ * filehandle is stored - do simply a \c close().
+ *
+ * For read-only files simply do a \c close() on their filehandles.
+ *
+ * Does return \c ENOENT without telling the user.
+ *
+ * \note If \a extension is given as \c NULL, only the existence of the 
+ * given WAA directory is checked. So the caller gets a \c 0 or an error 
+ * code (like \c ENOENT); \a flags and \a filehandle are ignored.
+ * */
+int waa__open(char *path,
+		const char *extension,
+		int flags,
+		int *filehandle)
+{
+	int status;
+	char *dest, *eos, *start_spec;
+
+
+	STOPIF( waa__get_waa_directory(path, &dest, &eos, &start_spec,
+				waa__get_gwd_flag(extension) ), NULL);
+	status=waa___open(dest, eos, start_spec, extension, flags, filehandle);
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * Like waa__open_byext() this returns \c ENOENT silently; an entry 
+ * without an ID has no files yet, so that's the answer for reading it.
+ * When writing, an ID gets assigned. */
+int waa__open_entry(struct estat *sts,
+		const char *extension,
+		int mode,
+		int *fh)
+{
+	int status;
+	char *dest, *eos, *start_spec;
+
+
+	status=waa__get_entry_directory(sts, &dest, &eos, &start_spec, 
+			(mode & (O_WRONLY | O_RDWR | O_CREAT)) ? GWD_NEW_ID : 0);
+	if (status == ENOENT) goto ex;
+	STOPIF(status, NULL);
+
+	status=waa___open(dest, eos, start_spec, extension, mode, fh);
+
+ex:
+	return status;
+}
+
+
 /** -.
  *
  * If \a has_failed is !=0, the writing to the file has
@@ -811,6 +935,48 @@ ex:
 }
 
 
+/** Removes the file \a cp, and the (max. 3) directory levels above, if 
+ * they're empty.
+ * \a eos must point to the last \c PATH_SEPARATOR in \a cp. */
+static int waa___delete(char *cp, char *eos, int ignore_not_exist)
+{
+	int status;
+	int i;
+
+
+	status=0;
+	DEBUGP("unlink %s", cp);
+	if (unlink(cp) == -1)
+	{
+		status=errno;
+		if (status == ENOENT && ignore_not_exist) status=0;
+
+		STOPIF(status, "Cannot remove spool entry %s", cp);
+	}
+
+	/* Try to unlink the (possibly) empty directory. 
+	 * If we get an error don't try further, but don't give it to 
+	 * the caller, either.
+	 * After all, it's just a clean-up. */
+	/* eos is currently at a PATH_SEPARATOR; we have to clean that. */
+	for(i=0; i<3; i++)
+	{
+		*eos=0;
+
+		if (rmdir(cp) == -1) break;
+
+		eos=strrchr(cp, PATH_SEPARATOR);
+		/* That should never happen. */
+		BUG_ON(!eos, "Got invalid path to remove");
+	}
+
+	DEBUGP("last removed was %s", cp);
+
+ex:
+	return status;
+}
+
+
 /** -.
  *
  * If the \c unlink()-call succeeds, the (max. 2) directory levels above 
@@ -829,7 +995,6 @@ int waa__delete_byext(char *path,
 {
 	int status;
 	char *cp, *eos;
-	int i;
 
 
 	status=0;
@@ -850,32 +1015,35 @@ int waa__delete_byext(char *path,
 		BUG_ON(!eos);
 	}
 
-	DEBUGP("unlink %s", cp);
-	if (unlink(cp) == -1)
-	{
-		status=errno;
-		if (status == ENOENT && ignore_not_exist) status=0;
+	STOPIF( waa___delete(cp, eos, ignore_not_exist), NULL);
 
-		STOPIF(status, "Cannot remove spool entry %s", cp);
-	}
+ex:
+	return status;
+}
 
-	/* Try to unlink the (possibly) empty directory. 
-	 * If we get an error don't try further, but don't give it to 
-	 * the caller, either.
-	 * After all, it's just a clean-up. */
-	/* eos is currently at a PATH_SEPARATOR; we have to clean that. */
-	for(i=0; i<3; i++)
-	{
-		*eos=0;
 
-		if (rmdir(cp) == -1) break;
+/** -.
+ * An entry without an ID has no files; that's a \c ENOENT, too. */
+int waa__delete_entry(struct estat *sts,
+		char *extension,
+		int ignore_not_exist)
+{
+	int status;
+	char *cp, *eos;
 
-		eos=strrchr(cp, PATH_SEPARATOR);
-		/* That should never happen. */
-		BUG_ON(!eos, "Got invalid path to remove");
+
+	status=waa__get_entry_directory(sts, &cp, &eos, NULL, 0);
+	if (status == ENOENT)
+	{
+		STOPIF_CODE_ERR( !ignore_not_exist, ENOENT,
+				"Entry %s has no %s file", sts->name, extension);
+		status=0;
+		goto ex;
 	}
+	STOPIF(status, NULL);
 
-	DEBUGP("last removed was %s", cp);
+	strcpy(eos, extension);
+	STOPIF( waa___delete(cp, eos-1, ignore_not_exist), NULL);
 
 ex:
 	return status;
@@ -1086,7 +1254,113 @@ int waa___find_position(struct estat **new,
 }
 
 
-/** -.
+/** Compares the addresses of two entries, for freeing them in memory 
+ * order (which keeps the free list short). */
+static int waa___compare_address(const void *a, const void *b)
+{
+	const struct estat * const *x=a, * const *y=b;
+
+	if (*x < *y) return -1;
+	if (*x > *y) return +1;
+	return 0;
+}
+
+
+/** Reads the directory \a dir for the streamed build.
+ *
+ * Like one level of waa__build_tree(); but the cwd stays at the wc root.  
+ * */
+static int waa___stream_read_dir(struct estat *dir)
+{
+	int status;
+	struct estat *sts;
+	char *path;
+	int i, ignore, have_ignored;
+
+
+	STOPIF( ops__build_path(&path, dir), NULL);
+	STOPIF_CODE_ERR( chdir(path) == -1, errno, "chdir(%s)", path);
+	STOPIF( waa__dir_enum( dir, 0, 0), NULL);
+	STOPIF_CODE_ERR( chdir(wc_path) == -1, errno, "chdir(%s)", wc_path);
+
+	DEBUGP("found %d entries in %s", dir->entry_count, path);
+	have_ignored=0;
+	for(i=0; i<dir->entry_count; i++)
+	{
+		sts=dir->by_inode[i];
+
+		STOPIF( ign__is_ignore(sts, &ignore), NULL);
+		if (ignore>0)
+		{
+			sts->to_be_ignored=1;
+			have_ignored=1;
+			continue;
+		}
+
+		sts->entry_status=FS_NEW;
+		ops__set_todo_bits(sts);
+		approx_entry_count++;
+
+		STOPIF( ac__dispatch(sts), NULL);
+	}
+
+	if (have_ignored)
+		STOPIF( ops__free_marked(dir, 0), NULL);
+
+	/* The directory itself is unfinished until all of its children are 
+	 * written. */
+	dir->unfinished=1;
+	if (dir->parent)
+		dir->parent->unfinished++;
+
+ex:
+	return status;
+}
+
+
+/** Marks one unfinished part of the directory \a dir as done.
+ *
+ * If that was the last one, all of its children have been written, and 
+ * can be freed; that finishes a part of the parent, too. */
+static int waa___stream_done(struct estat *dir)
+{
+	int status;
+	int i;
+
+
+	status=0;
+	while (dir)
+	{
+		BUG_ON(!dir->unfinished);
+		dir->unfinished--;
+		if (dir->unfinished) break;
+
+		DEBUGP("freeing %d children of %s", dir->entry_count, dir->name);
+		if (dir->entry_count)
+		{
+			qsort(dir->by_inode, dir->entry_count, sizeof(*dir->by_inode), 
+					waa___compare_address);
+			for(i=0; i<dir->entry_count; i++)
+				STOPIF( ops__free_entry(dir->by_inode+i), NULL);
+		}
+
+		IF_FREE(dir->by_inode);
+		IF_FREE(dir->by_name);
+		IF_FREE(dir->strings);
+		dir->entry_count=0;
+
+		dir=dir->parent;
+	}
+
+ex:
+	return status;
+}
+
+
+/** Writes the \ref dir file for \a root.
+ *
+ * If \a streamed is set, the directories are only read when they're 
+ * written; see waa__build_output_tree().
  *
  * Here the complete entry tree gets written to a file, which is used on the
  * next invocations to determine the entries' statii. It contains the names,
@@ -1186,6 +1460,9 @@ int waa___find_position(struct estat **new,
  * So instead of the inode number we store the number of the entry *in the
  * file*; so the root inode (which is always first) has parent_ino=0 (none),
  * its children get 1, and so on.
+ *
+ * Entries that don't have an \ref estat::entry_id yet get one here; the 
+ * next free ID is stored in the header.
  * That means that as long as we allocate the memory block in a single
  * continuous block, we don't have to search any more; we can just reconstruct
  * the pointers to the parent. 
@@ -1198,18 +1475,20 @@ int waa___find_position(struct estat **new,
  *   [20 30 35 40 50 60 70]
  * Again the first (smallest) element is written, and so on.
  */ 
-int waa__output_tree(struct estat *root)
+static int waa___output_tree(struct estat *root, int streamed)
 {
-	struct estat ***directory, *sts, **sts_pp;
+	struct estat ***directory, *sts, **sts_pp, *done_dir;
 	int max_dir, i, alloc_dir;
 	unsigned this_len;
 	int status, waa_info_hdl;
 	unsigned complete_count, string_space;
 	char header[HEADER_LEN] = "UNFINISHED";
+	char *cp;
 
 
 	waa_info_hdl=-1;
 	directory=NULL;
+	done_dir=NULL;
 	STOPIF( waa__open_dir(NULL, WAA__WRITE, &waa_info_hdl), NULL);
 
 	/* allocate space for later use - entry count and similar. */
@@ -1229,6 +1508,9 @@ int waa__output_tree(struct estat *root)
 	/* The root entry is visible above all URLs. */
 	root->url=NULL;
 
+	if (!root->entry_id)
+		STOPIF( waa__get_entry_directory(root, &cp, NULL, NULL, GWD_NEW_ID), 
+				NULL);
 	STOPIF( ops__save_1entry(root, 0, waa_info_hdl), NULL);
 	root->file_index=complete_count=1;
 
@@ -1236,6 +1518,13 @@ int waa__output_tree(struct estat *root)
 	root->path_len=string_space=strlen(root->name);
 	max_path_len=root->path_len;
 
+	if (streamed)
+	{
+		STOPIF( waa___stream_read_dir(root), NULL);
+		if (!root->entry_count)
+			STOPIF( waa___stream_done(root), NULL);
+	}
+
 	/* an if (root->entry_count) while (...) {...}
 	 * would be possible, but then an indentation level would
 	 * be wasted :-) ! */
@@ -1257,6 +1546,14 @@ int waa__output_tree(struct estat *root)
 	/* as long as there are directories to do... */
 	while (max_dir)
 	{
+		/* The children of a finished directory may only be freed after the 
+		 * last one has been handled. */
+		if (done_dir)
+		{
+			STOPIF( waa___stream_done(done_dir), NULL);
+			done_dir=NULL;
+		}
+
 		// get current entry
 		sts=( *directory[0] );
 
@@ -1271,6 +1568,8 @@ int waa__output_tree(struct estat *root)
 			max_dir--;
 			DEBUGP("finished subdir");
 			memmove(directory, directory+1, sizeof(*directory)*max_dir);
+
+			if (streamed) done_dir=sts->parent;
 		}
 		else if (max_dir>1)
 		{
@@ -1304,6 +1603,9 @@ int waa__output_tree(struct estat *root)
 
 
 		// do current entry
+		if (!sts->entry_id)
+			STOPIF( waa__get_entry_directory(sts, &cp, NULL, NULL, GWD_NEW_ID), 
+					NULL);
 		STOPIF( ops__save_1entry(sts, sts->parent->file_index, waa_info_hdl), 
 				NULL);
 
@@ -1319,6 +1621,13 @@ int waa__output_tree(struct estat *root)
 		if (sts->path_len > max_path_len)
 			max_path_len = sts->path_len;
 
+		if (streamed && S_ISDIR(sts->st.mode) && 
+				ops__are_children_interesting(sts))
+		{
+			STOPIF( waa___stream_read_dir(sts), NULL);
+			if (!sts->entry_count)
+				STOPIF( waa___stream_done(sts), NULL);
+		}
 
 		if (ops__has_children(sts))
 		{
@@ -1369,6 +1678,9 @@ int waa__output_tree(struct estat *root)
 #endif
 	}
 
+	if (done_dir)
+		STOPIF( waa___stream_done(done_dir), NULL);
+
 
 save_header:
 	/* save header information */
@@ -1376,7 +1688,7 @@ save_header:
 	status=snprintf(header, sizeof(header), waa__header_line,
 			WAA_VERSION, (t_ul)sizeof(header),
 			complete_count, alloc_dir, string_space+4,
-			max_path_len+4);
+			max_path_len+4, waa___next_id);
 	BUG_ON(status >= sizeof(header)-1, "header space not large enough");
 
 	/* keep \n at end */
@@ -1404,6 +1716,41 @@ ex:
 }
 
 
+/** -. */
+int waa__output_tree(struct estat *root)
+{
+	int status;
+
+	STOPIF( waa___output_tree(root, 0), NULL);
+	STOPIF( img__write(), NULL);
+	STOPIF( hot__write(root), NULL);
+
+ex:
+	return status;
+}
+
+
+/** -.
+ *
+ * This gives the same \ref dir file as waa__build_tree() followed by 
+ * waa__output_tree(); but as the directories are read in the order they 
+ * get written, and the children of completely written directories are 
+ * freed again, the memory needed is bounded by the active directories, 
+ * not by the size of the tree.
+ *
+ * The entries are freed, so \a root has no children afterwards. */
+int waa__build_output_tree(struct estat *root)
+{
+	int status;
+
+	STOPIF( waa___output_tree(root, 1), NULL);
+	STOPIF( img__write(), NULL);
+
+ex:
+	return status;
+}
+
+
 static struct estat *old;
 static struct estat current;
 static int nr_new;
@@ -1597,40 +1944,27 @@ ex:
 			__VA_ARGS__);
 
 
-/** -.
- * This may silently return -ENOENT, if the waa__open fails.
+/** Maps the \ref dir file, and checks and parses its header.
  *
- * The \a callback is called for \b every entry read; but for performance 
- * reasons the \c path parameter will be \c NULL.
- * */
-int waa__input_tree(struct estat *root,
-		struct waa__entry_blocks_t **blocks,
-		action_t *callback)
+ * On success \a *map and \a *length describe the mapping, which has to 
+ * be \c munmap()ed by the caller; \a *first is the first entry line.
+ * If the file doesn't exist \c -ENOENT is returned silently.
+ *
+ * Version 6 files are accepted, too; they have no entry IDs, so the 
+ * entries get their line numbers, and \a *next_id is set accordingly. */
+static int waa___map_entries(char **map, off_t *length, char **first,
+		unsigned *count, unsigned *subdirs, unsigned *string_space,
+		int *version, t_ull *next_id)
 {
 	int status, waa_info_hdl=-1;
-	int i, cur, first;
-	unsigned count, subdirs, string_space;
-	/* use a cache for directories, so that the parent can be located quickly */
-	/* substitute both array with one struct estat **cache, 
-	 * which runs along ->by_inode until NULL */
-	ino_t parent;
+	int i;
 	char header[HEADER_LEN];
-	char *filename;
-	struct estat *sts, *stat_mem;
-	char *strings;
-	int sts_free;
-	char *dir_mmap, *dir_end, *dir_curr;
-	off_t length;
+	char *dir_mmap;
 	t_ul header_len;
-	struct estat *sts_tmp;
-
 
-	waa__entry_block.first=root;
-	waa__entry_block.count=1;
-	waa__entry_block.next=waa__entry_block.prev=NULL;
 
-	length=0;
-	dir_mmap=NULL;
+	*map=NULL;
+	*length=0;
 	status=waa__open_dir(NULL, WAA__READ, &waa_info_hdl);
 	if (status == ENOENT) 
 	{
@@ -1639,12 +1973,12 @@ int waa__input_tree(struct estat *root,
 	}
 	STOPIF(status, "cannot open .dir file");
 
-	length=lseek(waa_info_hdl, 0, SEEK_END);
-	STOPIF_CODE_ERR( length == (off_t)-1, errno, 
+	*length=lseek(waa_info_hdl, 0, SEEK_END);
+	STOPIF_CODE_ERR( *length == (off_t)-1, errno, 
 			"Cannot get length of .dir file");
 
-	DEBUGP("mmap()ping %llu bytes", (t_ull)length);
-	dir_mmap=mmap(NULL, length,
+	DEBUGP("mmap()ping %llu bytes", (t_ull)*length);
+	dir_mmap=mmap(NULL, *length,
 			PROT_READ, MAP_SHARED, 
 			waa_info_hdl, 0);
 	/* If there's an error, return it.
@@ -1653,10 +1987,9 @@ int waa__input_tree(struct estat *root,
 	i=close(waa_info_hdl);
 	STOPIF_CODE_ERR( !dir_mmap, status, "mmap failed");
 	STOPIF_CODE_ERR( i, errno, "close() failed");
+	*map=dir_mmap;
 
-	dir_end=dir_mmap+length;
-
-	TREE_DAMAGED( length < (HEADER_LEN+5) || 
+	TREE_DAMAGED( *length < (HEADER_LEN+5) || 
 			dir_mmap[HEADER_LEN-1] != '\n' || 
 			dir_mmap[HEADER_LEN-2] != '$',
 			"the header is not correctly terminated");
@@ -1667,18 +2000,23 @@ int waa__input_tree(struct estat *root,
 	header[HEADER_LEN-2]=0;
 	status=sscanf(header, waa__header_line,
 			&i, &header_len,
-			&count, &subdirs, &string_space,
-			&max_path_len);
+			count, subdirs, string_space,
+			&max_path_len, next_id);
 	DEBUGP("got %d header fields", status);
-	TREE_DAMAGED( status != 6,
+	TREE_DAMAGED( status != (i < 7 ? 6 : 7),
 			"not all needed header fields could be parsed");
-	dir_curr=dir_mmap+HEADER_LEN;
+	*first=dir_mmap+HEADER_LEN;
 
-	TREE_DAMAGED( i != WAA_VERSION || header_len != HEADER_LEN, 
+	TREE_DAMAGED( (i != WAA_VERSION && i != 6) || header_len != HEADER_LEN, 
 			"the header has a wrong version");
+	*version=i;
+	if (i < 7)
+		*next_id=*count+1;
+	TREE_DAMAGED( *next_id <= *count,
+			"the next entry ID is invalid");
 
 	/* For progress display */
-	approx_entry_count=count;
+	approx_entry_count=*count;
 
 	/* for new subdirectories allow for some more space.
 	 * Note that this is not clean - you may have to have more space
@@ -1687,7 +2025,7 @@ int waa__input_tree(struct estat *root,
 	max_path_len+=1024;
 
 	DEBUGP("reading %d subdirs, %d entries, %d bytes string-space",
-			subdirs, count, string_space);
+			*subdirs, *count, *string_space);
 
 
 	/* Isn't there a snscanf() or something similar? I remember having seen
@@ -1696,10 +2034,257 @@ int waa__input_tree(struct estat *root,
 	 *
 	 * I now check for a \0\n at the end, so that I can be sure 
 	 * there'll be an end to sscanf. */
-	TREE_DAMAGED( dir_mmap[length-2] != '\0' || dir_mmap[length-1] != '\n',
+	TREE_DAMAGED( dir_mmap[*length-2] != '\0' || dir_mmap[*length-1] != '\n',
 			"the file is not correctly terminated");
 
 	DEBUGP("ok, found \\0 or \\0\\n at end");
+	status=0;
+
+ex:
+	return status;
+}
+
+
+/** Gives \a sts a new entry ID.
+ *
+ * The next free ID is stored in the \ref dir file header; if no tree was 
+ * read (eg. for \ref sync-repos), it's taken from there.
+ *
+ * If an action stored per-entry data, but failed before writing the \ref 
+ * dir file, the same IDs get handed out again; so files that are left 
+ * over for the new ID are removed. */
+static int waa___new_entry_id(struct estat *sts)
+{
+	static const char *const per_entry[]= {
+		WAA__FILE_MD5s_EXT, WAA__PROP_EXT, WAA__CONFLICT_EXT };
+	int status, version, i;
+	char *dir_mmap, *first, *cp, *eos;
+	off_t length;
+	unsigned count, subdirs, string_space;
+	struct stat st;
+
+
+	dir_mmap=NULL;
+	if (!waa___next_id)
+	{
+		status=waa___map_entries(&dir_mmap, &length, &first, 
+				&count, &subdirs, &string_space, &version, &waa___next_id);
+		if (status == -ENOENT) 
+		{
+			waa___next_id=1;
+			status=0;
+		}
+		STOPIF(status, NULL);
+		DEBUGP("next entry ID is %llu", waa___next_id);
+	}
+
+	sts->entry_id=waa___next_id++;
+
+	STOPIF( waa__get_entry_directory(sts, &cp, &eos, NULL, 0), NULL);
+	eos[-1]=0;
+	if (lstat(cp, &st) == -1)
+	{
+		STOPIF_CODE_ERR( errno != ENOENT, errno, "Cannot query %s", cp);
+		goto ex;
+	}
+
+	DEBUGP("removing stale data in %s", cp);
+	eos[-1]=PATH_SEPARATOR;
+	for(i=0; i<sizeof(per_entry)/sizeof(per_entry[0]); i++)
+	{
+		strcpy(eos, per_entry[i]);
+		STOPIF_CODE_ERR( unlink(cp) == -1 && errno != ENOENT, errno,
+				"Cannot remove %s", cp);
+	}
+
+ex:
+	if (dir_mmap) munmap(dir_mmap, length);
+	return status;
+}
+
+
+/** -.
+ *
+ * The result is like for waa__get_waa_directory(); \a flags can have \ref 
+ * GWD_MKDIR and \ref GWD_NEW_ID.
+ *
+ * If \a sts has no ID yet, and \ref GWD_NEW_ID is not given, \c ENOENT is 
+ * returned silently - such an entry has no files yet.
+ *
+ * The path of the working copy's WAA directory is only built once; after 
+ * that no hashing is needed. */
+int waa__get_entry_directory(struct estat *sts,
+		char **erg, char **eos, char **start_of_spec,
+		int flags)
+{
+	int status;
+	char *cp, *path;
+	struct stat st;
+
+
+	status=0;
+	if (!sts->entry_id)
+	{
+		if (!(flags & GWD_NEW_ID))
+		{
+			status=ENOENT;
+			goto ex;
+		}
+		STOPIF( waa___new_entry_id(sts), NULL);
+	}
+
+	if (!waa___entry_base)
+	{
+		STOPIF( waa__get_waa_directory(wc_path, &path, &cp, NULL, GWD_WAA), 
+				NULL);
+		strcpy(cp, WAA__ENTRY_DIR);
+		waa___entry_base_len=strlen(path);
+		path[waa___entry_base_len++]=PATH_SEPARATOR;
+		path[waa___entry_base_len]=0;
+		STOPIF( hlp__strdup( &waa___entry_base, path), NULL);
+	}
+
+	memcpy(waa_tmp_path, waa___entry_base, waa___entry_base_len);
+	cp=waa_tmp_path + waa___entry_base_len;
+	cp+=sprintf(cp, "%02x%c%llx", 
+			(int)(sts->entry_id & 0xff), PATH_SEPARATOR, sts->entry_id);
+
+	/* Files of a version 6 dir file that haven't been moved yet. */
+	if (waa__is_path_keyed(sts) && !(flags & GWD_NEW_ID) &&
+			lstat(waa_tmp_path, &st) == -1)
+	{
+		STOPIF_CODE_ERR( errno != ENOENT, errno, 
+				"Cannot query %s", waa_tmp_path);
+		STOPIF( ops__build_path(&path, sts), NULL);
+		DEBUGP("using the path-based directory for %s", path);
+		STOPIF( waa__get_waa_directory(path, erg, eos, start_of_spec, 
+					GWD_WAA | (flags & GWD_MKDIR)), NULL);
+		goto ex;
+	}
+
+	if (flags & GWD_MKDIR)
+		STOPIF( waa__mkdir(waa_tmp_path, 1), NULL);
+
+	*(cp++) = PATH_SEPARATOR;
+	*cp = '\0';
+
+	*erg=waa_tmp_path;
+	if (eos) *eos=cp;
+	if (start_of_spec) *start_of_spec=waa_tmp_fn;
+
+	DEBUGP("returning %s", waa_tmp_path);
+
+ex:
+	return status;
+}
+
+
+/** -.
+ * That's the case for a \ref dir file of version 6 that's read by an 
+ * action that doesn't change the WAA. */
+int waa__is_path_keyed(struct estat *sts)
+{
+	return sts->entry_id && sts->entry_id <= waa___legacy_ids;
+}
+
+
+/** Moves the per-entry files of \a sts from the path-based location 
+ * (up to \ref WAA_VERSION 6) to the one for its ID. */
+static int waa___move_entry_files(struct estat *sts)
+{
+	static const char *const per_entry[]= {
+		WAA__FILE_MD5s_EXT, WAA__PROP_EXT, WAA__CONFLICT_EXT };
+	int status, i, moved;
+	char *path, *old, *old_eos, *cp, *eos;
+	struct stat st;
+
+
+	old=NULL;
+	moved=0;
+	STOPIF( ops__build_path(&path, sts), NULL);
+	STOPIF( waa__get_waa_directory(path, &cp, &eos, NULL, GWD_WAA), NULL);
+	STOPIF( hlp__alloc( &old, waa_tmp_path_len), NULL);
+	strcpy(old, cp);
+	old_eos=old + (eos-cp);
+
+	for(i=0; i<sizeof(per_entry)/sizeof(per_entry[0]); i++)
+	{
+		strcpy(old_eos, per_entry[i]);
+		if (lstat(old, &st) == -1)
+		{
+			STOPIF_CODE_ERR( errno != ENOENT, errno, "Cannot query %s", old);
+			continue;
+		}
+
+		STOPIF( waa__get_entry_directory(sts, &cp, &eos, NULL, 
+					GWD_NEW_ID | GWD_MKDIR), NULL);
+		strcpy(eos, per_entry[i]);
+		DEBUGP("moving %s to %s", old, cp);
+		STOPIF_CODE_ERR( rename(old, cp) == -1, errno,
+				"Cannot move %s to %s", old, cp);
+		moved++;
+	}
+
+	/* The file is gone already; this removes the empty directories. */
+	if (moved)
+		STOPIF( waa___delete(old, old_eos-1, 1), NULL);
+
+ex:
+	IF_FREE(old);
+	return status;
+}
+
+
+/** -.
+ * This may silently return -ENOENT, if the waa__open fails.
+ *
+ * The \a callback is called for \b every entry read; but for performance 
+ * reasons the \c path parameter will be \c NULL.
+ * */
+int waa__input_tree(struct estat *root,
+		struct waa__entry_blocks_t **blocks,
+		action_t *callback)
+{
+	int status;
+	int i, cur, first;
+	unsigned count, subdirs, string_space;
+	/* use a cache for directories, so that the parent can be located quickly */
+	/* substitute both array with one struct estat **cache, 
+	 * which runs along ->by_inode until NULL */
+	ino_t parent;
+	char *filename;
+	struct estat *sts, *stat_mem;
+	char *strings;
+	int sts_free;
+	char *dir_mmap, *dir_end, *dir_curr;
+	off_t length;
+	struct estat *sts_tmp;
+	int version, move_files;
+	t_ull next_id, line;
+
+
+	waa__entry_block.first=root;
+	waa__entry_block.count=1;
+	waa__entry_block.next=waa__entry_block.prev=NULL;
+
+	move_files=0;
+	status=waa___map_entries(&dir_mmap, &length, &dir_curr,
+			&count, &subdirs, &string_space, &version, &next_id);
+	if (status == -ENOENT) goto ex;
+	STOPIF(status, NULL);
+	dir_end=dir_mmap+length;
+
+	if (next_id > waa___next_id)
+		waa___next_id=next_id;
+	/* A version 6 file has no IDs; the line numbers are used instead, and 
+	 * the files still keyed by path are found via the fallback in 
+	 * waa__get_entry_directory(). Actions that may change the WAA move 
+	 * them to their new place right away. */
+	if (version < 7)
+	{
+		waa___legacy_ids=count;
+		move_files=!action->is_readonly;
+	}
 
 	STOPIF( hlp__alloc( &strings, string_space), NULL);
 	root->strings=strings;
@@ -1708,6 +2293,8 @@ int waa__input_tree(struct estat *root,
 	cur=0;
 	sts_free=1;
 	first=1;
+	line=0;
+	url__subtree_index_start();
 	/* As long as there should be entries ... */
 	while ( count > 0)
 	{
@@ -1732,7 +2319,11 @@ int waa__input_tree(struct estat *root,
 		sts=first ? root : stat_mem+cur;
 
 		DEBUGP("about to parse %p = '%-.40s...'", dir_curr, dir_curr);
-		STOPIF( ops__load_1entry(&dir_curr, sts, &filename, &parent), NULL);
+		STOPIF( ops__load_1entry(&dir_curr, sts, &filename, &parent,
+					version), NULL);
+		line++;
+		if (version < 7)
+			sts->entry_id=line;
 
 		/* Should this just be a BUG_ON? To not waste space in the release 
 		 * binary just for people messing with their dir-file?  */
@@ -1775,8 +2366,20 @@ int waa__input_tree(struct estat *root,
 					sts_tmp=sts_tmp->parent;
 				}
 			}
+
+			/* Remember where the entries of an URL start, so that URL-specific 
+			 * operations needn't walk the whole tree. */
+			if (sts->url && 
+					(sts->url != sts->parent->url || !sts->parent->parent))
+				STOPIF( url__subtree_index_add(sts), NULL);
 		} /* if parent */
 
+		if (move_files)
+		{
+			STOPIF( waa___move_entry_files(sts), NULL);
+			STOPIF( prp__group_ref_rekey(sts), NULL);
+		}
+
 		/* if it's a directory, we need the child-pointers. */
 		if (S_ISDIR(sts->st.mode))
 		{
@@ -1794,6 +2397,9 @@ int waa__input_tree(struct estat *root,
 			STOPIF( callback(sts), NULL);
 	} /* while (count)  read entries */
 
+	if (move_files)
+		waa___legacy_ids=0;
+
 
 ex:
 	/* Return the first block even if we had eg. ENOENT */
@@ -1811,6 +2417,65 @@ ex:
 }
 
 
+/** -.
+ * The entries are parsed into a single \c struct \a estat, which is only 
+ * valid during the \a callback; no tree is built, and nothing but the 
+ * \ref dir file is read.
+ *
+ * \a name points into the mapped file. \a line is the number of this 
+ * entry, \a parent the number of its parent directory; the root entry is 
+ * number \c 1, and has \c 0 as parent.
+ *
+ * Like waa__input_tree() this silently returns \c -ENOENT if there is no 
+ * \ref dir file. */
+int waa__stream_entries(waa__stream_t *callback)
+{
+	int status;
+	unsigned count, subdirs, string_space, line;
+	ino_t parent;
+	char *filename;
+	struct estat sts;
+	char *dir_mmap, *dir_end, *dir_curr;
+	off_t length;
+	int i, version;
+	t_ull next_id;
+
+
+	status=waa___map_entries(&dir_mmap, &length, &dir_curr,
+			&count, &subdirs, &string_space, &version, &next_id);
+	if (status == -ENOENT) goto ex;
+	STOPIF(status, NULL);
+	dir_end=dir_mmap+length;
+
+	for(line=1; line<=count; line++)
+	{
+		TREE_DAMAGED( dir_curr>=dir_end, 
+				"An entry line has a wrong number of entries");
+
+		memset(&sts, 0, sizeof(sts));
+		STOPIF( ops__load_1entry(&dir_curr, &sts, &filename, &parent,
+					version), NULL);
+		if (version < 7)
+			sts.entry_id=line;
+
+		TREE_DAMAGED( (line == 1) != (parent == 0) || parent >= line,
+				"the parent pointers are invalid");
+
+		STOPIF( callback(&sts, filename, line, parent), NULL);
+	}
+
+ex:
+	if (dir_mmap)
+	{
+		i=munmap(dir_mmap, length);
+		if (!status)
+			STOPIF_CODE_ERR(i, errno, "munmap() failed");
+	}
+
+	return status;
+}
+
+
 /** Check whether the conditions for update and/or printing the directory
  * are fulfilled.
  *
@@ -1947,6 +2612,232 @@ ex:
 }
 
 
+/** Hashes the files that need a content check before the tree is 
+ * walked.
+ *
+ * This is done for \ref o_hash_order "hash_order=disk", to read them in 
+ * the order of their data on disk; and if all files are hashed (\ref 
+ * o_chcheck "change_check=allfiles"), as then many small files can be 
+ * hashed side by side, see cs__compare_list().
+ *
+ * The entry blocks are only looked at, not consumed. The estat::do_* bits 
+ * are set the same way as in waa__update_tree(); as that happens parent 
+ * before child and only ever sets bits, the later loop gets the same 
+ * values.
+ *
+ * The results are stored in estat::change_flag, so the cs__compare_file() 
+ * calls in ops__update_single_entry() just return them.
+ *
+ * Not used with a \ref o_deadline "deadline". */
+static int waa___prehash(struct waa__entry_blocks_t *block)
+{
+	int status;
+	struct estat *sts, **list;
+	struct sstat_t st;
+	int i, used, max, chk;
+	char *path;
+
+
+	status=0;
+	list=NULL;
+	used=max=0;
+	chk=opt__get_int(OPT__CHANGECHECK);
+	/* Without content checks nothing gets hashed; so don't do the \c 
+	 * lstat() calls twice. */
+	if (!(chk & (CHCHECK_FILE | CHCHECK_ALLFILES))) goto ex;
+
+	for(; block; block=block->next)
+		for(i=0; i<block->count; i++)
+		{
+			sts=block->first+i;
+
+			if (sts->flags & RF_ISNEW) continue;
+			if (sts->parent) ops__set_todo_bits(sts);
+
+			if (!sts->do_this_entry || 
+					!S_ISREG(sts->st.mode) ||
+					sts->change_flag != CF_UNKNOWN) 
+				continue;
+
+			/* Removed or replaced entries don't need hashing. */
+			STOPIF( ops__build_path(&path, sts), NULL);
+			if (hlp__lstat(path, &st) || !S_ISREG(st.mode)) continue;
+
+			/* Same conditions as in ops__update_single_entry(). */
+			if (!(chk & CHCHECK_ALLFILES) &&
+					!((chk & CHCHECK_FILE) && 
+						(ops__stat_to_action(sts, &st) & FS_LIKELY)))
+				continue;
+
+			if (used >= max)
+			{
+				max = max*2 + 1024;
+				STOPIF( hlp__realloc( &list, max*sizeof(*list)), NULL);
+			}
+			list[used++]=sts;
+		}
+
+	STOPIF( cs__compare_list(list, used, 
+				opt__get_int(OPT__HASH_ORDER) == HASH_ORDER_DISK), NULL);
+
+ex:
+	IF_FREE(list);
+	return status;
+}
+
+
+/** Compares two \c estat pointers, for \c qsort() and \c bsearch(). */
+static int waa___cmp_sts_ptr(const void *a, const void *b)
+{
+	const struct estat *const *l=a, *const *r=b;
+
+	return *l < *r ? -1 : *l > *r ? 1 : 0;
+}
+
+
+/** Stops waa__update_tree() because the \ref o_deadline "deadline" has 
+ * passed.
+ *
+ * The remaining entries in \a cur_block are counted in \ref 
+ * waa__unchecked, and are not shown. If \c deadline_resume is set, the 
+ * topmost of them are written into the \ref deadline file, so that the 
+ * next run can start there. */
+static int waa___deadline_stop(struct estat *root, 
+		struct waa__entry_blocks_t *cur_block)
+{
+	int status, fh, i, count, max, len;
+	struct estat *sts, **list, **sorted;
+	char *path;
+
+
+	status=0;
+	fh=-1;
+	list=sorted=NULL;
+	count=max=0;
+	for(; cur_block; cur_block=cur_block->next)
+		for(i=0; i<cur_block->count; i++)
+		{
+			sts=cur_block->first+i;
+			/* Parents come before their children, so these are correct. */
+			if (sts->parent)
+				ops__set_todo_bits(sts);
+			if (!sts->do_this_entry) continue;
+
+			if (count >= max)
+			{
+				max = max*2 + 256;
+				STOPIF( hlp__realloc( &list, max*sizeof(*list)), NULL);
+			}
+			list[count++]=sts;
+		}
+
+	DEBUGP("deadline reached, %d entries left", count);
+	waa__unchecked=count;
+
+	/* Not shown, and not handled by waa__do_sorted_tree(). */
+	for(i=0; i<count; i++)
+		list[i]->do_this_entry = list[i]->do_child_wanted = 0;
+
+
+	if (opt__get_int(OPT__DEADLINE_RESUME) == OPT__NO) goto ex;
+
+	/* Nothing done, so the next run has to do everything. */
+	if (count && list[0] == root)
+	{
+		STOPIF( waa__delete_byext(wc_path, WAA__DEADLINE_EXT, 1), NULL);
+		goto ex;
+	}
+
+	STOPIF( hlp__alloc( &sorted, count*sizeof(*sorted)), NULL);
+	memcpy(sorted, list, count*sizeof(*sorted));
+	qsort(sorted, count, sizeof(*sorted), waa___cmp_sts_ptr);
+
+	STOPIF( waa__open_byext(wc_path, WAA__DEADLINE_EXT, WAA__WRITE, &fh),
+			NULL);
+	for(i=0; i<count; i++)
+	{
+		sts=list[i];
+		/* Entries found just now aren't known on the next run; and below 
+		 * an unchecked directory everything gets checked anyway. */
+		if ((sts->flags & RF_ISNEW) ||
+				bsearch(&sts->parent, sorted, count, sizeof(*sorted), 
+					waa___cmp_sts_ptr))
+			continue;
+
+		STOPIF( ops__build_path(&path, sts), NULL);
+		len=strlen(path+2)+1;
+		STOPIF_CODE_ERR( write(fh, path+2, len) != len, errno,
+				"Cannot write the list of unchecked entries");
+	}
+
+ex:
+	if (fh != -1)
+	{
+		i=waa__close(fh, status);
+		fh=-1;
+		STOPIF( i, "closing the list of unchecked entries");
+	}
+	IF_FREE(sorted);
+	IF_FREE(list);
+	return status;
+}
+
+
+/** -.
+ * If there's no such file \a *argc is left alone. */
+int waa__deadline_list(int *argc, char ***list)
+{
+	int status, fh, count, i;
+	struct stat st;
+	char *data, **paths;
+
+
+	status=0;
+	fh=-1;
+	status=waa__open_byext(wc_path, WAA__DEADLINE_EXT, WAA__READ, &fh);
+	if (status == ENOENT) 
+	{
+		status=0;
+		goto ex;
+	}
+	STOPIF( status, NULL);
+
+	STOPIF_CODE_ERR( fstat(fh, &st) == -1, errno,
+			"Cannot get length of the list of unchecked entries");
+
+	STOPIF( hlp__alloc( &data, st.st_size+1), NULL);
+	STOPIF_CODE_ERR( read(fh, data, st.st_size) != st.st_size, errno,
+			"Cannot read the list of unchecked entries");
+	data[st.st_size]=0;
+
+	count=0;
+	for(i=0; i<st.st_size; i++)
+		if (!data[i]) count++;
+	/* An empty list would mean the whole working copy. */
+	if (!count)
+	{
+		IF_FREE(data);
+		goto ex;
+	}
+
+	STOPIF( hlp__alloc( &paths, (count+1)*sizeof(*paths)), NULL);
+	for(i=0; i<count; i++)
+	{
+		paths[i]=data;
+		data += strlen(data)+1;
+	}
+	paths[count]=NULL;
+
+	DEBUGP("resuming with %d entries", count);
+	*argc=count;
+	*list=paths;
+
+ex:
+	if (fh != -1) close(fh);
+	return status;
+}
+
+
 /** -.
  *
  * On input we expect a tree of nodes starting with \a root; the entries 
@@ -2031,8 +2922,21 @@ int waa__update_tree(struct estat *root,
 	action->keep_children=1;
 
 	status=0;
+	/* The pre-pass can't stop at the deadline; it would hash everything 
+	 * before the first check. */
+	if (!waa__deadline &&
+			(opt__get_int(OPT__HASH_ORDER) == HASH_ORDER_DISK ||
+			 (opt__get_int(OPT__CHANGECHECK) & CHCHECK_ALLFILES)))
+		STOPIF( waa___prehash(cur_block), NULL);
+
 	while (cur_block)
 	{
+		if (waa__deadline && hlp__usec_now() >= waa__deadline)
+		{
+			STOPIF( waa___deadline_stop(root, cur_block), NULL);
+			break;
+		}
+
 		/* For convenience */
 		sts=cur_block->first;
 		DEBUGP("doing update for %s ... %d left in %p",
@@ -2160,6 +3064,8 @@ next:
 		}
 
 
+		STOPIF( hlp__throttle(0), NULL);
+
 		/* Sadly there's no continue block, like in perl.
 		 * Advance the pointers. */
 		cur_block->first++;
@@ -2541,8 +3447,16 @@ only_rel_path:
 	STOPIF( waa__get_waa_directory( wc_path, &confname, &cp, NULL, GWD_CONF),
 			NULL);
 	setenv( FSVS_EXP_WC_CONF, confname, 1);
+	/* From now on the configuration files are looked for in the snapshot.  
+	 * */
+	STOPIF( snap__load(), NULL);
 	STOPIF( opt__load_settings(confname, "config", PRIO_ETC_WC ), NULL);
 
+	/* Only one process may change a working copy at once; readers don't 
+	 * wait. */
+	if (!action->is_readonly && !action->is_import_export)
+		STOPIF( waa__lock_wc(), NULL);
+
 
 	/* If this command is not filtered, or an invalid filter is defined, 
 	 * change filter to output all entries.
@@ -99,12 +99,13 @@ extern struct waa__entry_blocks_t waa__entry_block;
  * The filelists remember the last committed state of entries. That 
  * includes the ctime, mtime, unix-mode (with flags for 
  * directory/device/symlink/file), MD5 sum, size in bytes, inode, tree 
- * relation, number of child nodes, user and group, and filename.  The path 
- * can be recreated from the tree-structure and the filenames.
+ * relation, number of child nodes, user and group, \ref ids "entry ID" and 
+ * filename.  The path can be recreated from the tree-structure and the 
+ * filenames.
  *
  * The header includes fields such as header version, header length, number 
- * of entries, needed space for the filenames, and the length of the 
- * longest path - most of that for memory allocation.
+ * of entries, needed space for the filenames, the length of the longest 
+ * path - most of that for memory allocation - and the next free entry ID.
  * 
  * See also \a waa__output_tree().
  * */
@@ -129,16 +130,70 @@ extern struct waa__entry_blocks_t waa__entry_block;
  * stored relative to the wc root, without the leading \c "./", ie. as \c 
  * "dir/test". The \c \\0 is included in the data.  */
 #define WAA__COPYFROM_EXT		"Copy"
+/** \anchor gprop Auto-properties of groups, and references to them.
+ * Keys starting with \c ":" hold the user-defined auto-properties of a 
+ * group as a <tt>name\\0value\\0...</tt> list; the other keys are entry 
+ * IDs (in hex; up to \ref WAA_VERSION 6 the entry paths, like \c 
+ * "./dir/file"), and their value is the key of the list they use.
+ * This way adding many entries of a group needs no \ref prop file per 
+ * entry; see \ref prp__open_byestat(). */
+#define WAA__GROUP_PROP_EXT		"gprop"
+/** \anchor lock Lock file for processes changing the working copy.
+ * It contains the PID of the process holding the lock; see 
+ * waa__lock_wc(). */
+#define WAA__LOCK_EXT		"lock"
+/** \anchor upd Journal of an update in progress.
+ * For each file that has been fetched completely a record with the 
+ * revision, the MD5 (in hex) and the path, terminated by a \c \\0, is 
+ * appended; if the update gets interrupted, the next try needn't fetch 
+ * these files again. See \ref up__resume_check().
+ * \ref checkout and \ref export don't write this journal. */
+#define WAA__UPDATE_JOURNAL_EXT		"upd"
+/** \anchor snap Snapshot of the configuration files.
+ * Holds the contents of the working copy configuration, URL list, ignore 
+ * list and group definitions, along with the device, inode, size and 
+ * mtime they had; see \ref snapshot.c. */
+#define WAA__SNAPSHOT_EXT		"snap"
+/** \anchor tree Image of the entries tree.
+ * Has the same data as the \ref dir file, but in fixed-size records with 
+ * offsets instead of pointers, so that it can be used directly after \c 
+ * mmap(); see \ref image.c and \ref o_tree_image. */
+#define WAA__TREE_IMAGE_EXT		"tree"
+/** \anchor spool Directory of local commits that are not pushed yet.
+ * Each commit is a numbered subdirectory with the message, a list of the
+ * entries and copies of their data; see \ref spool.c and \ref push. */
+#define WAA__SPOOL_EXT		"spool"
+/** \anchor deadline Entries that were not checked by the last \ref 
+ * status because of the \ref o_deadline "deadline"; a list of \c \\0 
+ * terminated paths, relative to the working copy root. */
+#define WAA__DEADLINE_EXT		"deadline"
+/** \anchor hot Change statistics.
+ * How often the most often changed entries were committed with changes, 
+ * with their \c lstat() data; see \ref hot.c and \ref o_hot_first. */
+#define WAA__HOT_EXT		"hot"
 /** \anchor readme Information file.
  * Here a short explanation for this directory is stored. */
 #define WAA__README		"README.txt"
 /** @} */
 
 /** \anchor waa_file \name Per file/directory
- * The cached information (per-file) are located in the \c cache 
- * subdirectory of the WAA; two subdirectory levels are created below that.  
+ * The cached information (per-file) are located in the \ref ids 
+ * subdirectory of the working copy's WAA directory; they're addressed by 
+ * the \ref estat::entry_id "entry ID" that is stored in the \ref dir file, 
+ * so that no path needs to be built and hashed to find them.
  *
  * @{ */
+/** \anchor ids Directory for the per-entry files.
+ * Below it there's a directory named by the low byte of the entry ID (two 
+ * hex digits), and in that a directory named by the full entry ID (in 
+ * hex); that holds the files listed below.
+ *
+ * Before \ref WAA_VERSION 7 these files were addressed by the MD5 of the 
+ * entry's path, like the per working copy directories; a \ref dir file of 
+ * version 6 gets the line numbers of the entries as IDs, and the files are 
+ * moved over the first time the tree is loaded by an action that may 
+ * change the WAA. */
+#define WAA__ENTRY_DIR		"ids"
 /** \anchor md5s List of MD5s of the manber blocks of a file.
  *
  * To speed up comparing and committing large files, these files hold a 
@@ -195,7 +250,8 @@ extern struct waa__entry_blocks_t waa__entry_block;
 		max(                                             \
 			max(strlen(WAA__CONFLICT_EXT),                 \
 				strlen(WAA__COPYFROM_EXT)),                  \
-			strlen(WAA__IGNORE_EXT) ),										 \
+			max(strlen(WAA__IGNORE_EXT),                   \
+				strlen(WAA__GROUP_PROP_EXT)) ),              \
 		max(                                             \
 			max(max(strlen(WAA__DIR_EXT),                  \
 					strlen(WAA__FILE_MD5s_EXT)),               \
@@ -214,6 +270,8 @@ int waa__init(void);
 
 /** Create a directory; ignore \c EEXIST. */
 int waa__mkdir_mask(char *dir, int including_last, int mask);
+/** Makes sure that no other process changes the working copy. */
+int waa__lock_wc(void);
 /** Create a directory, ignore \c EEXIST, and use a default mask. */
 int waa__mkdir(char *dir, int including_last);
 
@@ -235,10 +293,19 @@ int waa__open_dir(char *directory,
 int waa__build_tree(struct estat *root);
 /** Write the \ref dir file for this \c root . */
 int waa__output_tree(struct estat *root);
+/** Creates the entries below \c root, and writes them into the \ref dir 
+ * file as they're read. */
+int waa__build_output_tree(struct estat *root);
 /** Read the \ref dir file for the current working directory. */
 int waa__input_tree(struct estat *root,
 		struct waa__entry_blocks_t **blocks,
 		action_t *callback);
+/** Callback for waa__stream_entries(). */
+typedef int (waa__stream_t)(struct estat *sts, char *name, 
+		unsigned line, unsigned parent);
+/** Calls \a callback for each entry in the \ref dir file, without 
+ * building a tree. */
+int waa__stream_entries(waa__stream_t *callback);
 /** Wrapper function for \c waa__open(). */
 int waa__open_byext(const char *directory,
 		const char *extension,
@@ -258,6 +325,15 @@ int waa__make_info_file(char *directory, char *name, char *dest);
 int waa__delete_byext(char *path, 
 		char *extension,
 		int ignore_not_exist);
+/** Like waa__open_byext(), but for the per-entry files of \a sts. */
+int waa__open_entry(struct estat *sts,
+		const char *extension,
+		int mode,
+		int *fh);
+/** Like waa__delete_byext(), but for the per-entry files of \a sts. */
+int waa__delete_entry(struct estat *sts,
+		char *extension,
+		int ignore_not_exist);
 /** Reads the entry tree or, if none stored, builds one. */
 int waa__read_or_build_tree(struct estat *root, 
 		int argc, char *normalized[], char *orig[],
@@ -297,11 +373,20 @@ int waa__set_working_copy(const char * const wc_dir);
 #define GWD_CONF (2)
 /** The intermediate directories should be created. */
 #define GWD_MKDIR (4)
+/** For waa__get_entry_directory(): if the entry has no ID yet, assign 
+ * one. */
+#define GWD_NEW_ID (8)
 /** This function determines the directory used in the WAA area for the 
  * given \a path. */
 int waa__get_waa_directory(const char *path, 
 		char **erg, char **eos, char **start_of_spec,
 		int flags);
+/** Determines the directory for the per-entry files of \a sts. */
+int waa__get_entry_directory(struct estat *sts,
+		char **erg, char **eos, char **start_of_spec,
+		int flags);
+/** Tells whether the data of \a sts may still be keyed by its path. */
+int waa__is_path_keyed(struct estat *sts);
 /** Function that returns the right flag for the wanted file.
  * To be used in calls of \ref waa__get_waa_directory(). */
 static inline int waa__get_gwd_flag(const char *const extension)
@@ -348,7 +433,7 @@ int waa__copy_entries(struct estat *src, struct estat *dest);
 /** How many bytes the \ref dir file header has. */
 #define HEADER_LEN (64)
 /** Which version does the dir file have? */
-#define WAA_VERSION (6)
+#define WAA_VERSION (7)
 
 /** Copy URL revision number.
  * The problem on commit is that we send a number of entries to the 
@@ -366,6 +451,14 @@ int waa__get_tmp_name(const char *base_dir,
 		apr_pool_t *pool);
 
 
+/** If set, waa__update_tree() stops at that time (as returned by 
+ * hlp__usec_now()); see \ref o_deadline. */
+extern long long waa__deadline;
+/** How many entries were not checked because of the \ref waa__deadline. */
+extern int waa__unchecked;
+/** Returns the paths stored in the \ref deadline file. */
+int waa__deadline_list(int *argc, char ***list);
+
 /** Our current WC base. */
 extern char *wc_path;
 /** How much bytes the \ref wc_path has. */